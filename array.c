@@ -0,0 +1,878 @@
+#include "config.h"
+#include "error.h"
+#include <limits.h>
+
+/*
+   array.c
+   紧凑存储的数值数组 (i64 / f64)，以及对应的向量化内核。
+   数组内容不可变，lval_copy 只增加引用计数；运算结果写入新数组，
+   当第一个参数是唯一引用时直接原地复用它的存储。
+   x86-64 上以 SSE2 为基线，运行时检测到 AVX2 时切换到 256 位内核，
+   其他平台使用标量实现。
+
+   同一份存储也用于全数字 Q-Expression 的紧凑表示 (见文件末尾)。
+*/
+
+#if defined(__x86_64__) && defined(__LP64__)
+#define ARR_X86 1
+#include <immintrin.h>
+#endif
+
+enum { ARR_OP_ADD, ARR_OP_SUB, ARR_OP_MUL, ARR_OP_DIV };
+enum { ARR_RED_SUM, ARR_RED_MIN, ARR_RED_MAX };
+
+/* --- 标量内核 (所有平台的兜底，也用于处理 SIMD 剩余的尾部) --- */
+
+static void f64_binop_scalar(int op, double* r, const double* x, const double* y, long n) {
+  switch (op) {
+    case ARR_OP_ADD: for (long i = 0; i < n; i++) { r[i] = x[i] + y[i]; } break;
+    case ARR_OP_SUB: for (long i = 0; i < n; i++) { r[i] = x[i] - y[i]; } break;
+    case ARR_OP_MUL: for (long i = 0; i < n; i++) { r[i] = x[i] * y[i]; } break;
+    case ARR_OP_DIV: for (long i = 0; i < n; i++) { r[i] = x[i] / y[i]; } break;
+  }
+}
+
+static void f64_scale_scalar(double* r, const double* x, double k, long n) {
+  for (long i = 0; i < n; i++) { r[i] = x[i] * k; }
+}
+
+static double f64_reduce_scalar(int op, const double* x, long n) {
+  double acc = (op == ARR_RED_SUM) ? 0.0 : x[0];
+  for (long i = 0; i < n; i++) {
+    if (op == ARR_RED_SUM) { acc += x[i]; }
+    if (op == ARR_RED_MIN && x[i] < acc) { acc = x[i]; }
+    if (op == ARR_RED_MAX && x[i] > acc) { acc = x[i]; }
+  }
+  return acc;
+}
+
+static double f64_dot_scalar(const double* x, const double* y, long n) {
+  double acc = 0.0;
+  for (long i = 0; i < n; i++) { acc += x[i] * y[i]; }
+  return acc;
+}
+
+/* i64 的加减乘按 64 位补码回绕，与 SIMD 内核的结果一致 (用 unsigned long 计算，避免有符号溢出) */
+#define I64_WRAP(a, op, b) ((long)((unsigned long)(a) op (unsigned long)(b)))
+
+static void i64_binop_scalar(int op, long* r, const long* x, const long* y, long n) {
+  switch (op) {
+    case ARR_OP_ADD: for (long i = 0; i < n; i++) { r[i] = I64_WRAP(x[i], +, y[i]); } break;
+    case ARR_OP_SUB: for (long i = 0; i < n; i++) { r[i] = I64_WRAP(x[i], -, y[i]); } break;
+    case ARR_OP_MUL: for (long i = 0; i < n; i++) { r[i] = I64_WRAP(x[i], *, y[i]); } break;
+    case ARR_OP_DIV: for (long i = 0; i < n; i++) { r[i] = x[i] / y[i]; } break;
+  }
+}
+
+static long i64_reduce_scalar(int op, const long* x, long n) {
+  long acc = (op == ARR_RED_SUM) ? 0 : x[0];
+  for (long i = 0; i < n; i++) {
+    if (op == ARR_RED_SUM) { acc = I64_WRAP(acc, +, x[i]); }
+    if (op == ARR_RED_MIN && x[i] < acc) { acc = x[i]; }
+    if (op == ARR_RED_MAX && x[i] > acc) { acc = x[i]; }
+  }
+  return acc;
+}
+
+#ifdef ARR_X86
+
+/* --- SSE2 内核 (x86-64 基线，一次处理 2 个 double / 2 个 long) --- */
+
+static void f64_binop_sse2(int op, double* r, const double* x, const double* y, long n) {
+  long i = 0;
+  switch (op) {
+    case ARR_OP_ADD:
+      for (; i + 2 <= n; i += 2) { _mm_storeu_pd(r+i, _mm_add_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i))); }
+      break;
+    case ARR_OP_SUB:
+      for (; i + 2 <= n; i += 2) { _mm_storeu_pd(r+i, _mm_sub_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i))); }
+      break;
+    case ARR_OP_MUL:
+      for (; i + 2 <= n; i += 2) { _mm_storeu_pd(r+i, _mm_mul_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i))); }
+      break;
+    case ARR_OP_DIV:
+      for (; i + 2 <= n; i += 2) { _mm_storeu_pd(r+i, _mm_div_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i))); }
+      break;
+  }
+  f64_binop_scalar(op, r+i, x+i, y+i, n-i);
+}
+
+static void f64_scale_sse2(double* r, const double* x, double k, long n) {
+  long i = 0;
+  __m128d vk = _mm_set1_pd(k);
+  for (; i + 2 <= n; i += 2) { _mm_storeu_pd(r+i, _mm_mul_pd(_mm_loadu_pd(x+i), vk)); }
+  f64_scale_scalar(r+i, x+i, k, n-i);
+}
+
+static double f64_reduce_sse2(int op, const double* x, long n) {
+  if (n < 4) { return f64_reduce_scalar(op, x, n); }
+  long i = 4;
+  __m128d a0 = _mm_loadu_pd(x);
+  __m128d a1 = _mm_loadu_pd(x+2);
+  for (; i + 4 <= n; i += 4) {
+    __m128d v0 = _mm_loadu_pd(x+i);
+    __m128d v1 = _mm_loadu_pd(x+i+2);
+    if (op == ARR_RED_SUM) { a0 = _mm_add_pd(a0, v0); a1 = _mm_add_pd(a1, v1); }
+    if (op == ARR_RED_MIN) { a0 = _mm_min_pd(a0, v0); a1 = _mm_min_pd(a1, v1); }
+    if (op == ARR_RED_MAX) { a0 = _mm_max_pd(a0, v0); a1 = _mm_max_pd(a1, v1); }
+  }
+  double lanes[4];
+  _mm_storeu_pd(lanes, a0);
+  _mm_storeu_pd(lanes+2, a1);
+  double acc = f64_reduce_scalar(op, lanes, 4);
+  if (i < n) {
+    double rest = f64_reduce_scalar(op, x+i, n-i);
+    if (op == ARR_RED_SUM) { acc += rest; }
+    if (op == ARR_RED_MIN && rest < acc) { acc = rest; }
+    if (op == ARR_RED_MAX && rest > acc) { acc = rest; }
+  }
+  return acc;
+}
+
+static double f64_dot_sse2(const double* x, const double* y, long n) {
+  long i = 0;
+  __m128d a0 = _mm_setzero_pd();
+  __m128d a1 = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(x+i), _mm_loadu_pd(y+i)));
+    a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(x+i+2), _mm_loadu_pd(y+i+2)));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+  return lanes[0] + lanes[1] + f64_dot_scalar(x+i, y+i, n-i);
+}
+
+static void i64_binop_sse2(int op, long* r, const long* x, const long* y, long n) {
+  long i = 0;
+  /* SSE2 没有 64 位整数乘除指令，乘除直接走标量 */
+  if (op == ARR_OP_ADD) {
+    for (; i + 2 <= n; i += 2) {
+      __m128i v = _mm_add_epi64(_mm_loadu_si128((const __m128i*)(x+i)), _mm_loadu_si128((const __m128i*)(y+i)));
+      _mm_storeu_si128((__m128i*)(r+i), v);
+    }
+  }
+  if (op == ARR_OP_SUB) {
+    for (; i + 2 <= n; i += 2) {
+      __m128i v = _mm_sub_epi64(_mm_loadu_si128((const __m128i*)(x+i)), _mm_loadu_si128((const __m128i*)(y+i)));
+      _mm_storeu_si128((__m128i*)(r+i), v);
+    }
+  }
+  i64_binop_scalar(op, r+i, x+i, y+i, n-i);
+}
+
+static long i64_reduce_sse2(int op, const long* x, long n) {
+  /* 64 位比较要到 SSE4.2 才有，min/max 在 SSE2 下走标量 */
+  if (op != ARR_RED_SUM) { return i64_reduce_scalar(op, x, n); }
+  long i = 0;
+  __m128i a0 = _mm_setzero_si128();
+  __m128i a1 = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    a0 = _mm_add_epi64(a0, _mm_loadu_si128((const __m128i*)(x+i)));
+    a1 = _mm_add_epi64(a1, _mm_loadu_si128((const __m128i*)(x+i+2)));
+  }
+  long lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(a0, a1));
+  return I64_WRAP(I64_WRAP(lanes[0], +, lanes[1]), +, i64_reduce_scalar(op, x+i, n-i));
+}
+
+/* --- AVX2 内核 (运行时检测，一次处理 4 个 double / 4 个 long) --- */
+
+#define ARR_AVX2 __attribute__((target("avx2")))
+
+ARR_AVX2 static void f64_binop_avx2(int op, double* r, const double* x, const double* y, long n) {
+  long i = 0;
+  switch (op) {
+    case ARR_OP_ADD:
+      for (; i + 4 <= n; i += 4) { _mm256_storeu_pd(r+i, _mm256_add_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i))); }
+      break;
+    case ARR_OP_SUB:
+      for (; i + 4 <= n; i += 4) { _mm256_storeu_pd(r+i, _mm256_sub_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i))); }
+      break;
+    case ARR_OP_MUL:
+      for (; i + 4 <= n; i += 4) { _mm256_storeu_pd(r+i, _mm256_mul_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i))); }
+      break;
+    case ARR_OP_DIV:
+      for (; i + 4 <= n; i += 4) { _mm256_storeu_pd(r+i, _mm256_div_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i))); }
+      break;
+  }
+  f64_binop_scalar(op, r+i, x+i, y+i, n-i);
+}
+
+ARR_AVX2 static void f64_scale_avx2(double* r, const double* x, double k, long n) {
+  long i = 0;
+  __m256d vk = _mm256_set1_pd(k);
+  for (; i + 4 <= n; i += 4) { _mm256_storeu_pd(r+i, _mm256_mul_pd(_mm256_loadu_pd(x+i), vk)); }
+  f64_scale_scalar(r+i, x+i, k, n-i);
+}
+
+ARR_AVX2 static double f64_reduce_avx2(int op, const double* x, long n) {
+  if (n < 8) { return f64_reduce_scalar(op, x, n); }
+  long i = 8;
+  __m256d a0 = _mm256_loadu_pd(x);
+  __m256d a1 = _mm256_loadu_pd(x+4);
+  for (; i + 8 <= n; i += 8) {
+    __m256d v0 = _mm256_loadu_pd(x+i);
+    __m256d v1 = _mm256_loadu_pd(x+i+4);
+    if (op == ARR_RED_SUM) { a0 = _mm256_add_pd(a0, v0); a1 = _mm256_add_pd(a1, v1); }
+    if (op == ARR_RED_MIN) { a0 = _mm256_min_pd(a0, v0); a1 = _mm256_min_pd(a1, v1); }
+    if (op == ARR_RED_MAX) { a0 = _mm256_max_pd(a0, v0); a1 = _mm256_max_pd(a1, v1); }
+  }
+  double lanes[8];
+  _mm256_storeu_pd(lanes, a0);
+  _mm256_storeu_pd(lanes+4, a1);
+  double acc = f64_reduce_scalar(op, lanes, 8);
+  if (i < n) {
+    double rest = f64_reduce_scalar(op, x+i, n-i);
+    if (op == ARR_RED_SUM) { acc += rest; }
+    if (op == ARR_RED_MIN && rest < acc) { acc = rest; }
+    if (op == ARR_RED_MAX && rest > acc) { acc = rest; }
+  }
+  return acc;
+}
+
+ARR_AVX2 static double f64_dot_avx2(const double* x, const double* y, long n) {
+  long i = 0;
+  __m256d a0 = _mm256_setzero_pd();
+  __m256d a1 = _mm256_setzero_pd();
+  for (; i + 8 <= n; i += 8) {
+    a0 = _mm256_add_pd(a0, _mm256_mul_pd(_mm256_loadu_pd(x+i), _mm256_loadu_pd(y+i)));
+    a1 = _mm256_add_pd(a1, _mm256_mul_pd(_mm256_loadu_pd(x+i+4), _mm256_loadu_pd(y+i+4)));
+  }
+  double lanes[4];
+  _mm256_storeu_pd(lanes, _mm256_add_pd(a0, a1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + f64_dot_scalar(x+i, y+i, n-i);
+}
+
+ARR_AVX2 static void i64_binop_avx2(int op, long* r, const long* x, const long* y, long n) {
+  long i = 0;
+  if (op == ARR_OP_ADD) {
+    for (; i + 4 <= n; i += 4) {
+      __m256i v = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(x+i)), _mm256_loadu_si256((const __m256i*)(y+i)));
+      _mm256_storeu_si256((__m256i*)(r+i), v);
+    }
+  }
+  if (op == ARR_OP_SUB) {
+    for (; i + 4 <= n; i += 4) {
+      __m256i v = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)(x+i)), _mm256_loadu_si256((const __m256i*)(y+i)));
+      _mm256_storeu_si256((__m256i*)(r+i), v);
+    }
+  }
+  i64_binop_scalar(op, r+i, x+i, y+i, n-i);
+}
+
+ARR_AVX2 static long i64_reduce_avx2(int op, const long* x, long n) {
+  if (n < 4) { return i64_reduce_scalar(op, x, n); }
+  long i = 4;
+  __m256i acc = _mm256_loadu_si256((const __m256i*)x);
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(x+i));
+    if (op == ARR_RED_SUM) { acc = _mm256_add_epi64(acc, v); }
+    /* blendv 按字节选择，cmpgt 的结果整条 64 位全 0 或全 1，所以可以安全使用 */
+    if (op == ARR_RED_MIN) { acc = _mm256_blendv_epi8(acc, v, _mm256_cmpgt_epi64(acc, v)); }
+    if (op == ARR_RED_MAX) { acc = _mm256_blendv_epi8(acc, v, _mm256_cmpgt_epi64(v, acc)); }
+  }
+  long lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, acc);
+  long res = i64_reduce_scalar(op, lanes, 4);
+  if (i < n) {
+    long rest = i64_reduce_scalar(op, x+i, n-i);
+    if (op == ARR_RED_SUM) { res = I64_WRAP(res, +, rest); }
+    if (op == ARR_RED_MIN && rest < res) { res = rest; }
+    if (op == ARR_RED_MAX && rest > res) { res = rest; }
+  }
+  return res;
+}
+
+#endif
+
+/* --- 运行时分派表 --- */
+
+static struct {
+  int ready;
+  void (*f64_binop)(int op, double* r, const double* x, const double* y, long n);
+  void (*f64_scale)(double* r, const double* x, double k, long n);
+  double (*f64_reduce)(int op, const double* x, long n);
+  double (*f64_dot)(const double* x, const double* y, long n);
+  void (*i64_binop)(int op, long* r, const long* x, const long* y, long n);
+  long (*i64_reduce)(int op, const long* x, long n);
+} K;
+
+static void arr_kernels_init(void) {
+  if (K.ready) { return; }
+  K.f64_binop = f64_binop_scalar;
+  K.f64_scale = f64_scale_scalar;
+  K.f64_reduce = f64_reduce_scalar;
+  K.f64_dot = f64_dot_scalar;
+  K.i64_binop = i64_binop_scalar;
+  K.i64_reduce = i64_reduce_scalar;
+#ifdef ARR_X86
+  K.f64_binop = f64_binop_sse2;
+  K.f64_scale = f64_scale_sse2;
+  K.f64_reduce = f64_reduce_sse2;
+  K.f64_dot = f64_dot_sse2;
+  K.i64_binop = i64_binop_sse2;
+  K.i64_reduce = i64_reduce_sse2;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    K.f64_binop = f64_binop_avx2;
+    K.f64_scale = f64_scale_avx2;
+    K.f64_reduce = f64_reduce_avx2;
+    K.f64_dot = f64_dot_avx2;
+    K.i64_binop = i64_binop_avx2;
+    K.i64_reduce = i64_reduce_avx2;
+  }
+#endif
+  K.ready = 1;
+}
+
+/* --- 数组值 --- */
+
+#define ARR_ELEM_SIZE(kind) ((kind) == ARR_I64 ? sizeof(long) : (kind) == ARR_F64 ? sizeof(double) : sizeof(lval*))
+
+static lval_arr_t* arr_store_new(int kind, long count) {
+  lval_arr_t* s = malloc(sizeof(lval_arr_t));
+  s->ref_count = 1;
+  s->kind = kind;
+  s->count = count;
+  s->data = malloc((count ? count : 1) * ARR_ELEM_SIZE(kind));
+  return s;
+}
+
+lval* lval_arr(int kind, long count) {
+  lval* v = lval_alloc();
+  v->type = LVAL_ARR;
+  v->arr = arr_store_new(kind, count);
+  return v;
+}
+
+void lval_arr_release(lval_arr_t* a) {
+  a->ref_count--;
+  if (a->ref_count == 0) {
+    if (a->kind == ARR_LVAL) {
+      for (long i = 0; i < a->count; i++) { lval_del(((lval**)a->data)[i]); }
+    }
+    free(a->data);
+    free(a);
+  }
+}
+
+int lval_arr_eq(lval* x, lval* y) {
+  lval_arr_t* a = x->arr;
+  lval_arr_t* b = y->arr;
+  if (a->kind != b->kind || a->count != b->count) { return 0; }
+  for (long i = 0; i < a->count; i++) {
+    if (a->kind == ARR_I64 && ((long*)a->data)[i] != ((long*)b->data)[i]) { return 0; }
+    if (a->kind == ARR_F64 && ((double*)a->data)[i] != ((double*)b->data)[i]) { return 0; }
+  }
+  return 1;
+}
+
+static void arr_write_items(lbuf* b, lval_arr_t* a) {
+  for (long i = 0; i < a->count; i++) {
+    if (a->kind == ARR_I64) { lbuf_long(b, ((long*)a->data)[i]); }
+    else { lbuf_double(b, ((double*)a->data)[i]); }
+    if (i != a->count - 1) { lbuf_putc(b, ' '); }
+  }
+}
+
+void lval_arr_write(lbuf* b, lval* v) {
+  lbuf_puts(b, v->arr->kind == ARR_I64 ? "#i64{" : "#f64{");
+  arr_write_items(b, v->arr);
+  lbuf_putc(b, '}');
+}
+
+static int dec_is_i64(double d) {
+  return d >= -0x1p63 && d < 0x1p63 && d == (double)(long)d;
+}
+
+/* 把 i64 数组转换成临时的 double 缓冲区，f64 数组直接返回原存储 */
+static double* arr_as_f64(lval_arr_t* a) {
+  if (a->kind == ARR_F64) { return a->data; }
+  double* d = malloc((a->count ? a->count : 1) * sizeof(double));
+  for (long i = 0; i < a->count; i++) { d[i] = (double)((long*)a->data)[i]; }
+  return d;
+}
+
+/* 结果存储：第一个参数是唯一引用且类型一致时原地复用，否则新建 */
+static lval* arr_result(lval* a, int kind) {
+  lval* x = a->cell[0];
+  if (x->arr->ref_count == 1 && x->arr->kind == kind) {
+    return lval_pop(a, 0);
+  }
+  return lval_arr(kind, x->arr->count);
+}
+
+static lval* arr_from_qexpr(lval* a, int kind, char* func) {
+  LASSERT_NUM(func, a, 1);
+  LASSERT_TYPE(func, a, 0, LVAL_QEXPR);
+
+  lval* q = a->cell[0];
+
+  /* 已经是同类紧凑存储的列表直接共享存储 */
+  if (q->arr && q->arr->kind == kind) {
+    lval* v = lval_alloc();
+    v->type = LVAL_ARR;
+    v->arr = q->arr;
+    v->arr->ref_count++;
+    lval_del(a);
+    return v;
+  }
+  lval_unpack(q);
+
+  for (int i = 0; i < q->count; i++) {
+    LASSERT(a, q->cell[i]->type == LVAL_NUM || q->cell[i]->type == LVAL_DEC,
+      "Function '%s' passed non-numeric element %i. Got %s, Expected %s.",
+      func, i, ltype_name(q->cell[i]->type), ltype_name(LVAL_NUM));
+    /* 小数只接受 i64 范围内的整数值，不做截断 (NaN 也在这里被拒绝) */
+    LASSERT(a, kind != ARR_I64 || q->cell[i]->type == LVAL_NUM || dec_is_i64(q->cell[i]->dec),
+      "Function '%s' passed non-integer element %i. Got %g, Expected an integer in the i64 range.",
+      func, i, q->cell[i]->dec);
+  }
+
+  lval* v = lval_arr(kind, q->count);
+  for (int i = 0; i < q->count; i++) {
+    lval* x = q->cell[i];
+    if (kind == ARR_I64) {
+      ((long*)v->arr->data)[i] = x->type == LVAL_NUM ? x->num : (long)x->dec;  /* 上面已检查是整数 */
+    } else {
+      ((double*)v->arr->data)[i] = x->type == LVAL_NUM ? (double)x->num : x->dec;
+    }
+  }
+  lval_del(a);
+  return v;
+}
+
+lval* builtin_arr_i64(lenv* e, lval* a) {
+  return arr_from_qexpr(a, ARR_I64, "arr-i64");
+}
+
+lval* builtin_arr_f64(lenv* e, lval* a) {
+  return arr_from_qexpr(a, ARR_F64, "arr-f64");
+}
+
+lval* builtin_arr_to_list(lenv* e, lval* a) {
+  LASSERT_NUM("arr->list", a, 1);
+  LASSERT_TYPE("arr->list", a, 0, LVAL_ARR);
+
+  /* 结果是共享同一份存储的紧凑 Q-Expression，不逐个装箱 */
+  lval* q = lval_qexpr();
+  q->arr = a->cell[0]->arr;
+  q->arr->ref_count++;
+  q->count = q->arr->count;
+  lval_del(a);
+  return q;
+}
+
+static lval* builtin_arr_op(lenv* e, lval* a, int op, char* func) {
+  LASSERT_NUM(func, a, 2);
+  LASSERT_TYPE(func, a, 0, LVAL_ARR);
+  LASSERT_TYPE(func, a, 1, LVAL_ARR);
+
+  lval_arr_t* x = a->cell[0]->arr;
+  lval_arr_t* y = a->cell[1]->arr;
+  LASSERT(a, x->count == y->count,
+    "Function '%s' passed arrays of different length. Got %li and %li.", func, x->count, y->count);
+
+  arr_kernels_init();
+  long n = x->count;
+
+  if (x->kind == ARR_I64 && y->kind == ARR_I64) {
+    if (op == ARR_OP_DIV) {
+      /* 除数为 0 和 LONG_MIN / -1 在硬件上都会触发 SIGFPE，先逐个检查 */
+      const long* xs = x->data;
+      const long* ys = y->data;
+      for (long i = 0; i < n; i++) {
+        LASSERT(a, ys[i] != 0, "Division By Zero!");
+        LASSERT(a, !(xs[i] == LONG_MIN && ys[i] == -1),
+          "Function '%s' overflowed: %li / -1 at index %li.", func, xs[i], i);
+      }
+    }
+    lval* r = arr_result(a, ARR_I64);
+    K.i64_binop(op, r->arr->data, x->data, y->data, n);
+    lval_del(a);
+    return r;
+  }
+
+  double* xd = arr_as_f64(x);
+  double* yd = arr_as_f64(y);
+  lval* r = arr_result(a, ARR_F64);
+  K.f64_binop(op, r->arr->data, xd, yd, n);
+  if (xd != x->data) { free(xd); }
+  if (yd != y->data) { free(yd); }
+  lval_del(a);
+  return r;
+}
+
+lval* builtin_arr_add(lenv* e, lval* a) {
+  return builtin_arr_op(e, a, ARR_OP_ADD, "arr+");
+}
+
+lval* builtin_arr_sub(lenv* e, lval* a) {
+  return builtin_arr_op(e, a, ARR_OP_SUB, "arr-");
+}
+
+lval* builtin_arr_mul(lenv* e, lval* a) {
+  return builtin_arr_op(e, a, ARR_OP_MUL, "arr*");
+}
+
+lval* builtin_arr_div(lenv* e, lval* a) {
+  return builtin_arr_op(e, a, ARR_OP_DIV, "arr/");
+}
+
+lval* builtin_arr_dot(lenv* e, lval* a) {
+  LASSERT_NUM("dot", a, 2);
+  LASSERT_TYPE("dot", a, 0, LVAL_ARR);
+  LASSERT_TYPE("dot", a, 1, LVAL_ARR);
+
+  lval_arr_t* x = a->cell[0]->arr;
+  lval_arr_t* y = a->cell[1]->arr;
+  LASSERT(a, x->count == y->count,
+    "Function 'dot' passed arrays of different length. Got %li and %li.", x->count, y->count);
+
+  arr_kernels_init();
+  lval* r;
+  if (x->kind == ARR_I64 && y->kind == ARR_I64) {
+    long acc = 0;
+    for (long i = 0; i < x->count; i++) { acc = I64_WRAP(acc, +, I64_WRAP(((long*)x->data)[i], *, ((long*)y->data)[i])); }
+    r = lval_num(acc);
+  } else {
+    double* xd = arr_as_f64(x);
+    double* yd = arr_as_f64(y);
+    r = lval_dec(K.f64_dot(xd, yd, x->count));
+    if (xd != x->data) { free(xd); }
+    if (yd != y->data) { free(yd); }
+  }
+  lval_del(a);
+  return r;
+}
+
+static lval* builtin_arr_reduce(lenv* e, lval* a, int op, char* func) {
+  LASSERT_NUM(func, a, 1);
+  LASSERT_TYPE(func, a, 0, LVAL_ARR);
+
+  lval_arr_t* x = a->cell[0]->arr;
+  LASSERT(a, op == ARR_RED_SUM || x->count > 0, "Function '%s' passed empty array!", func);
+
+  arr_kernels_init();
+  lval* r = x->kind == ARR_I64
+    ? lval_num(K.i64_reduce(op, x->data, x->count))
+    : lval_dec(K.f64_reduce(op, x->data, x->count));
+  lval_del(a);
+  return r;
+}
+
+lval* builtin_arr_sum(lenv* e, lval* a) {
+  return builtin_arr_reduce(e, a, ARR_RED_SUM, "arr-sum");
+}
+
+lval* builtin_arr_min(lenv* e, lval* a) {
+  return builtin_arr_reduce(e, a, ARR_RED_MIN, "arr-min");
+}
+
+lval* builtin_arr_max(lenv* e, lval* a) {
+  return builtin_arr_reduce(e, a, ARR_RED_MAX, "arr-max");
+}
+
+lval* builtin_arr_scale(lenv* e, lval* a) {
+  LASSERT_NUM("scale", a, 2);
+  LASSERT_TYPE("scale", a, 0, LVAL_ARR);
+  LASSERT(a, a->cell[1]->type == LVAL_NUM || a->cell[1]->type == LVAL_DEC,
+    "Function 'scale' passed incorrect type for argument 1. Got %s, Expected %s.",
+    ltype_name(a->cell[1]->type), ltype_name(LVAL_NUM));
+
+  arr_kernels_init();
+  lval_arr_t* x = a->cell[0]->arr;
+  lval* k = a->cell[1];
+
+  if (x->kind == ARR_I64 && k->type == LVAL_NUM) {
+    long kn = k->num;
+    lval* r = arr_result(a, ARR_I64);
+    long* src = x->data;
+    long* dst = r->arr->data;
+    for (long i = 0; i < x->count; i++) { dst[i] = src[i] * kn; }
+    lval_del(a);
+    return r;
+  }
+
+  double kd = k->type == LVAL_NUM ? (double)k->num : k->dec;
+  double* xd = arr_as_f64(x);
+  lval* r = arr_result(a, ARR_F64);
+  K.f64_scale(r->arr->data, xd, kd, x->count);
+  if (xd != x->data) { free(xd); }
+  lval_del(a);
+  return r;
+}
+
+lval* builtin_arr_cumsum(lenv* e, lval* a) {
+  LASSERT_NUM("cumsum", a, 1);
+  LASSERT_TYPE("cumsum", a, 0, LVAL_ARR);
+
+  lval_arr_t* x = a->cell[0]->arr;
+  lval* r = arr_result(a, x->kind);
+
+  /* 前缀和存在跨元素依赖，保持标量实现 */
+  if (x->kind == ARR_I64) {
+    long* src = x->data;
+    long* dst = r->arr->data;
+    long acc = 0;
+    for (long i = 0; i < x->count; i++) { acc = I64_WRAP(acc, +, src[i]); dst[i] = acc; }
+  } else {
+    double* src = x->data;
+    double* dst = r->arr->data;
+    double acc = 0.0;
+    for (long i = 0; i < x->count; i++) { acc += src[i]; dst[i] = acc; }
+  }
+  lval_del(a);
+  return r;
+}
+
+/* --- Q-Expression 的紧凑存储 ---
+   元素全是 NUM (或全是 DEC) 且不少于 LVAL_PACK_MIN 个的 Q-Expression
+   以 v->arr 保存数据，此时 v->cell 为 NULL，v->count 与 v->arr->count 相同。
+   copy/del/print/eq 以及 head/tail/join/len/nth 直接处理紧凑存储，
+   其他需要访问 cell 的地方先调用 lval_unpack 退回通用表示。
+
+   存入环境的较长 Q-Expression 由 lval_share 改为共享存储 (ARR_LVAL)，v->arr 保存元素指针，
+   lval_copy 只增加引用计数。写之前 (set-nth、cons 等) 存储被共享时先复制一份 (写时复制)，
+   独占时直接原地修改；lval_unpack 在独占时只是把指针数组交还给 cell。
+*/
+
+static int lval_list_kind(lval* v) {
+  if (v->count == 0) { return -1; }
+  int t = v->cell[0]->type;
+  if (t != LVAL_NUM && t != LVAL_DEC) { return -1; }
+  for (int i = 1; i < v->count; i++) {
+    if (v->cell[i]->type != t) { return -1; }
+  }
+  return t == LVAL_NUM ? ARR_I64 : ARR_F64;
+}
+
+/* 列表能否以 kind 紧凑存储：已是该 kind 的紧凑存储，或每个元素都是对应类型的数字 */
+static int lval_fits_kind(lval* v, int kind) {
+  if (v->arr) { return v->arr->kind == kind; }
+  int t = kind == ARR_I64 ? LVAL_NUM : LVAL_DEC;
+  for (int i = 0; i < v->count; i++) {
+    if (v->cell[i]->type != t) { return 0; }
+  }
+  return 1;
+}
+
+static void arr_store_set(lval_arr_t* s, long i, lval* x) {
+  if (s->kind == ARR_I64) { ((long*)s->data)[i] = x->num; }
+  else { ((double*)s->data)[i] = x->dec; }
+}
+
+/* 写之前确保存储是独占的 (写时复制) */
+static void arr_own(lval* v) {
+  lval_arr_t* s = v->arr;
+  if (s->ref_count == 1) { return; }
+  lval_arr_t* n = arr_store_new(s->kind, s->count);
+  if (s->kind == ARR_LVAL) {
+    for (long i = 0; i < s->count; i++) { ((lval**)n->data)[i] = lval_copy(((lval**)s->data)[i]); }
+  } else {
+    memcpy(n->data, s->data, s->count * ARR_ELEM_SIZE(s->kind));
+  }
+  lval_arr_release(s);
+  v->arr = n;
+}
+
+lval* lval_pack(lval* v) {
+  if (v->type != LVAL_QEXPR || v->arr || v->count < LVAL_PACK_MIN) { return v; }
+  int kind = lval_list_kind(v);
+  if (kind < 0) { return v; }
+
+  lval_arr_t* s = arr_store_new(kind, v->count);
+  for (int i = 0; i < v->count; i++) {
+    arr_store_set(s, i, v->cell[i]);
+    lval_del(v->cell[i]);
+  }
+  free(v->cell);
+  v->cell = NULL;
+  v->arr = s;
+  return v;
+}
+
+/* 把存入环境的值 v (调用者独占) 中足够长的 Q-Expression 改为共享存储，嵌套的列表和字典的值也一样 */
+lval* lval_share(lval* v) {
+  if (v->type == LVAL_DICT && v->dict->ref_count == 1) {
+    for (int k = 0; k < v->dict->count; k++) { lval_share(v->dict->vals[k]); }
+    return v;
+  }
+  if (v->type != LVAL_QEXPR || v->arr) { return v; }
+  for (int i = 0; i < v->count; i++) { lval_share(v->cell[i]); }
+  if (v->count < LVAL_SHARE_MIN) { return v; }
+
+  lval_arr_t* s = malloc(sizeof(lval_arr_t));
+  s->ref_count = 1;
+  s->kind = ARR_LVAL;
+  s->count = v->count;
+  s->data = v->cell;
+  v->cell = NULL;
+  v->arr = s;
+  return v;
+}
+
+/* 只读遍历用的元素数组：通用表示是 cell，共享存储是 arr->data (紧凑的数字存储没有元素数组) */
+lval** lval_elems(lval* v) {
+  if (!v->arr) { return v->cell; }
+  return v->arr->kind == ARR_LVAL ? v->arr->data : NULL;
+}
+
+lval* lval_unpack(lval* v) {
+  if (!v->arr) { return v; }
+  lval_arr_t* s = v->arr;
+  v->arr = NULL;
+  if (s->kind == ARR_LVAL && s->ref_count == 1) {
+    /* 独占的共享存储：元素指针直接交还，不复制 */
+    v->cell = s->data;
+    free(s);
+    return v;
+  }
+  v->cell = malloc(sizeof(lval*) * (v->count ? v->count : 1));
+  for (int i = 0; i < v->count; i++) {
+    v->cell[i] = s->kind == ARR_LVAL ? lval_copy(((lval**)s->data)[i])
+      : s->kind == ARR_I64 ? lval_num(((long*)s->data)[i]) : lval_dec(((double*)s->data)[i]);
+  }
+  lval_arr_release(s);
+  return v;
+}
+
+lval* lval_packed_nth(lval* v, long i) {
+  lval_arr_t* s = v->arr;
+  if (s->kind == ARR_LVAL) { return lval_copy(((lval**)s->data)[i]); }
+  return s->kind == ARR_I64 ? lval_num(((long*)s->data)[i]) : lval_dec(((double*)s->data)[i]);
+}
+
+int lval_packed_set(lval* v, long i, lval* x) {
+  if (v->arr->kind == ARR_LVAL) {
+    arr_own(v);
+    lval** items = v->arr->data;
+    lval_del(items[i]);
+    items[i] = x;
+    return 1;
+  }
+  if (x->type != (v->arr->kind == ARR_I64 ? LVAL_NUM : LVAL_DEC)) { return 0; }
+  arr_own(v);
+  arr_store_set(v->arr, i, x);
+  lval_del(x);
+  return 1;
+}
+
+int lval_packed_insert(lval* v, lval* x, int front) {
+  int boxed = v->arr->kind == ARR_LVAL;
+  if (!boxed && x->type != (v->arr->kind == ARR_I64 ? LVAL_NUM : LVAL_DEC)) { return 0; }
+  arr_own(v);
+  lval_arr_t* s = v->arr;
+  size_t size = ARR_ELEM_SIZE(s->kind);
+  s->data = realloc(s->data, (s->count + 1) * size);
+  long at = front ? 0 : s->count;
+  if (front) { memmove((char*)s->data + size, s->data, s->count * size); }
+  if (boxed) {
+    ((lval**)s->data)[at] = x;
+  } else {
+    arr_store_set(s, at, x);
+    lval_del(x);
+  }
+  s->count++;
+  v->count++;
+  return 1;
+}
+
+void* lval_packed_own(lval* v) {
+  arr_own(v);
+  return v->arr->data;
+}
+
+void lval_packed_slice(lval* v, long start, long end) {
+  size_t size = ARR_ELEM_SIZE(v->arr->kind);
+  if (v->arr->kind == ARR_LVAL) {
+    /* 元素指针不能整块复制：共享时逐个复制区间内的元素，独占时释放区间外的元素 */
+    lval** items = v->arr->data;
+    if (v->arr->ref_count > 1) {
+      lval_arr_t* n = arr_store_new(ARR_LVAL, end - start);
+      for (long i = start; i < end; i++) { ((lval**)n->data)[i - start] = lval_copy(items[i]); }
+      lval_arr_release(v->arr);
+      v->arr = n;
+      v->count = end - start;
+      return;
+    }
+    for (long i = 0; i < start; i++) { lval_del(items[i]); }
+    for (long i = end; i < v->count; i++) { lval_del(items[i]); }
+  }
+  if (v->arr->ref_count == 1) {
+    memmove(v->arr->data, (char*)v->arr->data + start * size, (end - start) * size);
+    v->arr->count = end - start;
+  } else {
+    lval_arr_t* n = arr_store_new(v->arr->kind, end - start);
+    memcpy(n->data, (char*)v->arr->data + start * size, (end - start) * size);
+    lval_arr_release(v->arr);
+    v->arr = n;
+  }
+  v->count = end - start;
+}
+
+int lval_packed_join(lval* x, lval* y) {
+  /* 共享存储的列表退回通用表示再拼接 (独占时只是交还指针) */
+  if ((x->arr && x->arr->kind == ARR_LVAL) || (y->arr && y->arr->kind == ARR_LVAL)) { return 0; }
+  int kind = x->arr ? x->arr->kind : y->arr->kind;
+  if (!lval_fits_kind(x, kind) || !lval_fits_kind(y, kind)) { return 0; }
+
+  size_t size = ARR_ELEM_SIZE(kind);
+  long total = (long)x->count + y->count;
+  lval_arr_t* s;
+
+  if (x->arr) {
+    arr_own(x);
+    s = x->arr;
+    s->data = realloc(s->data, (total ? total : 1) * size);
+  } else {
+    s = arr_store_new(kind, total);
+    for (int i = 0; i < x->count; i++) {
+      arr_store_set(s, i, x->cell[i]);
+      lval_del(x->cell[i]);
+    }
+    free(x->cell);
+    x->cell = NULL;
+    x->arr = s;
+  }
+
+  if (y->arr) {
+    memcpy((char*)s->data + x->count * size, y->arr->data, y->count * size);
+  } else {
+    for (int i = 0; i < y->count; i++) { arr_store_set(s, x->count + i, y->cell[i]); }
+  }
+
+  s->count = total;
+  x->count = total;
+  lval_del(y);
+  return 1;
+}
+
+int lval_packed_eq(lval* x, lval* y) {
+  if (x->count != y->count) { return 0; }
+  int xn = x->arr && x->arr->kind != ARR_LVAL;
+  int yn = y->arr && y->arr->kind != ARR_LVAL;
+  for (int i = 0; i < x->count; i++) {
+    lval* a = xn ? lval_packed_nth(x, i) : lval_elems(x)[i];
+    lval* b = yn ? lval_packed_nth(y, i) : lval_elems(y)[i];
+    int r = lval_eq(a, b);
+    if (xn) { lval_del(a); }
+    if (yn) { lval_del(b); }
+    if (!r) { return 0; }
+  }
+  return 1;
+}
+
+void lval_packed_write(lbuf* b, lval* v, char open, char close) {
+  lbuf_putc(b, open);
+  if (v->arr->kind == ARR_LVAL) {
+    lval** items = v->arr->data;
+    for (long i = 0; i < v->count; i++) {
+      if (i) { lbuf_putc(b, ' '); }
+      lval_write(b, items[i]);
+    }
+  } else {
+    arr_write_items(b, v->arr);
+  }
+  lbuf_putc(b, close);
+}
@@ -0,0 +1,369 @@
+#define _GNU_SOURCE
+#include "config.h"
+#include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+   batchread.c
+   批量读取很多个小文件。
+   fread-many 一次读入一组文件的全部内容：优先用 io_uring，把一批文件的 openat、read、close
+   各作为一轮提交 (read 有两轮，第二轮确认读到了结尾)，每轮只需要一次 io_uring_enter，
+   而不是每个文件四五次系统调用；
+   内核不支持 io_uring (或被 seccomp 禁止) 时退回到线程池，几个线程各自做普通的 open/read/close。
+   两种方式都只在 C 层面读入数据，最后在当前线程里统一生成 String 或错误值，解释器的状态不会被别的线程碰到。
+   没有使用 liburing，直接用系统调用和共享内存环。
+*/
+
+/* 从 fd 的当前位置读到 read 返回 0 为止，追加在 job->data 的 job->len 之后。
+   cap 只是预分配的大小：/proc、FUSE、管道等一次 read 可能只返回一部分，不能靠文件大小或读满判断结尾 */
+static void read_rest(lread_job* job, int fd, long cap) {
+  for (;;) {
+    if (job->len + 1 >= cap) {
+      cap = cap < 4096 ? 4096 : cap * 2;
+      job->data = realloc(job->data, cap);
+    }
+    ssize_t n = read(fd, job->data + job->len, cap - 1 - job->len);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n < 0) { job->err = errno; return; }
+    if (n == 0) { break; }
+    job->len += n;
+  }
+  job->data[job->len] = '\0';
+}
+
+/* --- 线程池 --- */
+
+typedef struct {
+  lread_job* jobs;
+  int count;
+  int next;  /* 下一个未领取的文件，原子递增 */
+} lread_queue;
+
+static void read_one(lread_job* job) {
+  int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { job->err = errno; return; }
+  struct stat st;
+  long cap = fstat(fd, &st) == 0 && st.st_size > 0 ? st.st_size + 1 : 0;
+  if (cap) { job->data = malloc(cap); }
+  read_rest(job, fd, cap);
+  close(fd);
+}
+
+static void* read_worker(void* arg) {
+  lread_queue* q = arg;
+  for (;;) {
+    int i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+    if (i >= q->count) { break; }
+    read_one(&q->jobs[i]);
+  }
+  return NULL;
+}
+
+void fread_many_threads(lread_job* jobs, int count) {
+  lread_queue q = { jobs, count, 0 };
+  int n = count < FREAD_MANY_THREADS ? count : FREAD_MANY_THREADS;
+  pthread_t threads[FREAD_MANY_THREADS];
+  int started = 1;
+  for (; started < n; started++) {
+    if (pthread_create(&threads[started], NULL, read_worker, &q) != 0) { break; }
+  }
+  /* 当前线程也领取文件 */
+  read_worker(&q);
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+/* --- io_uring --- */
+
+typedef struct {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  unsigned tail;     /* 本地的提交尾，提交时才写回共享内存 */
+  unsigned pending;  /* 已填写、还没提交的项 */
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size, sqes_size;
+} lring;
+
+/* 0: 还没试过；1: 可用；-1: 不可用，以后直接用线程池 */
+static int uring_state = 0;
+
+static int uring_supports(int fd, const int* ops, int nops) {
+  int max = 256;
+  struct io_uring_probe* p = calloc(1, sizeof(*p) + max * sizeof(struct io_uring_probe_op));
+  int ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, p, max) == 0;
+  for (int i = 0; ok && i < nops; i++) {
+    ok = ops[i] <= p->last_op && (p->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+  }
+  free(p);
+  return ok;
+}
+
+static void ring_close(lring* r) {
+  munmap(r->sqes, r->sqes_size);
+  if (r->cq_ptr != r->sq_ptr) { munmap(r->cq_ptr, r->cq_size); }
+  munmap(r->sq_ptr, r->sq_size);
+  close(r->fd);
+}
+
+static int ring_open(lring* r, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(r, 0, sizeof(*r));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) { return -1; }
+
+  /* 读取用 off = -1 (当前位置)，和 read_rest 接着读的位置一致 */
+  static const int ops[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+  if (!(p.features & IORING_FEAT_RW_CUR_POS) || !uring_supports(r->fd, ops, 3)) {
+    close(r->fd);
+    return -1;
+  }
+
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  int single = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single && r->cq_size > r->sq_size) { r->sq_size = r->cq_size; }
+
+  r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_ptr == MAP_FAILED) { close(r->fd); return -1; }
+  r->cq_ptr = single ? r->sq_ptr
+    : mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED) {
+    if (r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) { munmap(r->cq_ptr, r->cq_size); }
+    munmap(r->sq_ptr, r->sq_size);
+    close(r->fd);
+    return -1;
+  }
+
+  char* sq = r->sq_ptr;
+  char* cq = r->cq_ptr;
+  r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned*)(sq + p.sq_off.array);
+  r->cq_head = (unsigned*)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  r->tail = *r->sq_tail;
+  return 0;
+}
+
+/* 取一个空的提交项；调用者保证一轮里的项数不超过环的大小 */
+static struct io_uring_sqe* ring_sqe(lring* r, int op, unsigned long long tag) {
+  unsigned i = r->tail & *r->sq_mask;
+  struct io_uring_sqe* sqe = &r->sqes[i];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->user_data = tag;
+  r->sq_array[i] = i;
+  r->tail++;
+  r->pending++;
+  return sqe;
+}
+
+/* 一轮中的文件、它们打开后的描述符和第二次 read 读到的字节数 */
+typedef struct {
+  lread_job* jobs;
+  int* fds;
+  int* more;
+} lread_batch;
+
+/* 提交所有填好的项并等待它们全部完成，每个完成项调用一次 done(b, tag, res) */
+static int ring_run(lring* r, lread_batch* b, void (*done)(lread_batch*, unsigned long long, int)) {
+  unsigned want = r->pending;
+  unsigned submit = r->pending;
+  r->pending = 0;
+  __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+
+  while (want > 0) {
+    int n = syscall(__NR_io_uring_enter, r->fd, submit, want, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) { continue; }
+      return -1;
+    }
+    unsigned consumed = (unsigned)n;
+    submit -= consumed < submit ? consumed : submit;
+
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && want > 0; head++, want--) {
+      struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+      done(b, cqe->user_data, cqe->res);
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+/* 完成项的 tag 是文件在这一轮中的下标 */
+static void opened(lread_batch* b, unsigned long long tag, int res) {
+  if (res < 0) { b->jobs[tag].err = -res; } else { b->fds[tag] = res; }
+}
+
+static void was_read(lread_batch* b, unsigned long long tag, int res) {
+  lread_job* job = &b->jobs[tag];
+  if (res < 0) { job->err = -res; } else { job->len = res; }
+}
+
+static void read_again(lread_batch* b, unsigned long long tag, int res) {
+  if (res < 0) { b->jobs[tag].err = -res; } else { b->more[tag] = res; }
+}
+
+static void read_sqe(lring* r, int i, int fd, char* scratch) {
+  struct io_uring_sqe* sqe = ring_sqe(r, IORING_OP_READ, i);
+  sqe->fd = fd;
+  sqe->addr = (unsigned long long)(uintptr_t)(scratch + (size_t)i * FREAD_MANY_CHUNK);
+  sqe->len = FREAD_MANY_CHUNK;
+  sqe->off = (unsigned long long)-1;
+}
+
+static void closed(lread_batch* b, unsigned long long tag, int res) {}
+
+int fread_many_uring(lread_job* jobs, int count) {
+  if (!FREAD_MANY_URING || uring_state < 0) { return -1; }
+  lring r;
+  if (ring_open(&r, FREAD_MANY_QUEUE) < 0) {
+    uring_state = -1;
+    return -1;
+  }
+  uring_state = 1;
+
+  /* 每个文件先读进 scratch 中的一块，再复制成正好大小的字符串。只有 read 返回 0 才算读到结尾：
+     第一次读到内容的文件再一起提交一次 read，仍有内容的 (大文件、一次只返回一部分的 /proc 文件等) 用 read_rest 读完 */
+  int batch = FREAD_MANY_QUEUE;
+  int* fds = malloc(sizeof(int) * batch);
+  int* more = malloc(sizeof(int) * batch);
+  char* scratch = malloc((size_t)batch * FREAD_MANY_CHUNK);
+  int failed = 0;
+
+  for (int base = 0; base < count && !failed; base += batch) {
+    int n = count - base < batch ? count - base : batch;
+    lread_job* js = jobs + base;
+    lread_batch b = { js, fds, more };
+
+    /* 第一轮：openat */
+    for (int i = 0; i < n; i++) {
+      fds[i] = -1;
+      struct io_uring_sqe* sqe = ring_sqe(&r, IORING_OP_OPENAT, i);
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (unsigned long long)(uintptr_t)js[i].path;
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    if (ring_run(&r, &b, opened) < 0) { failed = 1; }
+
+    /* 第二轮：read */
+    for (int i = 0; i < n && !failed; i++) {
+      if (fds[i] >= 0) { read_sqe(&r, i, fds[i], scratch); }
+    }
+    if (!failed && ring_run(&r, &b, was_read) < 0) { failed = 1; }
+
+    for (int i = 0; i < n && !failed; i++) {
+      if (fds[i] < 0 || js[i].err) { continue; }
+      long len = js[i].len;
+      js[i].data = malloc(len + 1);
+      memcpy(js[i].data, scratch + (size_t)i * FREAD_MANY_CHUNK, len);
+      js[i].data[len] = '\0';
+    }
+
+    /* 第三轮：读到内容的文件再 read 一次，确认到了结尾 */
+    for (int i = 0; i < n && !failed; i++) {
+      more[i] = 0;
+      if (fds[i] >= 0 && !js[i].err && js[i].len > 0) { read_sqe(&r, i, fds[i], scratch); }
+    }
+    if (!failed && ring_run(&r, &b, read_again) < 0) { failed = 1; }
+
+    for (int i = 0; i < n; i++) {
+      if (fds[i] < 0 || js[i].err) { continue; }
+      if (failed) {
+        /* 位置不确定，从头重新读 */
+        free(js[i].data);
+        js[i].data = NULL;
+        js[i].len = 0;
+        if (lseek(fds[i], 0, SEEK_SET) < 0) { js[i].err = errno; continue; }
+        read_rest(&js[i], fds[i], 0);
+        continue;
+      }
+      if (more[i] == 0) { continue; }
+      struct stat st;
+      long cap = js[i].len + more[i] + 1;
+      if (fstat(fds[i], &st) == 0 && st.st_size >= cap) { cap = st.st_size + 1; }
+      js[i].data = realloc(js[i].data, cap);
+      memcpy(js[i].data + js[i].len, scratch + (size_t)i * FREAD_MANY_CHUNK, more[i]);
+      js[i].len += more[i];
+      read_rest(&js[i], fds[i], cap);
+    }
+
+    /* 第四轮：close */
+    for (int i = 0; i < n; i++) {
+      if (fds[i] < 0) { continue; }
+      if (failed) { close(fds[i]); continue; }
+      ring_sqe(&r, IORING_OP_CLOSE, i)->fd = fds[i];
+    }
+    if (!failed) { ring_run(&r, &b, closed); }
+  }
+
+  free(fds);
+  free(more);
+  free(scratch);
+  ring_close(&r);
+  if (failed) {
+    /* io_uring_enter 本身失败：已经处理完的文件保留结果，其余的用线程池重新读 */
+    for (int i = 0; i < count; i++) {
+      if (!jobs[i].data && !jobs[i].err) { read_one(&jobs[i]); }
+    }
+  }
+  return 0;
+}
+
+/* --- 内建函数 --- */
+
+/* (fread-many {paths})：按顺序返回每个文件的全部内容；读取失败的文件对应一个错误值 */
+lval* builtin_fread_many(lenv* e, lval* a) {
+  LASSERT_NUM("fread-many", a, 1);
+  LASSERT_TYPE("fread-many", a, 0, LVAL_QEXPR);
+  lval* q = lval_unpack(a->cell[0]);
+  for (int i = 0; i < q->count; i++) {
+    LASSERT(a, q->cell[i]->type == LVAL_STR,
+      "Function 'fread-many' passed incorrect type for path %i. Got %s, Expected %s.",
+      i, ltype_name(q->cell[i]->type), ltype_name(LVAL_STR));
+  }
+
+  int count = q->count;
+  lread_job* jobs = calloc((size_t)count + 1, sizeof(lread_job));
+  for (int i = 0; i < count; i++) { jobs[i].path = q->cell[i]->str; }
+
+  if (fread_many_uring(jobs, count) < 0) { fread_many_threads(jobs, count); }
+
+  lval* res = lval_qexpr();
+  res->cell = malloc(sizeof(lval*) * ((size_t)count + 1));
+  for (int i = 0; i < count; i++) {
+    lval* x;
+    if (jobs[i].err) {
+      free(jobs[i].data);
+      x = lval_err("Failed to read file '%s': %s", jobs[i].path, strerror(jobs[i].err));
+    } else {
+      x = lval_alloc();
+      x->type = LVAL_STR;
+      x->str = jobs[i].data;
+    }
+    res->cell[i] = x;
+  }
+  res->count = count;
+  free(jobs);
+  lval_del(a);
+  return res;
+}
@@ -0,0 +1,84 @@
+#include "config.h"
+#include <time.h>
+
+/*
+   bench_json.c
+   json-parse / json-emit 吞吐量测试。
+   生成若干个约 1 MB 的 JSON 文档 (对象数组，包含整数、小数、带转义的字符串、布尔、null、嵌套对象和数组)，
+   依次用 json-parse 解析、再用 json-emit 写回字符串，分别统计耗时和 MB/s。
+   文档分成多个而不是一个几百 MB 的大文档，是因为解析结果的 lval 比 JSON 文本大得多。
+   用法: bench_json [总大小 MB]   (默认 256)
+*/
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 一个约 1 MB 的文档 */
+static char* make_doc(long* id, long* len) {
+  long cap = 1200 * 1024;
+  char* s = malloc(cap);
+  long n = 0;
+  s[n++] = '[';
+  while (n < 1024 * 1024) {
+    long i = (*id)++;
+    n += snprintf(s + n, cap - n,
+      "%s{\"id\":%ld,\"name\":\"user \\\"%ld\\\"\",\"email\":\"u%ld@example.com\","
+      "\"score\":%ld.%02ld,\"ratio\":%.6g,\"active\":%s,\"tags\":[\"a\",\"b\\n\",\"\\u00e9\"],"
+      "\"address\":{\"city\":\"City %ld\",\"zip\":\"%05ld\"},"
+      "\"history\":[%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld],\"note\":null}",
+      n > 1 ? "," : "", i, i, i, i % 1000, i % 100, i / 7.0,
+      i % 3 ? "true" : "false", i % 97, i % 100000,
+      i, i + 1, i * 2, i * 3, i % 11, i % 13, -i, i * i);
+  }
+  s[n++] = ']';
+  s[n] = '\0';
+  *len = n;
+  return s;
+}
+
+int main(int argc, char** argv) {
+  long total_mb = argc > 1 ? atol(argv[1]) : 256;
+  if (total_mb < 1) { total_mb = 1; }
+
+  long id = 0;
+  long in_bytes = 0, out_bytes = 0;
+  double t_parse = 0, t_emit = 0;
+  int docs = 0;
+
+  while (in_bytes < total_mb * 1024 * 1024) {
+    long len;
+    char* doc = make_doc(&id, &len);
+    lval* arg = lval_add(lval_sexpr(), lval_str(doc));
+    free(doc);
+
+    double t0 = now();
+    lval* v = builtin_json_parse(NULL, arg);
+    double t1 = now();
+    if (v->type == LVAL_ERR) {
+      fprintf(stderr, "json-parse failed: %s\n", v->err);
+      return 1;
+    }
+
+    lval* s = builtin_json_emit(NULL, lval_add(lval_sexpr(), v));
+    double t2 = now();
+    if (s->type == LVAL_ERR) {
+      fprintf(stderr, "json-emit failed: %s\n", s->err);
+      return 1;
+    }
+
+    t_parse += t1 - t0;
+    t_emit += t2 - t1;
+    in_bytes += len;
+    out_bytes += strlen(s->str);
+    lval_del(s);
+    docs++;
+  }
+
+  printf("%d documents, %.1f MB in, %.1f MB out\n", docs, in_bytes / 1048576.0, out_bytes / 1048576.0);
+  printf("json-parse  %7.3f s  %7.1f MB/s\n", t_parse, in_bytes / 1048576.0 / t_parse);
+  printf("json-emit   %7.3f s  %7.1f MB/s\n", t_emit, out_bytes / 1048576.0 / t_emit);
+  return 0;
+}
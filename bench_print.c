@@ -0,0 +1,91 @@
+#include "config.h"
+#include <time.h>
+#include <unistd.h>
+
+/*
+   bench_print.c
+   打印吞吐量测试：构造几种 100 万个元素的列表，测量 lval_print 把它们写到 stdout 的耗时。
+   stdout 默认重定向到 /dev/null，只测格式化和写出本身；也可以指定一个文件测量真实写盘。
+   另外测量 to-string：一次生成约 100 MB 的字符串，以及 100 万次生成短字符串 (缓冲区在调用之间复用)。
+   用法: bench_print [输出文件]   (默认 /dev/null)
+*/
+
+#define N 1000000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static lval* make_list(int kind) {
+  lval* q = lval_qexpr();
+  q->cell = malloc(sizeof(lval*) * N);
+  for (int i = 0; i < N; i++) {
+    char tmp[32];
+    switch (kind) {
+      case 0: q->cell[i] = lval_num((long)i * 7919 - N); break;
+      case 1: q->cell[i] = lval_dec(i / 7.0); break;
+      case 2: q->cell[i] = lval_dec((i % 100000) / 100.0); break;
+      case 3:
+        snprintf(tmp, sizeof(tmp), "item \"%d\"\n", i);
+        q->cell[i] = lval_str(tmp);
+        break;
+      default:
+        q->cell[i] = lval_add(lval_add(lval_sexpr(), lval_sym("x")), lval_num(i));
+    }
+  }
+  q->count = N;
+  return q;
+}
+
+int main(int argc, char** argv) {
+  const char* out = argc > 1 ? argv[1] : "/dev/null";
+  static const char* names[] = { "integers", "decimals", "decimals (2 places)", "strings", "nested" };
+
+  FILE* report = fdopen(dup(fileno(stdout)), "w");
+  if (!freopen(out, "w", stdout)) {
+    fprintf(stderr, "Could not open %s\n", out);
+    return 1;
+  }
+
+  for (int kind = 0; kind < 5; kind++) {
+    lval* v = make_list(kind);
+    long before = ftell(stdout);
+    double t0 = now();
+    lval_println(v);
+    fflush(stdout);
+    double t = now() - t0;
+    long bytes = ftell(stdout) - before;
+    /* /dev/null 不能 ftell，只报告耗时 */
+    if (bytes > 0) {
+      fprintf(report, "%-20s %8.1f ms  %7.1f MB/s\n", names[kind], t * 1e3, bytes / 1048576.0 / t);
+    } else {
+      fprintf(report, "%-20s %8.1f ms\n", names[kind], t * 1e3);
+    }
+    lval_del(v);
+  }
+
+  /* 约 100 MB 的字符串：12M 个整数 */
+  lval* big = lval_qexpr();
+  big->cell = malloc(sizeof(lval*) * 12 * N);
+  for (int i = 0; i < 12 * N; i++) { big->cell[i] = lval_num((long)i * 7919); }
+  big->count = 12 * N;
+  double t0 = now();
+  lval* s = builtin_to_string(NULL, lval_add(lval_sexpr(), big));
+  double t = now() - t0;
+  fprintf(report, "%-20s %8.1f ms  %7.1f MB/s\n", "to-string (100 MB)", t * 1e3, strlen(s->str) / 1048576.0 / t);
+  lval_del(s);
+
+  /* 短字符串：每次一个键和一个数字 */
+  t0 = now();
+  for (int i = 0; i < N; i++) {
+    lval* a = lval_add(lval_add(lval_sexpr(), lval_str("key:")), lval_num(i));
+    lval_del(builtin_to_string(NULL, a));
+  }
+  t = now() - t0;
+  fprintf(report, "%-20s %8.1f ms  %7.1f ns/call\n", "to-string (short)", t * 1e3, t * 1e9 / N);
+
+  fclose(report);
+  return 0;
+}
@@ -0,0 +1,215 @@
+#include "config.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+   bench_serve.c
+   serve 的负载测试：本地客户端打开若干连接，每个连接保持 depth 个未完成的请求 (按行格式)，
+   收到一个回复就发下一个请求，统计每秒请求数和延迟的分位数。
+   不指定地址时在子进程里启动服务：加载 prelude，(serve "unix:..." handler) 后 (run-loop)；
+   也可以指定地址 (unix:路径 或 主机:端口) 测试另外启动的 lispy 服务。
+   用法: bench_serve [连接数] [每个连接的请求数] [depth] [handler 或 地址]
+         默认 16 个连接、每个 5000 个请求、depth 1、handler (\ {req} {to-string "ok " req})
+*/
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+  int fd;
+  long sent;
+  long done;
+  double* sent_at;  /* 按请求序号，depth 个一轮 */
+  char buf[4096];
+  long len;
+} client;
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+/* 子进程：在 path 上用 handler 提供服务，直到被结束 */
+static void run_server(const char* path, const char* handler) {
+  lenv* e = lenv_new();
+  lenv_add_builtins(e);
+  lval* x = builtin_load(e, lval_add(lval_sexpr(), lval_str("chapter/prelude.lspy")));
+  if (x->type == LVAL_ERR) { lval_println(x); }
+  lval_del(x);
+
+  char* src = malloc(strlen(path) + strlen(handler) + 64);
+  sprintf(src, "(serve \"unix:%s\" %s) (run-loop)", path, handler);
+  lval* forms = lval_parse(src);
+  while (forms->type == LVAL_SEXPR && forms->count > 0) {
+    lval* r = lval_eval(e, lval_pop(forms, 0));
+    if (r->type == LVAL_ERR) { lval_println(r); }
+    lval_del(r);
+  }
+  lval_del(forms);
+  _exit(0);
+}
+
+/* "unix:路径" 或 "主机:端口" */
+static int connect_addr(const char* addr) {
+  if (strncmp(addr, "unix:", 5) == 0) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, addr + 5, sizeof(sa.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  char host[256];
+  const char* colon = strrchr(addr, ':');
+  if (!colon || colon - addr >= (long)sizeof(host)) { return -1; }
+  memcpy(host, addr, colon - addr);
+  host[colon - addr] = '\0';
+  struct addrinfo hints = { .ai_socktype = SOCK_STREAM }, *res;
+  if (getaddrinfo(host, colon + 1, &hints, &res) != 0) { return -1; }
+  int fd = socket(res->ai_family, SOCK_STREAM, 0);
+  if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+    close(fd);
+    fd = -1;
+  } else {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+static void send_request(client* c, int depth) {
+  char req[64];
+  int n = snprintf(req, sizeof(req), "req-%ld\n", c->sent);
+  c->sent_at[c->sent % depth] = now();
+  c->sent++;
+  if (write(c->fd, req, n) != n) {
+    perror("write");
+    exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  int conns = argc > 1 ? atoi(argv[1]) : 16;
+  long reqs = argc > 2 ? atol(argv[2]) : 5000;
+  int depth = argc > 3 ? atoi(argv[3]) : 1;
+  const char* target = argc > 4 ? argv[4] : "(\\ {req} {to-string \"ok \" req})";
+  if (conns < 1 || reqs < 1 || depth < 1) {
+    fprintf(stderr, "usage: bench_serve [connections] [requests] [depth] [handler | unix:path | host:port]\n");
+    return 1;
+  }
+
+  /* 以 ( 开头的是处理函数，否则是地址 */
+  char addr[300];
+  char path[108];
+  pid_t child = 0;
+  if (target[0] != '(') {
+    snprintf(addr, sizeof(addr), "%s", target);
+  } else {
+    snprintf(path, sizeof(path), "/tmp/bench_serve.%d.sock", (int)getpid());
+    snprintf(addr, sizeof(addr), "unix:%s", path);
+    child = fork();
+    if (child == 0) { run_server(path, target); }
+  }
+
+  /* 等服务开始监听 */
+  int probe = -1;
+  for (int i = 0; i < 5000 && probe < 0; i++) {
+    probe = connect_addr(addr);
+    if (probe < 0) { usleep(1000); }
+  }
+  if (probe < 0) {
+    fprintf(stderr, "could not connect to %s\n", addr);
+    if (child) { kill(child, SIGTERM); }
+    return 1;
+  }
+  close(probe);
+
+  int ep = epoll_create1(0);
+  client* cs = calloc(conns, sizeof(client));
+  long total = (long)conns * reqs;
+  double* lat = malloc(sizeof(double) * total);
+  long nlat = 0;
+
+  double t0 = now();
+  for (int i = 0; i < conns; i++) {
+    cs[i].fd = connect_addr(addr);
+    if (cs[i].fd < 0) { perror("connect"); return 1; }
+    cs[i].sent_at = malloc(sizeof(double) * depth);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &cs[i] };
+    epoll_ctl(ep, EPOLL_CTL_ADD, cs[i].fd, &ev);
+    for (int k = 0; k < depth && cs[i].sent < reqs; k++) { send_request(&cs[i], depth); }
+  }
+
+  int open_conns = conns;
+  struct epoll_event evs[64];
+  while (open_conns > 0) {
+    int n = epoll_wait(ep, evs, 64, 5000);
+    if (n == 0) {
+      fprintf(stderr, "timed out waiting for replies\n");
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      client* c = evs[i].data.ptr;
+      ssize_t r = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+      if (r <= 0) {
+        fprintf(stderr, "connection closed after %ld replies\n", c->done);
+        epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+        open_conns--;
+        continue;
+      }
+      c->len += r;
+      double t = now();
+      /* 每个完整的回复行对应最早的一个未完成请求 */
+      char* p = c->buf;
+      char* nl;
+      while ((nl = memchr(p, '\n', c->buf + c->len - p))) {
+        lat[nlat++] = t - c->sent_at[c->done % depth];
+        c->done++;
+        p = nl + 1;
+        if (c->sent < reqs) { send_request(c, depth); }
+      }
+      c->len -= p - c->buf;
+      memmove(c->buf, p, c->len);
+      if (c->done == reqs) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        open_conns--;
+      }
+    }
+  }
+  double elapsed = now() - t0;
+
+  if (child) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+    unlink(path);
+  }
+
+  qsort(lat, nlat, sizeof(double), cmp_double);
+  printf("%d connections x %ld requests, depth %d\n", conns, reqs, depth);
+  printf("  %ld replies in %.2f s  %.0f req/s\n", nlat, elapsed, nlat / elapsed);
+  if (nlat > 0) {
+    printf("  latency  p50 %.1f us  p90 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+      lat[nlat / 2] * 1e6, lat[nlat * 9 / 10] * 1e6, lat[nlat * 99 / 100] * 1e6,
+      lat[nlat * 999 / 1000] * 1e6, lat[nlat - 1] * 1e6);
+  }
+  return nlat == total ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+   bench_startup.c
+   启动延迟测试：反复启动解释器运行一个空脚本，比较
+     1. 正常启动 (注册内置函数 + 解析并求值 chapter/prelude.lspy)
+     2. --image 启动 (从 --dump-image 生成的镜像恢复全局环境)
+   两种方式的耗时 (fork + exec + 退出)。需要在仓库根目录下运行，prelude 使用相对路径。
+   用法: bench_startup ./lispy [次数]   (默认 200 次)
+*/
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 运行一次，返回耗时 (秒)；子进程输出丢弃 */
+static double run(char** argv) {
+  double t0 = now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    freopen("/dev/null", "w", stdout);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+    fprintf(stderr, "Could not run %s\n", argv[0]);
+    exit(1);
+  }
+  return now() - t0;
+}
+
+static int cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void report(const char* name, double* t, int n) {
+  qsort(t, n, sizeof(double), cmp_double);
+  double sum = 0;
+  for (int i = 0; i < n; i++) { sum += t[i]; }
+  printf("%-8s min %7.3f ms  median %7.3f ms  p95 %7.3f ms  mean %7.3f ms\n",
+    name, t[0] * 1e3, t[n / 2] * 1e3, t[n * 95 / 100] * 1e3, sum / n * 1e3);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s ./lispy [runs]\n", argv[0]);
+    return 1;
+  }
+  char* lispy = argv[1];
+  int runs = argc > 2 ? atoi(argv[2]) : 200;
+  if (runs < 1) { runs = 1; }
+
+  char script[] = "/tmp/bench_startup_XXXXXX";
+  char image[] = "/tmp/bench_startup_img_XXXXXX";
+  close(mkstemp(script));
+  close(mkstemp(image));
+
+  char* dump[] = { lispy, "--dump-image", image, NULL };
+  run(dump);
+
+  char* plain[] = { lispy, script, NULL };
+  char* imaged[] = { lispy, "--image", image, script, NULL };
+  double* t_plain = malloc(sizeof(double) * runs);
+  double* t_image = malloc(sizeof(double) * runs);
+
+  /* 交替运行，让两种方式受到相同的系统抖动 */
+  for (int i = 0; i < runs; i++) {
+    t_plain[i] = run(plain);
+    t_image[i] = run(imaged);
+  }
+
+  printf("%d runs each\n", runs);
+  report("prelude", t_plain, runs);
+  report("image", t_image, runs);
+
+  unlink(script);
+  unlink(image);
+  free(t_plain);
+  free(t_image);
+  return 0;
+}
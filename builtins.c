@@ -3,9 +3,15 @@
 
 lval* builtin_len(lenv* e, lval* a) {
   LASSERT_NUM("len", a, 1);
-  LASSERT_TYPE("len", a, 0, LVAL_QEXPR);
+  int t = a->cell[0]->type;
+  LASSERT(a, t == LVAL_QEXPR || t == LVAL_ARR || t == LVAL_BYTES || t == LVAL_DICT || t == LVAL_VIEW || t == LVAL_STR,
+    "Function 'len' passed incorrect type for argument 0. Got %s, Expected %s, %s, %s, %s, %s or %s.",
+    ltype_name(t), ltype_name(LVAL_QEXPR), ltype_name(LVAL_ARR), ltype_name(LVAL_BYTES), ltype_name(LVAL_DICT),
+    ltype_name(LVAL_VIEW), ltype_name(LVAL_STR));
   lval* x = lval_take(a, 0);
-  long count = x->count;
+  /* String 与 View 一样返回字节数 */
+  long count = t == LVAL_ARR ? x->arr->count : t == LVAL_BYTES ? x->bytes->len : t == LVAL_DICT ? x->dict->count
+    : t == LVAL_VIEW ? x->view->len : t == LVAL_STR ? (long)strlen(x->str) : x->count;
   lval_del(x);
   return lval_num(count);
 }
@@ -29,6 +35,109 @@ lval* builtin_init(lenv* e, lval* a) {
   return q;
 }
 
+lval* builtin_nth(lenv* e, lval* a) {
+  LASSERT_NUM("nth", a, 2);
+  LASSERT_TYPE("nth", a, 0, LVAL_NUM);
+  LASSERT(a, a->cell[1]->type == LVAL_QEXPR || a->cell[1]->type == LVAL_ARR,
+    "Function 'nth' passed incorrect type for argument 1. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[1]->type), ltype_name(LVAL_QEXPR), ltype_name(LVAL_ARR));
+
+  long i = a->cell[0]->num;
+  lval* q = a->cell[1];
+
+  if (q->type == LVAL_ARR) {
+    lval_arr_t* arr = q->arr;
+    LASSERT(a, i >= 0 && i < arr->count,
+      "Function 'nth' index %li out of range for array of length %li.", i, arr->count);
+    lval* x = arr->kind == ARR_I64 ? lval_num(((long*)arr->data)[i]) : lval_dec(((double*)arr->data)[i]);
+    lval_del(a);
+    return x;
+  }
+  LASSERT(a, i >= 0 && i < q->count,
+    "Function 'nth' index %li out of range for list of length %i.", i, q->count);
+
+  if (q->arr) {
+    lval* x = lval_packed_nth(q, i);
+    lval_del(a);
+    return x;
+  }
+
+  /* 直接取出第 i 个元素，用最后一个元素补位，列表随后整体释放，顺序无关 */
+  lval* x = q->cell[i];
+  q->cell[i] = q->cell[q->count-1];
+  q->count--;
+  lval_del(a);
+  return x;
+}
+
+lval* builtin_set_nth(lenv* e, lval* a) {
+  LASSERT_NUM("set-nth", a, 3);
+  LASSERT_TYPE("set-nth", a, 0, LVAL_NUM);
+  LASSERT_TYPE("set-nth", a, 2, LVAL_QEXPR);
+
+  long i = a->cell[0]->num;
+  LASSERT(a, i >= 0 && i < a->cell[2]->count,
+    "Function 'set-nth' index %li out of range for list of length %i.", i, a->cell[2]->count);
+
+  /* 参数列表由求值器独占，可以原地替换，无需复制整个列表 */
+  lval* x = lval_pop(a, 1);
+  lval* q = lval_take(a, 1);
+  if (q->arr) {
+    if (lval_packed_set(q, i, x)) { return q; }
+    lval_unpack(q);
+  }
+  lval_del(q->cell[i]);
+  q->cell[i] = x;
+  return q;
+}
+
+lval* builtin_slice(lenv* e, lval* a) {
+  LASSERT_NUM("slice", a, 3);
+  LASSERT_TYPE("slice", a, 0, LVAL_NUM);
+  LASSERT_TYPE("slice", a, 1, LVAL_NUM);
+  int t = a->cell[2]->type;
+  LASSERT(a, t == LVAL_QEXPR || t == LVAL_STR || t == LVAL_BYTES || t == LVAL_VIEW,
+    "Function 'slice' passed incorrect type for argument 2. Got %s, Expected %s, %s, %s or %s.",
+    ltype_name(t), ltype_name(LVAL_QEXPR), ltype_name(LVAL_STR), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
+
+  long start = a->cell[0]->num;
+  long end = a->cell[1]->num;
+  long len = t == LVAL_QEXPR ? a->cell[2]->count : t == LVAL_BYTES ? a->cell[2]->bytes->len
+    : t == LVAL_VIEW ? a->cell[2]->view->len : (long)strlen(a->cell[2]->str);
+  LASSERT(a, start >= 0 && start <= end && end <= len,
+    "Function 'slice' range [%li, %li) out of range for length %li.", start, end, len);
+
+  lval* v = lval_take(a, 2);
+
+  /* Bytes 和视图的切片共享原来的存储，O(1) 且不复制 */
+  if (t == LVAL_BYTES || t == LVAL_VIEW) {
+    lval* r = t == LVAL_BYTES ? lval_bytes_slice(v, start, end)
+      : lval_view(v->view->map, v->view->off + start, end - start);
+    lval_del(v);
+    return r;
+  }
+
+  if (v->type == LVAL_STR) {
+    memmove(v->str, v->str + start, end - start);
+    v->str[end - start] = '\0';
+    v->str = realloc(v->str, end - start + 1);
+    return v;
+  }
+
+  if (v->arr) {
+    lval_packed_slice(v, start, end);
+    return v;
+  }
+
+  /* 释放区间外的元素，再把区间内的指针整体前移 */
+  for (long i = 0; i < start; i++) { lval_del(v->cell[i]); }
+  for (long i = end; i < v->count; i++) { lval_del(v->cell[i]); }
+  memmove(&v->cell[0], &v->cell[start], sizeof(lval*) * (end - start));
+  v->count = end - start;
+  v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+  return v;
+}
+
 lval* builtin_head(lenv* e, lval* a) {
   LASSERT_NUM("head", a, 1);
   LASSERT(a, a->cell[0]->type == LVAL_QEXPR || a->cell[0]->type == LVAL_STR,
@@ -38,6 +147,11 @@ lval* builtin_head(lenv* e, lval* a) {
   if (a->cell[0]->type == LVAL_QEXPR) {
       LASSERT_NOT_EMPTY("head", a, 0);
       lval* v = lval_take(a, 0);
+      if (v->arr) {
+        lval* x = lval_packed_nth(v, 0);
+        lval_del(v);
+        return lval_add(lval_qexpr(), x);
+      }
       while (v->count > 1) { lval_del(lval_pop(v, 1)); }
       return v;
   }
@@ -64,6 +178,10 @@ lval* builtin_tail(lenv* e, lval* a) {
   if (a->cell[0]->type == LVAL_QEXPR) {
       LASSERT_NOT_EMPTY("tail", a, 0);
       lval* v = lval_take(a, 0);
+      if (v->arr) {
+        lval_packed_slice(v, 1, v->count);
+        return v;
+      }
       lval_del(lval_pop(v, 0));
       return v;
   }
@@ -210,7 +328,7 @@ lval* builtin_join(lenv* e, lval* a) {
 lval* builtin_var(lenv* e, lval* a, char* func) {
     LASSERT_TYPE(func, a, 0, LVAL_QEXPR);
 
-    lval* syms = a->cell[0];
+    lval* syms = lval_unpack(a->cell[0]);
     for (int i = 0;i < syms->count; i++) {
         LASSERT(a, syms->cell[i]->type == LVAL_SYM,
             "Function '%s' cannot define non-symbol. "
@@ -283,6 +401,7 @@ lval* builtin_lambda(lenv* e, lval* a) {
     LASSERT_TYPE("lambda", a, 1, LVAL_QEXPR);
 
     /* Check first Q-Expression contains only Symbols */
+    lval_unpack(a->cell[0]);
     for (int i = 0;i < a->cell[0]->count; i++) {
         LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
         "Cannot define non-symbol. Got %s, Expected %s.",
@@ -303,7 +422,7 @@ lval* builtin_fun(lenv* e, lval* a) {
     LASSERT_TYPE("fun", a, 1, LVAL_QEXPR);
 
     /* Check first argument is a list of symbols */
-    lval* syms = a->cell[0];
+    lval* syms = lval_unpack(a->cell[0]);
     LASSERT_NOT_EMPTY("fun", a, 0);
 
     for (int i = 0; i < syms->count; i++) {
@@ -351,21 +470,27 @@ lval* builtin_le(lenv* e, lval* a) {
 
 lval* builtin_ord(lenv* e, lval* a, char* op) {
   LASSERT_NUM("ord", a, 2);
-  LASSERT_TYPE("ord", a, 0, LVAL_NUM);
-  LASSERT_TYPE("ord", a, 1, LVAL_NUM);
-
-  int r;
-  if (strcmp(op, ">") == 0) {
-    r = a->cell[0]->num > a->cell[1]->num;
-  }
-  if (strcmp(op, "<") == 0) {
-    r = a->cell[0]->num < a->cell[1]->num;
+  for (int i = 0; i < 2; i++) {
+    LASSERT(a, a->cell[i]->type == LVAL_NUM || a->cell[i]->type == LVAL_DEC,
+      "Function '%s' passed incorrect type for argument %i. Got %s, Expected %s.",
+      op, i, ltype_name(a->cell[i]->type), ltype_name(LVAL_NUM));
   }
-  if (strcmp(op, ">=") == 0) {
-    r = a->cell[0]->num >= a->cell[1]->num;
-  }
-  if (strcmp(op, "<=") == 0) {
-    r = a->cell[0]->num <= a->cell[1]->num;
+
+  int r = 0;
+  if (a->cell[0]->type == LVAL_NUM && a->cell[1]->type == LVAL_NUM) {
+    long x = a->cell[0]->num, y = a->cell[1]->num;
+    if (strcmp(op, ">") == 0)  { r = x > y; }
+    if (strcmp(op, "<") == 0)  { r = x < y; }
+    if (strcmp(op, ">=") == 0) { r = x >= y; }
+    if (strcmp(op, "<=") == 0) { r = x <= y; }
+  } else {
+    /* 有小数参与时统一按小数比较 */
+    double x = a->cell[0]->type == LVAL_NUM ? (double)a->cell[0]->num : a->cell[0]->dec;
+    double y = a->cell[1]->type == LVAL_NUM ? (double)a->cell[1]->num : a->cell[1]->dec;
+    if (strcmp(op, ">") == 0)  { r = x > y; }
+    if (strcmp(op, "<") == 0)  { r = x < y; }
+    if (strcmp(op, ">=") == 0) { r = x >= y; }
+    if (strcmp(op, "<=") == 0) { r = x <= y; }
   }
   lval_del(a);
   return lval_num(r);
@@ -458,51 +583,88 @@ lval* builtin_false(lenv* e, lval* a) {
 }
 
 lval* builtin_load(lenv* e, lval * a) {
-  LASSERT_NUM("load", a, 1);
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function 'load' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
   LASSERT_TYPE("load", a, 0, LVAL_STR);
+  if (a->count == 2) {
+    LASSERT_TYPE("load", a, 1, LVAL_NUM);
+    LASSERT(a, a->cell[1]->num >= 1 && a->cell[1]->num <= 256,
+      "Function 'load' passed invalid thread count %li.", a->cell[1]->num);
+  }
 
   /* Parse File given by string name */
   //mpc_result_t r;
   /* 1. 打开文件 */
   char* filename = a->cell[0]->str;
-  FILE* f = fopen(filename, "r");
-  if (f == NULL) {
+  lreader* r = lreader_open(filename);
+  if (r == NULL) {
     lval* err = lval_err("Could not open file %s", filename);
     lval_del(a);
     return err;
   }
-  /* 2. 读取整个文件到字符串缓冲区 */
-  fseek(f, 0, SEEK_END);
-  long length = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  char* buffer = malloc(length + 1);
-  if (!buffer) {
-      fclose(f);
-      lval_del(a);
-      return lval_err("Memory allocation failed for file %s", filename);
-  }
-
-  fread(buffer, 1, length, f);
-
-  buffer[length] = '\0';
-  fclose(f);
+  int nthreads = a->count == 2 ? a->cell[1]->num : 1;
 
-  /* 3. 使用 lval_parse 解析内容 */
-  lval* expr = lval_parse(buffer);
-  free(buffer); // 解析完就可以释放原始字符串了
+  /* 编译缓存有效时直接解码出表达式求值，跳过词法和语法分析 */
+  lcache* c = lcache_open(filename, r->fd);
+  if (lcache_valid(c)) {
+    lreader_close(r);
+    lval_del(a);
+    lval* expr;
+    while ((expr = lcache_next(c))) {
+      if (expr->type == LVAL_ERR) {
+        lcache_close(c, 0);
+        return expr;
+      }
+      lval* x = lval_eval(e, expr);
+      if (x->type == LVAL_ERR) { lval_println(x); }
+      lval_del(x);
+    }
+    lcache_close(c, 0);
+    return lval_sym("ok");
+  }
   lval_del(a);  // 释放参数 a
 
-  if (expr->type == LVAL_ERR) {
-    return expr;
+  /* 2a. 多线程：一批表达式并行解析，再按文件顺序依次求值 */
+  if (nthreads > 1) {
+    lval* batch;
+    while ((batch = lreader_next_batch(r, nthreads))) {
+      /* 按下标依次取出，避免 lval_pop 每次移动整个数组 */
+      for (int i = 0; i < batch->count; i++) {
+        lval* x = batch->cell[i];
+        batch->cell[i] = lval_sexpr();
+        if (x->type == LVAL_ERR) {
+          lval_del(batch);
+          lreader_close(r);
+          lcache_close(c, 0);
+          return x;
+        }
+        x = lval_eval(e, x);
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
+      }
+      lval_del(batch);
+    }
+    lreader_close(r);
+    lcache_close(c, 0);
+    return lval_sym("ok");
   }
 
-  /* 5. 依次求值 (expr 是一个包含所有表达式的 S-Expr) */
-  while (expr->count) {
-    lval* x = lval_eval(e, lval_pop(expr, 0));
+  /* 2b. 逐个读取顶层表达式：解析一个、求值一个、释放一个，不保留整棵语法树。
+         同时把解析结果记进缓存，整个文件都解析成功后才写出 */
+  lval* expr;
+  while ((expr = lreader_next(r))) {
+    if (expr->type == LVAL_ERR) {
+      lreader_close(r);
+      lcache_close(c, 0);
+      return expr;
+    }
+    lcache_add(c, expr);
+    lval* x = lval_eval(e, expr);
     if (x->type == LVAL_ERR) { lval_println(x); }
     lval_del(x);
   }
-  lval_del(expr);
+  lreader_close(r);
+  lcache_close(c, 1);
   return lval_sym("ok");
 
   #if 0
@@ -548,12 +710,16 @@ lval* builtin_load(lenv* e, lval * a) {
 lval* builtin_print(lenv* e, lval* a) {
   
   /* Print each argument followed by a space */
+  /* 整行先写进缓冲区，再一次写到 stdout */
+  lbuf b;
+  lbuf_init(&b, stdout);
   for (int i = 0; i < a->count; i++) {
-    lval_print(a->cell[i]); putchar(' ');
+    lval_write(&b, a->cell[i]); lbuf_putc(&b, ' ');
   }
   
   /* Print a newline and delete arguments */
-  putchar('\n');
+  lbuf_putc(&b, '\n');
+  lbuf_free(&b);
   lval_del(a);
   
   return lval_sexpr();
@@ -562,17 +728,58 @@ lval* builtin_print(lenv* e, lval* a) {
 lval* builtin_show(lenv* e, lval* a) {
   
   /* Print each argument followed by a space */
+  /* 字符串带引号和转义，其他类型照常打印 */
+  lbuf b;
+  lbuf_init(&b, stdout);
   for (int i = 0; i < a->count; i++) {
-    lval_print_str(a->cell[i]); putchar(' ');
+    if (a->cell[i]->type == LVAL_STR) {
+      lbuf_escaped(&b, a->cell[i]->str);
+    } else {
+      lval_write(&b, a->cell[i]);
+    }
+    lbuf_putc(&b, ' ');
   }
   
   /* Print a newline and delete arguments */
-  putchar('\n');
+  lbuf_putc(&b, '\n');
+  lbuf_free(&b);
   lval_del(a);
   
   return lval_sexpr();
 }
 
+/* to-string / show-str 生成字符串用的缓冲区，每个线程一个，容量在调用之间保留 */
+static __thread lbuf str_buf;
+
+lval* builtin_to_string(lenv* e, lval* a) {
+  /* 字符串 (和视图) 原样拼接，其他值按 print 的格式写出，参数之间不加分隔 */
+  for (int i = 0; i < a->count; i++) {
+    const char* s;
+    long n;
+    if (lval_str_bytes(a->cell[i], &s, &n)) {
+      lbuf_put(&str_buf, s, n);
+    } else {
+      lval_write(&str_buf, a->cell[i]);
+    }
+  }
+  lval_del(a);
+  return lbuf_str(&str_buf);
+}
+
+lval* builtin_show_str(lenv* e, lval* a) {
+  /* 与 show 输出的内容相同 (字符串带引号和转义，参数之间用空格分隔)，但不带换行，结果可以再用 read 读回 */
+  for (int i = 0; i < a->count; i++) {
+    if (i > 0) { lbuf_putc(&str_buf, ' '); }
+    if (a->cell[i]->type == LVAL_STR) {
+      lbuf_escaped(&str_buf, a->cell[i]->str);
+    } else {
+      lval_write(&str_buf, a->cell[i]);
+    }
+  }
+  lval_del(a);
+  return lbuf_str(&str_buf);
+}
+
 lval* builtin_error(lenv* e, lval* a) {
   LASSERT_NUM("error", a, 1);
   LASSERT_TYPE("error", a, 0, LVAL_STR);
@@ -0,0 +1,203 @@
+#include "config.h"
+#include "error.h"
+
+/*
+   bytes.c
+   二进制数据 (LVAL_BYTES)：带长度的字节串，可以包含 '\0'，取长度是 O(1)。
+   slice 对 Bytes 得到共享存储的切片，不复制；u8 / u16-le / f64-be 等从给定偏移处按字节序解码一个数，
+   bytes-unpack 按格式字符串一次解码一整条记录。
+   解码函数同样接受 mmap-open 的视图，可以直接在映射的文件上解析二进制记录。
+*/
+
+lval* lval_bytes(unsigned char* data, long len) {
+  lval* v = lval_alloc();
+  v->type = LVAL_BYTES;
+  v->bytes = malloc(sizeof(lval_bytes_t));
+  v->bytes->ref_count = 1;
+  v->bytes->len = len;
+  v->bytes->data = data;
+  v->bytes->base = NULL;
+  return v;
+}
+
+void lval_bytes_release(lval_bytes_t* b) {
+  /* 切片释放后再释放它引用的底层存储，沿链迭代 */
+  while (b) {
+    b->ref_count--;
+    if (b->ref_count > 0) { return; }
+    lval_bytes_t* base = b->base;
+    if (!base) { free(b->data); }
+    free(b);
+    b = base;
+  }
+}
+
+/* Bytes 或 View 的内容和长度；其他类型返回 0 */
+static int byte_span(lval* x, const unsigned char** s, long* n) {
+  if (x->type == LVAL_BYTES) {
+    *s = x->bytes->data;
+    *n = x->bytes->len;
+    return 1;
+  }
+  if (x->type == LVAL_VIEW) {
+    *s = (const unsigned char*)x->view->map->data + x->view->off;
+    *n = x->view->len;
+    return 1;
+  }
+  return 0;
+}
+
+/* slice 对 Bytes 的实现：[start, end) 的切片与 x 共享存储，不复制 (调用者已检查范围) */
+lval* lval_bytes_slice(lval* x, long start, long end) {
+  lval* r = lval_bytes(x->bytes->data + start, end - start);
+  r->bytes->base = x->bytes;
+  x->bytes->ref_count++;
+  return r;
+}
+
+/* 解码函数共用的参数检查：(f b offset)，*p 指向 offset 处的 size 个字节；出错时返回错误 */
+static lval* decode_at(lval* a, char* func, int size, const unsigned char** p) {
+  LASSERT_NUM(func, a, 2);
+  LASSERT(a, a->cell[0]->type == LVAL_BYTES || a->cell[0]->type == LVAL_VIEW,
+    "Function '%s' passed incorrect type for argument 0. Got %s, Expected %s or %s.",
+    func, ltype_name(a->cell[0]->type), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
+  LASSERT_TYPE(func, a, 1, LVAL_NUM);
+
+  const unsigned char* s;
+  long n;
+  byte_span(a->cell[0], &s, &n);
+  long off = a->cell[1]->num;
+  LASSERT(a, off >= 0 && off <= n - size,
+    "Function '%s' cannot read %i bytes at offset %li of %li.", func, size, off, n);
+  *p = s + off;
+  return NULL;
+}
+
+/* 从 p 读 size 字节的无符号整数 */
+static inline unsigned long load_le(const unsigned char* p, int size) {
+  unsigned long x = 0;
+  for (int i = size - 1; i >= 0; i--) { x = x << 8 | p[i]; }
+  return x;
+}
+
+static inline unsigned long load_be(const unsigned char* p, int size) {
+  unsigned long x = 0;
+  for (int i = 0; i < size; i++) { x = x << 8 | p[i]; }
+  return x;
+}
+
+/* 符号扩展 size 字节的整数 */
+static inline long sign_extend(unsigned long x, int size) {
+  int shift = 64 - size * 8;
+  return (long)(x << shift) >> shift;
+}
+
+static inline double bits_f32(unsigned long x) {
+  unsigned int u = (unsigned int)x;
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline double bits_f64(unsigned long x) {
+  double d;
+  memcpy(&d, &x, sizeof(d));
+  return d;
+}
+
+/* 每个解码函数：检查参数，读出 size 字节，转换成 Number 或 Decimal。
+   u64 超过 long 范围的值按补码变成负数 */
+#define BYTES_DECODER(fname, name, size, load, make) \
+  lval* fname(lenv* e, lval* a) { \
+    const unsigned char* p; \
+    lval* err = decode_at(a, name, size, &p); \
+    if (err) { return err; } \
+    unsigned long x = load(p, size); \
+    lval_del(a); \
+    return make; \
+  }
+
+BYTES_DECODER(builtin_u8, "u8", 1, load_le, lval_num((long)x))
+BYTES_DECODER(builtin_i8, "i8", 1, load_le, lval_num(sign_extend(x, 1)))
+BYTES_DECODER(builtin_u16_le, "u16-le", 2, load_le, lval_num((long)x))
+BYTES_DECODER(builtin_u16_be, "u16-be", 2, load_be, lval_num((long)x))
+BYTES_DECODER(builtin_i16_le, "i16-le", 2, load_le, lval_num(sign_extend(x, 2)))
+BYTES_DECODER(builtin_i16_be, "i16-be", 2, load_be, lval_num(sign_extend(x, 2)))
+BYTES_DECODER(builtin_u32_le, "u32-le", 4, load_le, lval_num((long)x))
+BYTES_DECODER(builtin_u32_be, "u32-be", 4, load_be, lval_num((long)x))
+BYTES_DECODER(builtin_i32_le, "i32-le", 4, load_le, lval_num(sign_extend(x, 4)))
+BYTES_DECODER(builtin_i32_be, "i32-be", 4, load_be, lval_num(sign_extend(x, 4)))
+BYTES_DECODER(builtin_u64_le, "u64-le", 8, load_le, lval_num((long)x))
+BYTES_DECODER(builtin_u64_be, "u64-be", 8, load_be, lval_num((long)x))
+BYTES_DECODER(builtin_f32_le, "f32-le", 4, load_le, lval_dec(bits_f32(x)))
+BYTES_DECODER(builtin_f32_be, "f32-be", 4, load_be, lval_dec(bits_f32(x)))
+BYTES_DECODER(builtin_f64_le, "f64-le", 8, load_le, lval_dec(bits_f64(x)))
+BYTES_DECODER(builtin_f64_be, "f64-be", 8, load_be, lval_dec(bits_f64(x)))
+
+/* (bytes-ref b i)：第 i 个字节 (0..255) */
+lval* builtin_bytes_ref(lenv* e, lval* a) {
+  const unsigned char* p;
+  lval* err = decode_at(a, "bytes-ref", 1, &p);
+  if (err) { return err; }
+  long x = *p;
+  lval_del(a);
+  return lval_num(x);
+}
+
+/* (bytes-unpack "fmt" b [offset])：按格式一次解码一条记录，返回各字段组成的 Q-Expression。
+   格式的第一个字符可以是 '<' (小端，默认) 或 '>' (大端)，之后每个字符是一个字段：
+   b/B = i8/u8，h/H = i16/u16，i/I = i32/u32，q/Q = i64/u64，f = f32，d = f64，x = 跳过一个字节 */
+lval* builtin_bytes_unpack(lenv* e, lval* a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function 'bytes-unpack' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+  LASSERT_TYPE("bytes-unpack", a, 0, LVAL_STR);
+  LASSERT(a, a->cell[1]->type == LVAL_BYTES || a->cell[1]->type == LVAL_VIEW,
+    "Function 'bytes-unpack' passed incorrect type for argument 1. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[1]->type), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
+  if (a->count == 3) { LASSERT_TYPE("bytes-unpack", a, 2, LVAL_NUM); }
+
+  const char* fmt = a->cell[0]->str;
+  int big = 0;
+  if (*fmt == '<' || *fmt == '>') { big = *fmt++ == '>'; }
+
+  /* 先算出记录的大小和字段数，检查格式和范围 */
+  long size = 0;
+  int fields = 0;
+  for (const char* c = fmt; *c; c++) {
+    switch (*c) {
+      case 'b': case 'B': case 'x': size += 1; break;
+      case 'h': case 'H': size += 2; break;
+      case 'i': case 'I': case 'f': size += 4; break;
+      case 'q': case 'Q': case 'd': size += 8; break;
+      default:
+        LASSERT(a, 0, "Function 'bytes-unpack' passed an unknown format character '%c'.", *c);
+    }
+    if (*c != 'x') { fields++; }
+  }
+
+  const unsigned char* s;
+  long n;
+  byte_span(a->cell[1], &s, &n);
+  long off = a->count == 3 ? a->cell[2]->num : 0;
+  LASSERT(a, off >= 0 && off <= n - size,
+    "Function 'bytes-unpack' cannot read %li bytes at offset %li of %li.", size, off, n);
+
+  const unsigned char* p = s + off;
+  lval* q = lval_qexpr();
+  q->cell = malloc(sizeof(lval*) * (fields ? fields : 1));
+  for (const char* c = fmt; *c; c++) {
+    int w = *c == 'b' || *c == 'B' || *c == 'x' ? 1 : *c == 'h' || *c == 'H' ? 2
+      : *c == 'i' || *c == 'I' || *c == 'f' ? 4 : 8;
+    unsigned long x = big ? load_be(p, w) : load_le(p, w);
+    p += w;
+    switch (*c) {
+      case 'x': continue;
+      case 'b': case 'h': case 'i': q->cell[q->count++] = lval_num(sign_extend(x, w)); break;
+      case 'f': q->cell[q->count++] = lval_dec(bits_f32(x)); break;
+      case 'd': q->cell[q->count++] = lval_dec(bits_f64(x)); break;
+      default: q->cell[q->count++] = lval_num((long)x);
+    }
+  }
+  lval_del(a);
+  return lval_pack(q);
+}
@@ -19,7 +19,7 @@ typedef lval*(*lbuiltin)(lenv*, lval*);
 
 /* Enum of lval types */
 enum { LVAL_NUM, LVAL_DEC, LVAL_ERR, LVAL_SYM, LVAL_STR,
-        LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN, LVAL_FILE };
+        LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN, LVAL_FILE, LVAL_ARR, LVAL_SEQ, LVAL_BYTES, LVAL_DICT, LVAL_VIEW };
 
 /*dynamic array*/
 typedef struct {
@@ -34,8 +34,131 @@ typedef struct {
   FILE* file;
   int ref_count;
   char* mode;
+  char* line;       /* fread-line / file-lines 复用的行缓冲区 */
+  size_t line_cap;
+  char* buf;        /* 交给 setvbuf 的缓冲区，文件关闭后释放 */
 } lval_file_t;
 
+/* 打开文件时给 stdio 设置的默认缓冲区大小，顺序读写大文件时一次读写一大块；
+   (fopen file mode size policy) 可以为单个文件指定大小和 full / line / none 策略 */
+#ifndef FILE_BUF_SIZE
+#define FILE_BUF_SIZE (256 * 1024)
+#endif
+
+/* fwrite-all：短片段先复制进这么大的块，块满或遇到长片段时连同长片段一次 writev 写出 */
+#ifndef WRITEV_CHUNK
+#define WRITEV_CHUNK (1024 * 1024)
+#endif
+
+/* 不短于这个长度的片段不复制，直接作为 writev 的一项 */
+#ifndef WRITEV_DIRECT_MIN
+#define WRITEV_DIRECT_MIN 4096
+#endif
+
+/* serve：listen 的等待队列长度，单个请求 (一行或一帧) 的最大字节数，每次从连接读入的字节数 */
+#ifndef SERVE_BACKLOG
+#define SERVE_BACKLOG 512
+#endif
+
+#ifndef SERVE_MAX_REQUEST
+#define SERVE_MAX_REQUEST (1024 * 1024)
+#endif
+
+#ifndef SERVE_READ_SIZE
+#define SERVE_READ_SIZE (64 * 1024)
+#endif
+
+/* 描述符用完 (EMFILE / ENFILE) 时监听套接字暂停，隔这么多毫秒再试着接受连接 */
+#ifndef SERVE_ACCEPT_RETRY_MS
+#define SERVE_ACCEPT_RETRY_MS 100
+#endif
+
+/* fread-many：io_uring 提交队列的长度 (每轮最多处理这么多个文件)，以及不能用 io_uring 时的线程数 */
+#ifndef FREAD_MANY_QUEUE
+#define FREAD_MANY_QUEUE 64
+#endif
+
+/* fread-many 用 io_uring 时每个文件先读入的字节数，更大的文件剩下的部分另外读 */
+#ifndef FREAD_MANY_CHUNK
+#define FREAD_MANY_CHUNK (16 * 1024)
+#endif
+
+/* 设为 0 时 fread-many 不尝试 io_uring，总是用线程池 */
+#ifndef FREAD_MANY_URING
+#define FREAD_MANY_URING 1
+#endif
+
+#ifndef FREAD_MANY_THREADS
+#define FREAD_MANY_THREADS 8
+#endif
+
+
+/* Packed numeric array (共享存储，引用计数，内容不可变)。
+   ARR_LVAL 只用于 Q-Expression 的共享存储：元素是 lval*，共享期间 (ref_count > 1) 不可修改 */
+enum { ARR_I64, ARR_F64, ARR_LVAL };
+
+typedef struct {
+  int ref_count;
+  int kind;     /* ARR_I64、ARR_F64 或 ARR_LVAL */
+  long count;
+  void* data;   /* long[count]、double[count] 或 lval*[count] */
+} lval_arr_t;
+
+
+/* Lazy sequence: 源节点 (range/iterate/list) 加上一串阶段节点 (map/filter/take)。
+   节点内容不可变，lval_copy 只增加引用计数；元素只在终结操作 (into/fold) 拉取时才计算。 */
+enum { SEQ_RANGE, SEQ_ITERATE, SEQ_LIST, SEQ_MAP, SEQ_FILTER, SEQ_TAKE, SEQ_CSV, SEQ_LINES };
+
+typedef struct lval_seq_t lval_seq_t;
+struct lval_seq_t {
+  int ref_count;
+  int kind;
+  lval_seq_t* parent; /* 阶段节点的上游序列，源节点为 NULL */
+  lval* fn;           /* iterate/map/filter 的函数 */
+  lval* val;          /* iterate 的初值，list 源的列表，csv 源的文件名，lines 源的文件句柄 */
+  long start, end, step; /* range 的区间；take 用 end 作为数量；csv 用 start 作为跳过的记录数 */
+};
+
+
+/* 二进制数据 (共享存储，引用计数，内容不可变)，可以包含任意字节。
+   slice 得到的切片指向 base 的存储 (data 是 base 中的位置)，持有 base 的引用，自己不拥有 data */
+typedef struct lval_bytes_t lval_bytes_t;
+struct lval_bytes_t {
+  int ref_count;
+  long len;
+  unsigned char* data;
+  lval_bytes_t* base;
+};
+
+
+/* 内存映射的只读文件 (mmap-open)，引用计数，最后一个引用释放时 munmap */
+typedef struct {
+  int ref_count;
+  long len;
+  char* data;
+} lval_map_t;
+
+/* 映射中从 off 开始的 len 字节，作为不复制的字符串使用 (共享，引用计数，内容不可变) */
+typedef struct {
+  int ref_count;
+  lval_map_t* map;
+  long off;
+  long len;
+} lval_view_t;
+
+
+/* 字典：字符串键，按插入顺序保存，slots 是开放寻址的哈希表 (存下标 + 1)。
+   存储是共享的 (引用计数)，共享期间 (ref_count > 1) 不可修改，写之前先复制 */
+typedef struct {
+  int ref_count;
+  int count;
+  int cap;
+  char** keys;
+  lval** vals;
+  int* slots;
+  int nslots;   /* 2 的幂，至少是 cap 的两倍 */
+} lval_dict_t;
+
 
 /* lval Struct */
 struct lval {
@@ -60,8 +183,34 @@ struct lval {
 
   /* 使用共享的文件结构体指针 */
   lval_file_t* file_rc;
+
+  /* Packed numeric array; 对 Q-Expression 而言非空表示元素以紧凑形式存储 */
+  lval_arr_t* arr;
+
+  /* Lazy sequence */
+  lval_seq_t* seq;
+
+  /* Binary data */
+  lval_bytes_t* bytes;
+
+  /* Dictionary */
+  lval_dict_t* dict;
+
+  /* Memory-mapped view */
+  lval_view_t* view;
 };
 
+/* 元素不少于这个数目的全数字 Q-Expression 才会使用紧凑存储 */
+#ifndef LVAL_PACK_MIN
+#define LVAL_PACK_MIN 8
+#endif
+
+/* 元素不少于这个数目的 Q-Expression 存入环境时改用共享存储 (ARR_LVAL)，
+   之后 lenv_get 取值只增加引用计数，nth/len 不再需要先复制整个列表 */
+#ifndef LVAL_SHARE_MIN
+#define LVAL_SHARE_MIN 8
+#endif
+
 /* lenv Struct */
 struct lenv {
   lenv* par;
@@ -77,6 +226,8 @@ lval* lval_num(long x);
 lval* lval_dec(double x);
 lval* lval_err(char* fmt, ...);
 lval* lval_sym(char* s);
+lval* lval_sym_n(char* s, int n);
+lval* lval_str_n(char* s, int n);
 lval* lval_sexpr(void);
 lval* lval_qexpr(void);
 lval* lval_fun(lbuiltin func);
@@ -97,15 +248,47 @@ lval* lval_pop(lval* v, int i);
 lval* lval_take(lval* v, int i);
 lval* lval_join(lval* x, lval* y);
 lval* lval_lambda(lval* formals, lval* body);
-//lval* lval_call(lenv* e, lval* f, lval* a);
+lval* lval_call(lenv* e, lval* f, lval* a);
 lval* lval_str(char* s);
 
 
+/* 只追加的输出缓冲区 (lbuf.c)：写满 LBUF_SIZE 或结束时一次 fwrite 到 out，out 为 NULL 时只在内存中增长 */
+#ifndef LBUF_SIZE
+#define LBUF_SIZE (64 * 1024)
+#endif
+
+/* 生成字符串用的缓冲区在调用之间保留的最大容量，更大的结果直接交出缓冲区 */
+#ifndef LBUF_KEEP
+#define LBUF_KEEP (1024 * 1024)
+#endif
+
+typedef struct {
+  char* data;
+  long len;
+  long cap;
+  FILE* out;
+} lbuf;
+
+void lbuf_init(lbuf* b, FILE* out);
+void lbuf_reserve(lbuf* b, long n);
+void lbuf_flush(lbuf* b);
+void lbuf_free(lbuf* b);
+char* lbuf_take(lbuf* b);
+lval* lbuf_str(lbuf* b);
+void lbuf_put(lbuf* b, const char* s, long n);
+void lbuf_putc(lbuf* b, char c);
+void lbuf_puts(lbuf* b, const char* s);
+void lbuf_long(lbuf* b, long x);
+void lbuf_double(lbuf* b, double d);
+void lbuf_escaped(lbuf* b, const char* s);
+void lbuf_escaped_n(lbuf* b, const char* s, long n);
+
 /* Reading & Printing */
 lval* lval_read(mpc_ast_t* t);
+void lval_write(lbuf* b, lval* v);
+void lval_expr_write(lbuf* b, lval* v, char open, char close);
 void lval_print(lval* v);
 void lval_println(lval* v);
-void lval_expr_print(lval* v, char open, char close);
 char* ltype_name(int t);
 void lval_print_str(lval* v);
 lval* lval_read_str(mpc_ast_t* t);
@@ -133,6 +316,9 @@ lval* builtin_eval(lenv* e, lval* a);
 lval* builtin_len(lenv* e, lval* a);
 lval* builtin_cons(lenv* e, lval* a);
 lval* builtin_init(lenv* e, lval* a);
+lval* builtin_nth(lenv* e, lval* a);
+lval* builtin_set_nth(lenv* e, lval* a);
+lval* builtin_slice(lenv* e, lval* a);
 lval* builtin_def(lenv* e, lval* a);
 lval* builtin_add(lenv* e, lval* a);
 lval* builtin_sub(lenv* e, lval* a);
@@ -157,6 +343,7 @@ lval* builtin_if(lenv* e, lval* a);
 lval* builtin_or(lenv* e, lval* a);
 lval* builtin_and(lenv* e, lval* a);
 lval* builtin_not(lenv* e, lval* a);
+int lval_is_true(lval* v);
 lval* builtin_true(lenv* e, lval* a);
 lval* builtin_false(lenv* e, lval* a);
 lval* builtin_load(lenv* e, lval* a);
@@ -164,6 +351,8 @@ lval* builtin_error(lenv* e, lval* a);
 lval* builtin_print(lenv* e, lval* a);
 lval* builtin_read(lenv* e, lval* a);
 lval* builtin_show(lenv* e, lval* a);
+lval* builtin_to_string(lenv* e, lval* a);
+lval* builtin_show_str(lenv* e, lval* a);
 
 /* File Functions */
 lval* builtin_fopen(lenv* e, lval* a);
@@ -183,6 +372,168 @@ lval* builtin_fwrite(lenv* e, lval* a);
 lval* builtin_fseek(lenv* e, lval* a);
 lval* builtin_ftell(lenv* e, lval* a);
 lval* builtin_rewind(lenv* e, lval* a);
+lval* builtin_fprint(lenv* e, lval* a);
+lval* builtin_fwrite_all(lenv* e, lval* a);
+lval* builtin_flush(lenv* e, lval* a);
+lval* builtin_fread_line(lenv* e, lval* a);
+lval* builtin_fread_bytes(lenv* e, lval* a);
+lval* builtin_file_fold_lines(lenv* e, lval* a);
+lval* builtin_csv_fold(lenv* e, lval* a);
+lval* lfile_read_line(lval_file_t* f);
+
+/* 流式 CSV 读取 (file_function.c)，一次解析一条记录 */
+typedef struct lcsv lcsv;
+lcsv* lcsv_open(char* filename);
+lval* lcsv_next(lcsv* c);
+void lcsv_close(lcsv* c);
+
+/* Lazy Sequence Functions */
+void lval_seq_release(lval_seq_t* s);
+lval* builtin_range(lenv* e, lval* a);
+lval* builtin_iterate(lenv* e, lval* a);
+lval* builtin_csv_rows(lenv* e, lval* a);
+lval* builtin_file_lines(lenv* e, lval* a);
+lval* builtin_lazy_map(lenv* e, lval* a);
+lval* builtin_lazy_filter(lenv* e, lval* a);
+lval* builtin_take(lenv* e, lval* a);
+lval* builtin_into(lenv* e, lval* a);
+lval* builtin_fold(lenv* e, lval* a);
+
+/* Sort Functions */
+lval* builtin_sort(lenv* e, lval* a);
+lval* builtin_sort_by(lenv* e, lval* a);
+
+/* Packed Array Functions */
+lval* lval_arr(int kind, long count);
+void lval_arr_release(lval_arr_t* a);
+int lval_arr_eq(lval* x, lval* y);
+void lval_arr_write(lbuf* b, lval* v);
+lval* lval_pack(lval* v);
+lval* lval_unpack(lval* v);
+lval* lval_share(lval* v);
+lval** lval_elems(lval* v);
+lval* lval_packed_nth(lval* v, long i);
+void* lval_packed_own(lval* v);
+int lval_packed_set(lval* v, long i, lval* x);
+int lval_packed_insert(lval* v, lval* x, int front);
+void lval_packed_slice(lval* v, long start, long end);
+int lval_packed_join(lval* x, lval* y);
+int lval_packed_eq(lval* x, lval* y);
+void lval_packed_write(lbuf* b, lval* v, char open, char close);
+lval* builtin_arr_i64(lenv* e, lval* a);
+lval* builtin_arr_f64(lenv* e, lval* a);
+lval* builtin_arr_to_list(lenv* e, lval* a);
+lval* builtin_arr_add(lenv* e, lval* a);
+lval* builtin_arr_sub(lenv* e, lval* a);
+lval* builtin_arr_mul(lenv* e, lval* a);
+lval* builtin_arr_div(lenv* e, lval* a);
+lval* builtin_arr_dot(lenv* e, lval* a);
+lval* builtin_arr_sum(lenv* e, lval* a);
+lval* builtin_arr_min(lenv* e, lval* a);
+lval* builtin_arr_max(lenv* e, lval* a);
+lval* builtin_arr_scale(lenv* e, lval* a);
+lval* builtin_arr_cumsum(lenv* e, lval* a);
+
+/* Dictionary Functions */
+lval* lval_dict(void);
+int lval_dict_find(lval* v, const char* key);
+void lval_dict_put(lval* v, char* key, lval* x);
+int lval_dict_release(lval_dict_t* d);
+void lval_dict_free(lval_dict_t* d);
+int lval_dict_eq(lval* x, lval* y);
+void lval_dict_write(lbuf* b, lval* v);
+lval* builtin_dict(lenv* e, lval* a);
+lval* builtin_dict_get(lenv* e, lval* a);
+lval* builtin_dict_set(lenv* e, lval* a);
+lval* builtin_dict_has(lenv* e, lval* a);
+lval* builtin_dict_keys(lenv* e, lval* a);
+lval* builtin_dict_vals(lenv* e, lval* a);
+
+/* Memory-Mapped Views (view.c) */
+lval* lval_view(lval_map_t* m, long off, long len);
+void lval_view_release(lval_view_t* v);
+lval* lval_view_line(lval* v, long* pos);
+int lval_str_bytes(lval* x, const char** s, long* n);
+lval* builtin_mmap_open(lenv* e, lval* a);
+lval* builtin_substring(lenv* e, lval* a);
+lval* builtin_string_find(lenv* e, lval* a);
+
+/* JSON Functions */
+lval* builtin_json_parse(lenv* e, lval* a);
+lval* builtin_json_emit(lenv* e, lval* a);
+
+/* Binary Data (bytes.c) */
+lval* lval_bytes(unsigned char* data, long len);
+void lval_bytes_release(lval_bytes_t* b);
+lval* lval_bytes_slice(lval* x, long start, long end);
+lval* builtin_bytes_ref(lenv* e, lval* a);
+lval* builtin_bytes_unpack(lenv* e, lval* a);
+lval* builtin_u8(lenv* e, lval* a);
+lval* builtin_i8(lenv* e, lval* a);
+lval* builtin_u16_le(lenv* e, lval* a);
+lval* builtin_u16_be(lenv* e, lval* a);
+lval* builtin_i16_le(lenv* e, lval* a);
+lval* builtin_i16_be(lenv* e, lval* a);
+lval* builtin_u32_le(lenv* e, lval* a);
+lval* builtin_u32_be(lenv* e, lval* a);
+lval* builtin_i32_le(lenv* e, lval* a);
+lval* builtin_i32_be(lenv* e, lval* a);
+lval* builtin_u64_le(lenv* e, lval* a);
+lval* builtin_u64_be(lenv* e, lval* a);
+lval* builtin_f32_le(lenv* e, lval* a);
+lval* builtin_f32_be(lenv* e, lval* a);
+lval* builtin_f64_le(lenv* e, lval* a);
+lval* builtin_f64_be(lenv* e, lval* a);
+
+/* Batched File Reads (batchread.c) */
+typedef struct {
+  const char* path;
+  char* data;   /* 成功时是以 '\0' 结尾的全部内容 */
+  long len;
+  int err;      /* 失败时的 errno */
+} lread_job;
+
+int fread_many_uring(lread_job* jobs, int count);
+void fread_many_threads(lread_job* jobs, int count);
+lval* builtin_fread_many(lenv* e, lval* a);
+
+/* Event Loop (event.c) */
+/* C 层面的事件回调：嵌入在调用者自己的结构体开头。ready 在描述符就绪时调用 (loop_after 的定时器到期时
+   events 为 0)，返回错误时循环停止；
+   forget 在对应的文件被 fclose / unwatch 时调用 */
+typedef struct lnative lnative;
+struct lnative {
+  lval* (*ready)(lenv* e, lnative* n, unsigned events);
+  void (*forget)(lnative* n);
+};
+
+int loop_add(int fd, unsigned events, lnative* n);
+void loop_events(int fd, unsigned events);
+void loop_after(long ms, lnative* n);
+void loop_remove(int fd);
+void loop_forget(lval_file_t* f);
+lval* builtin_on_readable(lenv* e, lval* a);
+lval* builtin_on_writable(lenv* e, lval* a);
+lval* builtin_unwatch(lenv* e, lval* a);
+lval* builtin_after(lenv* e, lval* a);
+lval* builtin_every(lenv* e, lval* a);
+lval* builtin_cancel(lenv* e, lval* a);
+lval* builtin_run_loop(lenv* e, lval* a);
+lval* builtin_stop_loop(lenv* e, lval* a);
+lval* builtin_fread_nb(lenv* e, lval* a);
+lval* builtin_fwrite_nb(lenv* e, lval* a);
+lval* builtin_pipe(lenv* e, lval* a);
+lval* builtin_socketpair(lenv* e, lval* a);
+
+/* Socket Server (serve.c) */
+lval* builtin_serve(lenv* e, lval* a);
+lval* builtin_connect(lenv* e, lval* a);
+
+/* Serialization & Heap Image (serialize.c) */
+lval* lenv_dump_image(lenv* e, char* filename);
+lval* lenv_load_image(lenv* e, char* filename);
+lval* builtin_serialize(lenv* e, lval* a);
+lval* builtin_deserialize(lenv* e, lval* a);
 
 /* Parser Declaration */
 lval* lval_parse(char* input);
@@ -219,7 +570,17 @@ typedef struct {
   int len;      // 源代码总长度
 } Tokenizer;
 
+/* 解析器允许的最大嵌套深度，超过时返回错误而不是耗尽 C 栈。
+   解析本身不受 C 栈限制，但求值、打印等仍是递归的：这个值要保证解析出来的值能被它们处理
+   (与 SERIALIZE_MAX_DEPTH、json-parse 的上限相同，ASan 构建下也不会栈溢出) */
+#ifndef PARSE_MAX_DEPTH
+#define PARSE_MAX_DEPTH 10000
+#endif
+
 /*parser function*/
+void tokenizer_init(void);
+const char* tok_find_structural(const char* p, const char* end);
+const char* tok_find_quote(const char* p, const char* end);
 Tokenizer tokenizer_new(char* src);
 char peek(Tokenizer* t);
 char advance(Tokenizer* t);
@@ -230,7 +591,50 @@ lval* parse_sexpr(Tokenizer* t);
 lval* parse_qexpr(Tokenizer* t);
 lval* parse_atom(Token tok);
 lval* parse_expr_list(Tokenizer* t, TokenType end_type);
+lval* parse_form(Tokenizer* t);
+void parse_stack_free(void);
 lval* lval_parse(char* input);
 
+/* 流式读取器：有界缓冲区 + 顶层表达式边界扫描，一次只解析一个表达式 */
+#ifndef READER_BUF_SIZE
+#define READER_BUF_SIZE (64 * 1024)
+#endif
+
+typedef struct {
+  int fd;
+  char* buf;
+  long cap;
+  long start;   // 下一个表达式在缓冲区中的起点
+  long end;     // 缓冲区中已读入数据的末尾
+  long scan;    // 边界扫描已经检查到的位置
+  int depth;    // 当前括号深度
+  int in_str, in_esc, in_comment, in_atom;
+  int eof;
+} lreader;
+
+/* 并行 load 时每个线程每批解析的数据量 */
+#ifndef LOAD_CHUNK_SIZE
+#define LOAD_CHUNK_SIZE (1024 * 1024)
+#endif
+
+lreader* lreader_open(char* filename);
+lval* lreader_next(lreader* r);
+lval* lreader_next_batch(lreader* r, int nthreads);
+void lreader_close(lreader* r);
+
+/* load 的编译缓存：foo.lspy 解析出的表达式序列化到 foo.lspyc，
+   按源文件内容哈希、缓存格式版本和解释器的构建指纹校验，失效时退回源文件并重新生成。
+   源文件或序列化结果超过 LOAD_CACHE_MAX 字节时不缓存，设为 0 关闭缓存 */
+#ifndef LOAD_CACHE_MAX
+#define LOAD_CACHE_MAX (64 * 1024 * 1024)
+#endif
+
+typedef struct lcache lcache;
+lcache* lcache_open(char* filename, int fd);
+int lcache_valid(lcache* c);
+lval* lcache_next(lcache* c);
+void lcache_add(lcache* c, lval* form);
+void lcache_close(lcache* c, int commit);
+
 
 #endif
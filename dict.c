@@ -0,0 +1,230 @@
+#include "config.h"
+#include "error.h"
+
+/*
+   dict.c
+   字典 (LVAL_DICT)：字符串键到任意值的映射，按插入顺序保存。
+   键和值放在两个平行数组里，另有一个开放寻址的哈希表 (存数组下标 + 1) 用来查找，
+   所以遍历顺序稳定，查找是 O(1)。
+   与列表一样是值语义，但存储是写时复制的：lval_copy 只增加引用计数 (变量引用、参数传递都不复制)，
+   dict-set 只在存储被共享时才复制一份再修改，返回修改后的字典。
+*/
+
+static unsigned long dict_hash(const char* s) {
+  unsigned long h = 1469598103934665603UL;
+  for (; *s; s++) { h = (h ^ (unsigned char)*s) * 1099511628211UL; }
+  return h ^ (h >> 32);
+}
+
+static lval_dict_t* dict_new(int cap) {
+  lval_dict_t* d = malloc(sizeof(lval_dict_t));
+  d->ref_count = 1;
+  d->count = 0;
+  d->cap = cap > 0 ? cap : 4;
+  d->keys = malloc(sizeof(char*) * d->cap);
+  d->vals = malloc(sizeof(lval*) * d->cap);
+  d->nslots = 8;
+  while (d->nslots < d->cap * 2) { d->nslots *= 2; }
+  d->slots = calloc(d->nslots, sizeof(int));
+  return d;
+}
+
+lval* lval_dict(void) {
+  lval* v = lval_alloc();
+  v->type = LVAL_DICT;
+  v->dict = dict_new(4);
+  return v;
+}
+
+/* 键所在的槽位：找到时槽里是它的下标 + 1，否则是可以插入的空槽 */
+static int dict_slot(lval_dict_t* d, const char* key) {
+  int mask = d->nslots - 1;
+  int i = dict_hash(key) & mask;
+  while (d->slots[i] && strcmp(d->keys[d->slots[i] - 1], key) != 0) { i = (i + 1) & mask; }
+  return i;
+}
+
+static void dict_grow(lval_dict_t* d) {
+  d->cap *= 2;
+  d->keys = realloc(d->keys, sizeof(char*) * d->cap);
+  d->vals = realloc(d->vals, sizeof(lval*) * d->cap);
+  if (d->cap * 2 > d->nslots) {
+    d->nslots *= 2;
+    free(d->slots);
+    d->slots = calloc(d->nslots, sizeof(int));
+    for (int k = 0; k < d->count; k++) { d->slots[dict_slot(d, d->keys[k])] = k + 1; }
+  }
+}
+
+/* 查找键，返回下标，不存在时返回 -1 */
+int lval_dict_find(lval* v, const char* key) {
+  int i = dict_slot(v->dict, key);
+  return v->dict->slots[i] - 1;
+}
+
+static lval_dict_t* dict_clone(lval_dict_t* d) {
+  lval_dict_t* n = dict_new(d->cap);
+  n->nslots = d->nslots;
+  free(n->slots);
+  n->slots = malloc(sizeof(int) * d->nslots);
+  memcpy(n->slots, d->slots, sizeof(int) * d->nslots);
+  for (int k = 0; k < d->count; k++) {
+    n->keys[k] = malloc(strlen(d->keys[k]) + 1);
+    strcpy(n->keys[k], d->keys[k]);
+    n->vals[k] = lval_copy(d->vals[k]);
+  }
+  n->count = d->count;
+  return n;
+}
+
+/* 写之前确保存储是独占的 (写时复制) */
+static void dict_own(lval* v) {
+  lval_dict_t* d = v->dict;
+  if (d->ref_count == 1) { return; }
+  v->dict = dict_clone(d);
+  d->ref_count--;
+}
+
+/* 设置键的值，键已存在时替换旧值。key (malloc 得到的) 和 x 的所有权都交给字典 */
+void lval_dict_put(lval* v, char* key, lval* x) {
+  dict_own(v);
+  lval_dict_t* d = v->dict;
+  int i = dict_slot(d, key);
+  if (d->slots[i]) {
+    int k = d->slots[i] - 1;
+    lval_del(d->vals[k]);
+    d->vals[k] = x;
+    free(key);
+    return;
+  }
+  if (d->count == d->cap) {
+    dict_grow(d);
+    i = dict_slot(d, key);
+  }
+  d->keys[d->count] = key;
+  d->vals[d->count] = x;
+  d->slots[i] = ++d->count;
+}
+
+/* 去掉一个引用，返回是否是最后一个 (这时由调用者删除值并 lval_dict_free) */
+int lval_dict_release(lval_dict_t* d) {
+  return --d->ref_count == 0;
+}
+
+/* 只释放键和字典本身，值由 lval_del 放进它的待删除栈 */
+void lval_dict_free(lval_dict_t* d) {
+  for (int k = 0; k < d->count; k++) { free(d->keys[k]); }
+  free(d->keys);
+  free(d->vals);
+  free(d->slots);
+  free(d);
+}
+
+int lval_dict_eq(lval* x, lval* y) {
+  if (x->dict->count != y->dict->count) { return 0; }
+  for (int k = 0; k < x->dict->count; k++) {
+    int j = lval_dict_find(y, x->dict->keys[k]);
+    if (j < 0 || !lval_eq(x->dict->vals[k], y->dict->vals[j])) { return 0; }
+  }
+  return 1;
+}
+
+void lval_dict_write(lbuf* b, lval* v) {
+  lval_dict_t* d = v->dict;
+  lbuf_puts(b, "#dict{");
+  for (int k = 0; k < d->count; k++) {
+    lbuf_escaped(b, d->keys[k]);
+    lbuf_putc(b, ' ');
+    lval_write(b, d->vals[k]);
+    if (k != d->count - 1) { lbuf_putc(b, ' '); }
+  }
+  lbuf_putc(b, '}');
+}
+
+static char* dict_key_copy(lval* k) {
+  char* s = malloc(strlen(k->str) + 1);
+  strcpy(s, k->str);
+  return s;
+}
+
+/* --- 内置函数 --- */
+
+lval* builtin_dict(lenv* e, lval* a) {
+  LASSERT(a, a->count % 2 == 0,
+    "Function 'dict' passed an odd number of arguments. Got %i, Expected key value pairs.", a->count);
+  for (int i = 0; i < a->count; i += 2) { LASSERT_TYPE("dict", a, i, LVAL_STR); }
+
+  lval* d = lval_dict();
+  for (int i = 0; i < a->count; i += 2) {
+    lval_dict_put(d, dict_key_copy(a->cell[i]), a->cell[i+1]);
+    a->cell[i+1] = NULL;
+  }
+  /* 值已经交给字典，只删除键 */
+  for (int i = 0; i < a->count; i += 2) { lval_del(a->cell[i]); }
+  a->count = 0;
+  lval_del(a);
+  return d;
+}
+
+lval* builtin_dict_get(lenv* e, lval* a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function 'dict-get' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+  LASSERT_TYPE("dict-get", a, 0, LVAL_DICT);
+  LASSERT_TYPE("dict-get", a, 1, LVAL_STR);
+
+  lval* d = a->cell[0];
+  int k = lval_dict_find(d, a->cell[1]->str);
+  if (k < 0) {
+    if (a->count == 3) { return lval_take(a, 2); }
+    lval* err = lval_err("Function 'dict-get' key \"%s\" not found.", a->cell[1]->str);
+    lval_del(a);
+    return err;
+  }
+  /* 字典可能与变量共享，值要复制 (共享的列表只增加引用计数) */
+  lval* x = lval_copy(d->dict->vals[k]);
+  lval_del(a);
+  return x;
+}
+
+lval* builtin_dict_set(lenv* e, lval* a) {
+  LASSERT_NUM("dict-set", a, 3);
+  LASSERT_TYPE("dict-set", a, 0, LVAL_DICT);
+  LASSERT_TYPE("dict-set", a, 1, LVAL_STR);
+
+  lval* d = lval_pop(a, 0);
+  lval* k = lval_pop(a, 0);
+  lval_dict_put(d, dict_key_copy(k), lval_take(a, 0));
+  lval_del(k);
+  return d;
+}
+
+lval* builtin_dict_has(lenv* e, lval* a) {
+  LASSERT_NUM("dict-has", a, 2);
+  LASSERT_TYPE("dict-has", a, 0, LVAL_DICT);
+  LASSERT_TYPE("dict-has", a, 1, LVAL_STR);
+  int found = lval_dict_find(a->cell[0], a->cell[1]->str) >= 0;
+  lval_del(a);
+  return lval_num(found);
+}
+
+lval* builtin_dict_keys(lenv* e, lval* a) {
+  LASSERT_NUM("dict-keys", a, 1);
+  LASSERT_TYPE("dict-keys", a, 0, LVAL_DICT);
+  lval_dict_t* d = a->cell[0]->dict;
+  lval* q = lval_qexpr();
+  q->cell = malloc(sizeof(lval*) * (d->count ? d->count : 1));
+  for (int k = 0; k < d->count; k++) { q->cell[q->count++] = lval_str(d->keys[k]); }
+  lval_del(a);
+  return q;
+}
+
+lval* builtin_dict_vals(lenv* e, lval* a) {
+  LASSERT_NUM("dict-vals", a, 1);
+  LASSERT_TYPE("dict-vals", a, 0, LVAL_DICT);
+  lval_dict_t* d = a->cell[0]->dict;
+  lval* q = lval_qexpr();
+  q->cell = malloc(sizeof(lval*) * (d->count ? d->count : 1));
+  for (int k = 0; k < d->count; k++) { q->cell[q->count++] = lval_copy(d->vals[k]); }
+  lval_del(a);
+  return lval_pack(q);
+}
@@ -0,0 +1,483 @@
+#include "config.h"
+#include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+   event.c
+   基于 epoll 的事件循环。
+   on-readable / on-writable 给文件句柄 (管道、套接字等) 登记回调，after / every 登记定时器，
+   run-loop 在一个线程里等待这些事件并依次调用回调；回调是普通的 Lispy 函数，通过 lval_call 求值。
+   没有任何登记的句柄和定时器、或者回调调用了 stop-loop 时 run-loop 返回；
+   回调返回错误时循环停止，run-loop 返回这个错误。
+   fread-nb / fwrite-nb 直接在文件描述符上做非阻塞读写 (不经过 stdio 缓冲区)，
+   pipe / socketpair 创建一对相连的句柄，用于进程内测试。
+   C 代码可以用 loop_add 登记自己的回调 (lnative)，serve.c 的监听套接字和连接就是这样接入同一个循环的。
+*/
+
+/* 一个文件描述符上的回调，file 保存句柄的一份引用，使它在登记期间不会被释放；
+   native 是 C 层面的回调 (serve 的监听套接字和连接)，与 file 不会同时存在 */
+typedef struct {
+  lval* file;
+  lval* on_read;
+  lval* on_write;
+  lnative* native;
+  unsigned native_events;
+} watcher;
+
+/* 定时器：deadline 是单调时钟的毫秒数，interval 为 0 表示只触发一次；
+   native 是 C 层面的定时器 (loop_after)，到期时调用 native->ready；fn 和 native 都为 NULL 表示已取消 */
+typedef struct {
+  long deadline;
+  long interval;
+  long id;
+  lval* fn;
+  lnative* native;
+} ltimer;
+
+static struct {
+  int epfd;
+  watcher* watch;   /* 按文件描述符下标 */
+  int watch_cap;
+  int nwatch;       /* 有回调的描述符个数 */
+  ltimer* heap;     /* 按 deadline 的最小堆 */
+  int ntimers;
+  int timer_cap;
+  int live_timers;  /* 没有取消的定时器个数 */
+  int native_timers; /* 其中 C 层面的定时器个数 */
+  long next_id;
+  int running;
+  int stop;
+} loop = { .epfd = -1 };
+
+static long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* --- 文件描述符 --- */
+
+static int loop_init(void) {
+  if (loop.epfd < 0) { loop.epfd = epoll_create1(EPOLL_CLOEXEC); }
+  return loop.epfd;
+}
+
+/* 需要时扩大按描述符下标的数组 */
+static watcher* watch_slot(int fd) {
+  if (fd >= loop.watch_cap) {
+    int cap = loop.watch_cap ? loop.watch_cap : 64;
+    while (cap <= fd) { cap *= 2; }
+    loop.watch = realloc(loop.watch, sizeof(watcher) * cap);
+    memset(loop.watch + loop.watch_cap, 0, sizeof(watcher) * (cap - loop.watch_cap));
+    loop.watch_cap = cap;
+  }
+  return &loop.watch[fd];
+}
+
+/* 按 fd 的回调更新 epoll 的登记 */
+static int watch_update(int fd) {
+  watcher* w = &loop.watch[fd];
+  unsigned events = w->native ? w->native_events
+    : (w->on_read ? EPOLLIN : 0) | (w->on_write ? EPOLLOUT : 0);
+  if (!events && !w->native) {
+    epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, NULL);
+    lval_del(w->file);
+    w->file = NULL;
+    loop.nwatch--;
+    return 0;
+  }
+  struct epoll_event ev = { .events = events, .data.fd = fd };
+  if (epoll_ctl(loop.epfd, EPOLL_CTL_MOD, fd, &ev) == 0) { return 0; }
+  if (errno != ENOENT) { return -1; }
+  return epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* 登记 C 层面的回调，fd 可读写时调用 n->ready；fd 不能已经登记过 */
+int loop_add(int fd, unsigned events, lnative* n) {
+  if (loop_init() < 0) { return -1; }
+  watcher* w = watch_slot(fd);
+  if (w->file || w->native) { errno = EEXIST; return -1; }
+  w->native = n;
+  w->native_events = events;
+  loop.nwatch++;
+  if (watch_update(fd) < 0) {
+    w->native = NULL;
+    loop.nwatch--;
+    return -1;
+  }
+  return 0;
+}
+
+/* 修改 C 层面的回调等待的事件 (EPOLLIN / EPOLLOUT，可以为 0) */
+void loop_events(int fd, unsigned events) {
+  watcher* w = &loop.watch[fd];
+  if (w->native_events == events) { return; }
+  w->native_events = events;
+  watch_update(fd);
+}
+
+static void timers_forget(lnative* n);
+
+/* 去掉 C 层面的回调和它的定时器，在关闭描述符之前调用 */
+void loop_remove(int fd) {
+  if (fd < 0 || fd >= loop.watch_cap || !loop.watch[fd].native) { return; }
+  timers_forget(loop.watch[fd].native);
+  epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, NULL);
+  loop.watch[fd].native = NULL;
+  loop.nwatch--;
+}
+
+/* 关闭文件之前调用：去掉这个句柄的所有回调，避免描述符被重新使用后收到别的文件的事件 */
+void loop_forget(lval_file_t* f) {
+  if (!f->file) { return; }
+  int fd = fileno(f->file);
+  if (fd < 0 || fd >= loop.watch_cap) { return; }
+  watcher* w = &loop.watch[fd];
+  if (w->native) {
+    lnative* n = w->native;
+    loop_remove(fd);
+    n->forget(n);
+    return;
+  }
+  if (!w->file) { return; }
+  lval_del(w->on_read);
+  lval_del(w->on_write);
+  w->on_read = w->on_write = NULL;
+  watch_update(fd);
+}
+
+/* (on-readable file f) / (on-writable file f)：file 可读 / 可写时调用 (f file)；f 为 () 时取消 */
+static lval* builtin_on_ready(lval* a, char* func, int writable) {
+  LASSERT_NUM(func, a, 2);
+  LASSERT_TYPE(func, a, 0, LVAL_FILE);
+  LASSERT(a, a->cell[1]->type == LVAL_FUN || (a->cell[1]->type == LVAL_SEXPR && a->cell[1]->count == 0),
+    "Function '%s' passed incorrect type for argument 1. Got %s, Expected %s or ().",
+    func, ltype_name(a->cell[1]->type), ltype_name(LVAL_FUN));
+  LASSERT(a, a->cell[0]->file_rc->file != NULL, "Cannot watch a closed file!");
+  LASSERT(a, loop_init() >= 0, "Function '%s' could not create an epoll instance: %s", func, strerror(errno));
+
+  int fd = fileno(a->cell[0]->file_rc->file);
+  watcher* w = watch_slot(fd);
+  LASSERT(a, !w->native, "Function '%s' cannot watch a file that is being served.", func);
+  lval* fn = lval_pop(a, 1);
+  if (fn->type != LVAL_FUN) { lval_del(fn); fn = NULL; }
+  if (!w->file) {
+    if (!fn) { lval_del(a); return lval_sexpr(); }
+    w->file = lval_pop(a, 0);
+    loop.nwatch++;
+  }
+  lval** slot = writable ? &w->on_write : &w->on_read;
+  lval_del(*slot);
+  *slot = fn;
+  lval_del(a);
+
+  if (watch_update(fd) < 0) {
+    /* 普通文件不能用 epoll 等待 (总是就绪) */
+    lval* err = errno == EPERM
+      ? lval_err("Function '%s' cannot watch a regular file, it is always ready.", func)
+      : lval_err("Function '%s' cannot watch this file: %s", func, strerror(errno));
+    loop_forget(w->file->file_rc);
+    return err;
+  }
+  return lval_sexpr();
+}
+
+lval* builtin_on_readable(lenv* e, lval* a) { return builtin_on_ready(a, "on-readable", 0); }
+lval* builtin_on_writable(lenv* e, lval* a) { return builtin_on_ready(a, "on-writable", 1); }
+
+/* (unwatch file)：去掉 file 的所有回调 */
+lval* builtin_unwatch(lenv* e, lval* a) {
+  LASSERT_NUM("unwatch", a, 1);
+  LASSERT_TYPE("unwatch", a, 0, LVAL_FILE);
+  loop_forget(a->cell[0]->file_rc);
+  lval_del(a);
+  return lval_sexpr();
+}
+
+/* --- 定时器 --- */
+
+static void heap_push(ltimer t) {
+  if (loop.ntimers == loop.timer_cap) {
+    loop.timer_cap = loop.timer_cap ? loop.timer_cap * 2 : 16;
+    loop.heap = realloc(loop.heap, sizeof(ltimer) * loop.timer_cap);
+  }
+  int i = loop.ntimers++;
+  while (i > 0 && loop.heap[(i - 1) / 2].deadline > t.deadline) {
+    loop.heap[i] = loop.heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  loop.heap[i] = t;
+}
+
+static ltimer heap_pop(void) {
+  ltimer top = loop.heap[0];
+  ltimer last = loop.heap[--loop.ntimers];
+  int i = 0;
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= loop.ntimers) { break; }
+    if (c + 1 < loop.ntimers && loop.heap[c + 1].deadline < loop.heap[c].deadline) { c++; }
+    if (last.deadline <= loop.heap[c].deadline) { break; }
+    loop.heap[i] = loop.heap[c];
+    i = c;
+  }
+  if (loop.ntimers > 0) { loop.heap[i] = last; }
+  return top;
+}
+
+/* (after ms f) / (every ms f)：ms 毫秒后 (每隔 ms 毫秒) 调用 (f)，返回定时器编号 */
+static lval* builtin_timer(lval* a, char* func, int repeat) {
+  LASSERT_NUM(func, a, 2);
+  LASSERT_TYPE(func, a, 0, LVAL_NUM);
+  LASSERT_TYPE(func, a, 1, LVAL_FUN);
+  long ms = a->cell[0]->num;
+  LASSERT(a, ms >= 0 && (ms > 0 || !repeat), "Function '%s' passed an invalid interval of %li ms.", func, ms);
+
+  ltimer t = { now_ms() + ms, repeat ? ms : 0, ++loop.next_id, lval_pop(a, 1), NULL };
+  heap_push(t);
+  loop.live_timers++;
+  lval_del(a);
+  return lval_num(t.id);
+}
+
+lval* builtin_after(lenv* e, lval* a) { return builtin_timer(a, "after", 0); }
+
+/* C 层面的一次性定时器：ms 毫秒后调用 n->ready(e, n, 0)。n 登记的描述符被 loop_remove 时一起取消 */
+void loop_after(long ms, lnative* n) {
+  ltimer t = { now_ms() + ms, 0, ++loop.next_id, NULL, n };
+  heap_push(t);
+  loop.live_timers++;
+  loop.native_timers++;
+}
+
+static void timers_forget(lnative* n) {
+  for (int i = 0; i < loop.ntimers && loop.native_timers > 0; i++) {
+    if (loop.heap[i].native == n) {
+      loop.heap[i].native = NULL;
+      loop.live_timers--;
+      loop.native_timers--;
+    }
+  }
+}
+lval* builtin_every(lenv* e, lval* a) { return builtin_timer(a, "every", 1); }
+
+/* (cancel id)：取消定时器；堆中的项只做标记，到期时丢弃 */
+lval* builtin_cancel(lenv* e, lval* a) {
+  LASSERT_NUM("cancel", a, 1);
+  LASSERT_TYPE("cancel", a, 0, LVAL_NUM);
+  long id = a->cell[0]->num;
+  lval_del(a);
+  for (int i = 0; i < loop.ntimers; i++) {
+    if (loop.heap[i].id == id && loop.heap[i].fn) {
+      lval_del(loop.heap[i].fn);
+      loop.heap[i].fn = NULL;
+      loop.live_timers--;
+      return lval_num(1);
+    }
+  }
+  return lval_num(0);
+}
+
+/* --- 循环 --- */
+
+/* 调用所有已到期的定时器；出错时返回错误 */
+static lval* run_timers(lenv* e) {
+  long now = now_ms();
+  while (loop.ntimers > 0 && loop.heap[0].deadline <= now && !loop.stop) {
+    ltimer t = heap_pop();
+    if (t.native) {
+      loop.live_timers--;
+      loop.native_timers--;
+      lval* r = t.native->ready(e, t.native, 0);
+      if (r) { return r; }
+      continue;
+    }
+    if (!t.fn) { continue; }
+    lval* fn = t.fn;
+    if (t.interval > 0) {
+      /* 按原定的节拍安排下一次，落后太多时从现在重新开始 */
+      t.deadline += t.interval;
+      if (t.deadline <= now) { t.deadline = now + t.interval; }
+      t.fn = lval_copy(fn);
+      heap_push(t);
+    } else {
+      loop.live_timers--;
+    }
+    lval* r = lval_call(e, fn, lval_sexpr());
+    if (r->type == LVAL_ERR) { return r; }
+    lval_del(r);
+  }
+  return NULL;
+}
+
+#define LOOP_MAX_EVENTS 64
+
+/* (run-loop)：处理事件和定时器，直到没有任何登记或调用了 stop-loop */
+lval* builtin_run_loop(lenv* e, lval* a) {
+  LASSERT_NUM("run-loop", a, 0);
+  LASSERT(a, !loop.running, "Function 'run-loop' called while the loop is already running.");
+  lval_del(a);
+  if (loop_init() < 0) { return lval_err("Function 'run-loop' could not create an epoll instance: %s", strerror(errno)); }
+
+  loop.running = 1;
+  loop.stop = 0;
+  lval* err = NULL;
+  struct epoll_event events[LOOP_MAX_EVENTS];
+
+  while (!loop.stop && !err && (loop.nwatch > 0 || loop.live_timers > 0)) {
+    /* 丢掉堆顶已取消的定时器，再按最早的到期时间决定等待多久 */
+    while (loop.ntimers > 0 && !loop.heap[0].fn && !loop.heap[0].native) { heap_pop(); }
+    int timeout = -1;
+    if (loop.ntimers > 0) {
+      long wait = loop.heap[0].deadline - now_ms();
+      timeout = wait < 0 ? 0 : wait > 1000000 ? 1000000 : (int)wait;
+    }
+
+    int n = epoll_wait(loop.epfd, events, LOOP_MAX_EVENTS, timeout);
+    if (n < 0 && errno != EINTR) {
+      err = lval_err("Function 'run-loop' failed: %s", strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < n && !loop.stop && !err; i++) {
+      int fd = events[i].data.fd;
+      unsigned ev = events[i].events;
+      /* 挂断和出错时两种回调都调用，让回调通过读写看到结束或错误 */
+      if (ev & (EPOLLHUP | EPOLLERR)) { ev |= EPOLLIN | EPOLLOUT; }
+      if (fd < loop.watch_cap && loop.watch[fd].native) {
+        /* ready 可能去掉并释放 native，之后不能再访问它 */
+        lnative* nv = loop.watch[fd].native;
+        err = nv->ready(e, nv, events[i].events);
+        continue;
+      }
+      for (int k = 0; k < 2 && !err; k++) {
+        /* 前面的回调可能已经去掉了这个描述符的登记 */
+        if (fd >= loop.watch_cap || !loop.watch[fd].file) { break; }
+        watcher* w = &loop.watch[fd];
+        lval* fn = k == 0 ? w->on_read : w->on_write;
+        if (!fn || !(ev & (k == 0 ? EPOLLIN : EPOLLOUT))) { continue; }
+        lval* r = lval_call(e, lval_copy(fn), lval_add(lval_sexpr(), lval_copy(w->file)));
+        if (r->type == LVAL_ERR) { err = r; } else { lval_del(r); }
+      }
+    }
+
+    if (!err && !loop.stop) { err = run_timers(e); }
+  }
+
+  loop.running = 0;
+  return err ? err : lval_sexpr();
+}
+
+/* (stop-loop)：当前回调返回后 run-loop 结束，登记的回调和定时器保留 */
+lval* builtin_stop_loop(lenv* e, lval* a) {
+  LASSERT_NUM("stop-loop", a, 0);
+  loop.stop = 1;
+  lval_del(a);
+  return lval_sexpr();
+}
+
+/* --- 非阻塞读写 --- */
+
+static int set_nonblock(int fd) {
+  int fl = fcntl(fd, F_GETFL);
+  if (fl < 0) { return -1; }
+  if (fl & O_NONBLOCK) { return 0; }
+  return fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+/* (fread-nb file n)：立即可读的最多 n 个字节；没有数据时返回 ""，文件结束时返回 () */
+lval* builtin_fread_nb(lenv* e, lval* a) {
+  LASSERT_NUM("fread-nb", a, 2);
+  LASSERT_TYPE("fread-nb", a, 0, LVAL_FILE);
+  LASSERT_TYPE("fread-nb", a, 1, LVAL_NUM);
+  LASSERT(a, a->cell[0]->file_rc->file != NULL, "Cannot read from a closed file!");
+  long size = a->cell[1]->num;
+  LASSERT(a, size >= 0, "Function 'fread-nb' passed a negative size.");
+
+  int fd = fileno(a->cell[0]->file_rc->file);
+  lval_del(a);
+  set_nonblock(fd);
+
+  char* buf = malloc(size + 1);
+  ssize_t n;
+  do { n = read(fd, buf, size); } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    free(buf);
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return lval_str(""); }
+    return lval_err("Function 'fread-nb' failed: %s", strerror(errno));
+  }
+  if (n == 0 && size > 0) {
+    free(buf);
+    return lval_sexpr();
+  }
+  buf[n] = '\0';
+  lval* v = lval_alloc();
+  v->type = LVAL_STR;
+  v->str = realloc(buf, n + 1);
+  return v;
+}
+
+/* (fwrite-nb file s)：不阻塞地写出 s 中能立即写出的部分，返回写出的字节数 (可能为 0) */
+lval* builtin_fwrite_nb(lenv* e, lval* a) {
+  LASSERT_NUM("fwrite-nb", a, 2);
+  LASSERT_TYPE("fwrite-nb", a, 0, LVAL_FILE);
+  LASSERT(a, a->cell[1]->type == LVAL_STR || a->cell[1]->type == LVAL_BYTES || a->cell[1]->type == LVAL_VIEW,
+    "Function 'fwrite-nb' passed incorrect type for argument 1. Got %s, Expected %s, %s or %s.",
+    ltype_name(a->cell[1]->type), ltype_name(LVAL_STR), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
+  FILE* f = a->cell[0]->file_rc->file;
+  LASSERT(a, f != NULL, "Cannot write to a closed file!");
+
+  const char* s;
+  long len;
+  if (a->cell[1]->type == LVAL_BYTES) {
+    s = (const char*)a->cell[1]->bytes->data;
+    len = a->cell[1]->bytes->len;
+  } else {
+    lval_str_bytes(a->cell[1], &s, &len);
+  }
+
+  /* stdio 中还没写出的内容要排在前面 */
+  fflush(f);
+  int fd = fileno(f);
+  set_nonblock(fd);
+  ssize_t n;
+  do { n = write(fd, s, len); } while (n < 0 && errno == EINTR);
+  lval_del(a);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return lval_num(0); }
+    return lval_err("Function 'fwrite-nb' failed: %s", strerror(errno));
+  }
+  return lval_num(n);
+}
+
+/* 由描述符创建文件句柄 */
+static lval* fd_file(int fd, char* mode) {
+  lval* f = lval_file(mode);
+  f->file_rc->file = fdopen(fd, mode);
+  return f;
+}
+
+/* (pipe)：{读端 写端} */
+lval* builtin_pipe(lenv* e, lval* a) {
+  LASSERT_NUM("pipe", a, 0);
+  lval_del(a);
+  int fds[2];
+  if (pipe(fds) < 0) { return lval_err("Function 'pipe' failed: %s", strerror(errno)); }
+  return lval_add(lval_add(lval_qexpr(), fd_file(fds[0], "r")), fd_file(fds[1], "w"));
+}
+
+/* (socketpair)：一对相连的 Unix 域流套接字，两端都可读写 */
+lval* builtin_socketpair(lenv* e, lval* a) {
+  LASSERT_NUM("socketpair", a, 0);
+  lval_del(a);
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    return lval_err("Function 'socketpair' failed: %s", strerror(errno));
+  }
+  return lval_add(lval_add(lval_qexpr(), fd_file(fds[0], "r+")), fd_file(fds[1], "r+"));
+}
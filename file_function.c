@@ -1,5 +1,9 @@
 #include "config.h"
 #include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 lval* lval_file(char* mode) {
     lval* v = malloc(sizeof(lval));
@@ -9,18 +13,32 @@ lval* lval_file(char* mode) {
     v->file_rc = malloc(sizeof(lval_file_t));
     v->file_rc->file = NULL;
     v->file_rc->ref_count = 1; /* 初始化引用计数为 1 */
+    v->file_rc->line = NULL;
+    v->file_rc->line_cap = 0;
+    v->file_rc->buf = NULL;
     v->file_rc->mode = malloc(strlen(mode) + 1);
     strcpy(v->file_rc->mode, mode);
     return v;
 }
 
+/* (fopen "file" "mode" [size] [policy])：size 是 stdio 缓冲区的字节数 (默认 FILE_BUF_SIZE)，
+   policy 是 "full" (写满才写出，默认)、"line" (遇到换行写出) 或 "none" (不缓冲) */
 lval* builtin_fopen(lenv* e, lval* a) {
-    LASSERT_NUM("fopen", a, 2);
+    LASSERT(a, a->count >= 2 && a->count <= 4,
+        "Function 'fopen' passed incorrect number of arguments. Got %i, Expected 2 to 4.", a->count);
     LASSERT_TYPE("fopen", a, 0, LVAL_STR);
     LASSERT_TYPE("fopen", a, 1, LVAL_STR);
+    if (a->count >= 3) { LASSERT_TYPE("fopen", a, 2, LVAL_NUM); }
+    if (a->count == 4) { LASSERT_TYPE("fopen", a, 3, LVAL_STR); }
 
     char* filename = a->cell[0]->str;
     char* mode = a->cell[1]->str;
+    long size = a->count >= 3 ? a->cell[2]->num : FILE_BUF_SIZE;
+    char* policy = a->count == 4 ? a->cell[3]->str : "full";
+    int vmode = strcmp(policy, "full") == 0 ? _IOFBF : strcmp(policy, "line") == 0 ? _IOLBF
+        : strcmp(policy, "none") == 0 ? _IONBF : -1;
+    LASSERT(a, vmode >= 0, "Function 'fopen' passed an unknown buffering policy '%s'. Expected full, line or none.", policy);
+    LASSERT(a, size > 0, "Function 'fopen' passed a buffer size of %li.", size);
 
     /* Create the file lval */
     lval* f = lval_file(mode);
@@ -28,10 +46,14 @@ lval* builtin_fopen(lenv* e, lval* a) {
 
     /* If fopen failed */
     if (!f->file_rc->file) {
+        lval* err = lval_err("Failed to open file '%s' with mode '%s'.", filename, mode);
         lval_del(f);
         lval_del(a);
-        return lval_err("Failed to open file '%s' with mode '%s'.", filename, mode);
+        return err;
     }
+    /* 缓冲区由我们分配：glibc 的 setvbuf 在 buf 为 NULL 时会忽略 size，仍然用 4 KB */
+    if (vmode != _IONBF) { f->file_rc->buf = malloc(size); }
+    setvbuf(f->file_rc->file, f->file_rc->buf, vmode, size);
     lval_del(a);
     return f;
 }
@@ -42,8 +64,12 @@ lval* builtin_fclose(lenv* e, lval* a) {
 
     lval* f = a->cell[0];
     if (f->file_rc->file) {
+        /* 先去掉事件循环中的回调，描述符关闭后可能被新打开的文件重新使用 */
+        loop_forget(f->file_rc);
         fclose(f->file_rc->file);
         f->file_rc->file = NULL;//为什么不是直接del？
+        free(f->file_rc->buf);
+        f->file_rc->buf = NULL;
     }
     lval_del(a);
     return lval_sexpr();
@@ -63,42 +89,227 @@ lval* builtin_fread(lenv* e, lval* a) {
         return lval_err("Cannot read from a closed file!");
     }
 
-    /* Allocate buffer */
+    if (size < 0) {
+        lval_del(a);
+        return lval_err("Function 'fread' passed a negative size.");
+    }
+
+    /* 直接读进 String 的存储，读到的比请求的少时收缩 */
     char* buffer = malloc(size + 1);
-    
-    /* Read from file */
     size_t read_size = fread(buffer, 1, size, f->file_rc->file);
     buffer[read_size] = '\0';
+    if ((long)read_size < size) { buffer = realloc(buffer, read_size + 1); }
 
     lval_del(a);
-    
-    /* Return as string */
-    lval* result = lval_str(buffer);
-    free(buffer);
+
+    lval* result = lval_alloc();
+    result->type = LVAL_STR;
+    result->str = buffer;
     return result;
 }
 
 
 
 
+/* (fread-bytes file n)：最多读 n 个字节作为 Bytes，可以包含 '\0'；文件结束时得到空的 Bytes */
+lval* builtin_fread_bytes(lenv* e, lval* a) {
+    LASSERT_NUM("fread-bytes", a, 2);
+    LASSERT_TYPE("fread-bytes", a, 0, LVAL_FILE);
+    LASSERT_TYPE("fread-bytes", a, 1, LVAL_NUM);
+
+    FILE* f = a->cell[0]->file_rc->file;
+    long size = a->cell[1]->num;
+    if (!f) {
+        lval_del(a);
+        return lval_err("Cannot read from a closed file!");
+    }
+    LASSERT(a, size >= 0, "Function 'fread-bytes' passed a negative size.");
+
+    unsigned char* data = malloc(size ? size : 1);
+    size_t n = fread(data, 1, size, f);
+    if ((long)n < size) { data = realloc(data, n ? n : 1); }
+    lval_del(a);
+    return lval_bytes(data, n);
+}
+
 lval* builtin_fwrite(lenv* e, lval* a) {
     LASSERT_NUM("fwrite", a, 2);
     LASSERT_TYPE("fwrite", a, 0, LVAL_FILE);
-    LASSERT_TYPE("fwrite", a, 1, LVAL_STR);
+    LASSERT(a, a->cell[1]->type == LVAL_STR || a->cell[1]->type == LVAL_BYTES || a->cell[1]->type == LVAL_VIEW,
+        "Function 'fwrite' passed incorrect type for argument 1. Got %s, Expected %s, %s or %s.",
+        ltype_name(a->cell[1]->type), ltype_name(LVAL_STR), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
 
     lval* f = a->cell[0];
-    char* str = a->cell[1]->str;
 
     if(!f->file_rc->file) {
         lval_del(a);
         return lval_err("Cannot write to a closed file!");
     }
 
-    fwrite(str, 1, strlen(str), f->file_rc->file);//这里为什么不用像fread那样分配缓冲区？
+    /* Bytes 原样写出，可以包含 '\0' */
+    if (a->cell[1]->type == LVAL_BYTES) {
+        fwrite(a->cell[1]->bytes->data, 1, a->cell[1]->bytes->len, f->file_rc->file);
+        lval_del(a);
+        return lval_sexpr();
+    }
+
+    const char* str;
+    long n;
+    lval_str_bytes(a->cell[1], &str, &n);
+    fwrite(str, 1, n, f->file_rc->file);//这里为什么不用像fread那样分配缓冲区？
+    lval_del(a);
+    return lval_sexpr();
+}
+
+/* (fprint file x ...)：与 print 相同的格式写入文件，经过输出缓冲区一次写出 */
+lval* builtin_fprint(lenv* e, lval* a) {
+    LASSERT(a, a->count >= 1,
+        "Function 'fprint' passed incorrect number of arguments. Got %i, Expected at least 1.", a->count);
+    LASSERT_TYPE("fprint", a, 0, LVAL_FILE);
+
+    lval* f = a->cell[0];
+    if (!f->file_rc->file) {
+        lval_del(a);
+        return lval_err("Cannot write to a closed file!");
+    }
+
+    lbuf b;
+    lbuf_init(&b, f->file_rc->file);
+    for (int i = 1; i < a->count; i++) {
+        lval_write(&b, a->cell[i]);
+        lbuf_putc(&b, ' ');
+    }
+    lbuf_putc(&b, '\n');
+    lbuf_free(&b);
     lval_del(a);
     return lval_sexpr();
 }
 
+/* (flush [file])：把 file (缺省为标准输出) 缓冲区中的内容写出 */
+lval* builtin_flush(lenv* e, lval* a) {
+    LASSERT(a, a->count <= 1,
+        "Function 'flush' passed incorrect number of arguments. Got %i, Expected 0 or 1.", a->count);
+    FILE* f = stdout;
+    if (a->count == 1) {
+        LASSERT_TYPE("flush", a, 0, LVAL_FILE);
+        f = a->cell[0]->file_rc->file;
+        LASSERT(a, f != NULL, "Cannot flush a closed file!");
+    }
+    fflush(f);
+    lval_del(a);
+    return lval_sexpr();
+}
+
+/* writev 直到全部写出，处理部分写入和 EINTR；出错返回 -1 */
+static int writev_all(int fd, struct iovec* iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) { continue; }
+            return -1;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char*)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+#define WRITEV_BATCH 1024
+
+/* 待写出的片段：短片段复制进 chunk，长片段直接引用，攒满后一次 writev */
+typedef struct {
+    int fd;
+    struct iovec iov[WRITEV_BATCH];
+    int n;
+    char* chunk;
+    long len;
+    long mark;      /* chunk 中还没有作为 iov 项加入的部分从这里开始 */
+    int err;
+} lgather;
+
+static void gather_cut(lgather* g) {
+    if (g->len > g->mark) {
+        g->iov[g->n++] = (struct iovec){ g->chunk + g->mark, g->len - g->mark };
+        g->mark = g->len;
+    }
+}
+
+static void gather_flush(lgather* g) {
+    gather_cut(g);
+    if (g->n > 0 && !g->err && writev_all(g->fd, g->iov, g->n) < 0) { g->err = errno; }
+    g->n = 0;
+    g->len = g->mark = 0;
+}
+
+static void gather_put(lgather* g, const char* s, long n) {
+    if (n >= WRITEV_DIRECT_MIN) {
+        if (g->n + 2 > WRITEV_BATCH) { gather_flush(g); }
+        gather_cut(g);
+        g->iov[g->n++] = (struct iovec){ (void*)s, n };
+        return;
+    }
+    if (g->len + n > WRITEV_CHUNK || g->n + 1 >= WRITEV_BATCH) { gather_flush(g); }
+    memcpy(g->chunk + g->len, s, n);
+    g->len += n;
+}
+
+/* (fwrite-all file {fragments})：依次写出列表中的 String / Bytes / View。
+   片段不经过 stdio，短片段合并进 WRITEV_CHUNK 大小的块，长片段不复制，
+   整个列表只需要 (总长度 / WRITEV_CHUNK) 次左右的 writev */
+lval* builtin_fwrite_all(lenv* e, lval* a) {
+    LASSERT_NUM("fwrite-all", a, 2);
+    LASSERT_TYPE("fwrite-all", a, 0, LVAL_FILE);
+    LASSERT_TYPE("fwrite-all", a, 1, LVAL_QEXPR);
+
+    FILE* f = a->cell[0]->file_rc->file;
+    LASSERT(a, f != NULL, "Cannot write to a closed file!");
+
+    lval* q = a->cell[1];
+    lval_unpack(q);
+    for (int i = 0; i < q->count; i++) {
+        int t = q->cell[i]->type;
+        LASSERT(a, t == LVAL_STR || t == LVAL_BYTES || t == LVAL_VIEW,
+            "Function 'fwrite-all' passed a %s in the list. Expected %s, %s or %s.",
+            ltype_name(t), ltype_name(LVAL_STR), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
+    }
+
+    /* stdio 缓冲区中已有的内容先写出，保证顺序 */
+    fflush(f);
+
+    lgather* g = malloc(sizeof(lgather));
+    g->fd = fileno(f);
+    g->n = 0;
+    g->chunk = malloc(WRITEV_CHUNK);
+    g->len = g->mark = 0;
+    g->err = 0;
+    for (int i = 0; i < q->count && !g->err; i++) {
+        lval* x = q->cell[i];
+        if (x->type == LVAL_BYTES) {
+            gather_put(g, (const char*)x->bytes->data, x->bytes->len);
+        } else {
+            const char* s;
+            long n;
+            lval_str_bytes(x, &s, &n);
+            gather_put(g, s, n);
+        }
+    }
+    gather_flush(g);
+
+    int err = g->err;
+    free(g->chunk);
+    free(g);
+    lval_del(a);
+    if (err) { return lval_err("Function 'fwrite-all' failed: %s", strerror(err)); }
+    return lval_sexpr();
+}
+
 lval* builtin_fseek(lenv* e, lval* a) {
     LASSERT_NUM("fseek", a, 2);
     LASSERT_TYPE("fseek", a, 0, LVAL_FILE);
@@ -147,4 +358,324 @@ lval* builtin_rewind(lenv* e, lval* a) {
 
     lval_del(a);
     return lval_sexpr();
-}
\ No newline at end of file
+}
+
+/* --- 按行读取 ---
+   fread-line / file-lines / file-fold-lines 用 getline 从文件句柄读出一行 (去掉行尾的 \n 或 \r\n)。
+   行缓冲区挂在句柄的共享结构体上，各行之间复用，只在遇到更长的行时扩容；
+   底层是 fopen 设置的 FILE_BUF_SIZE 缓冲区，所以可以和 fread / fseek / ftell 混合使用。 */
+
+/* 读出下一行作为 String，文件结束时返回 NULL，读取出错时返回错误 */
+lval* lfile_read_line(lval_file_t* f) {
+    ssize_t n = getline(&f->line, &f->line_cap, f->file);
+    if (n < 0) {
+        if (ferror(f->file)) { return lval_err("Error reading file: %s", strerror(errno)); }
+        return NULL;
+    }
+    if (n > 0 && f->line[n - 1] == '\n') { n--; }
+    if (n > 0 && f->line[n - 1] == '\r') { n--; }
+
+    lval* v = lval_alloc();
+    v->type = LVAL_STR;
+    v->str = malloc(n + 1);
+    memcpy(v->str, f->line, n);
+    v->str[n] = '\0';
+    return v;
+}
+
+/* (fread-line file)：下一行，文件结束时返回 () */
+lval* builtin_fread_line(lenv* e, lval* a) {
+    LASSERT_NUM("fread-line", a, 1);
+    LASSERT_TYPE("fread-line", a, 0, LVAL_FILE);
+
+    lval_file_t* f = a->cell[0]->file_rc;
+    if (!f->file) {
+        lval_del(a);
+        return lval_err("Cannot read from a closed file!");
+    }
+    lval* line = lfile_read_line(f);
+    lval_del(a);
+    return line ? line : lval_sexpr();
+}
+
+/* (file-fold-lines f z file)：从当前位置开始依次用 f 把每一行累加到 z 上 */
+lval* builtin_file_fold_lines(lenv* e, lval* a) {
+    LASSERT_NUM("file-fold-lines", a, 3);
+    LASSERT_TYPE("file-fold-lines", a, 0, LVAL_FUN);
+    LASSERT_TYPE("file-fold-lines", a, 2, LVAL_FILE);
+    LASSERT(a, a->cell[2]->file_rc->file != NULL, "Cannot read from a closed file!");
+
+    lval* f = lval_pop(a, 0);
+    lval* acc = lval_pop(a, 0);
+    lval* file = lval_pop(a, 0);
+    lval_del(a);
+
+    lval* line;
+    while ((line = lfile_read_line(file->file_rc))) {
+        if (line->type == LVAL_ERR) {
+            lval_del(acc);
+            acc = line;
+            break;
+        }
+        acc = lval_call(e, lval_copy(f), lval_add(lval_add(lval_sexpr(), acc), line));
+        if (acc->type == LVAL_ERR) { break; }
+        /* f 可能关闭了文件 */
+        if (!file->file_rc->file) { break; }
+    }
+    lval_del(file);
+    lval_del(f);
+    return acc;
+}
+
+/* --- CSV ---
+   流式读取 CSV：固定大小的缓冲区用完后从文件描述符继续读入，一次只解析一条记录，
+   内存占用与文件大小无关 (缓冲区只会在单条记录比它还大时扩容)。
+   字段以逗号分隔，记录以 \n 或 \r\n 结束；带引号的字段可以包含逗号、换行和 "" (转义的引号)。
+   没有引号、形如数字的字段转换成 Number / Decimal，其余字段是 String；空行跳过。
+   每条记录是一个 Q-Expression，全数字的记录使用紧凑表示。 */
+
+struct lcsv {
+    int fd;
+    char* buf;
+    long cap;
+    long start;     /* 下一条记录在缓冲区中的起点 */
+    long end;       /* 缓冲区中已读入数据的末尾 */
+    int eof;
+    long record;    /* 已读出的记录数，用于错误信息 */
+    lval_vec fields;
+    char* field;    /* 带引号字段去掉转义后的内容 */
+    long field_cap;
+};
+
+lcsv* lcsv_open(char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return NULL; }
+
+    lcsv* c = malloc(sizeof(lcsv));
+    c->fd = fd;
+    c->cap = READER_BUF_SIZE;
+    c->buf = malloc(c->cap);
+    c->start = c->end = 0;
+    c->eof = 0;
+    c->record = 0;
+    c->fields = (lval_vec){0};
+    c->field_cap = 256;
+    c->field = malloc(c->field_cap);
+    return c;
+}
+
+void lcsv_close(lcsv* c) {
+    close(c->fd);
+    free(c->buf);
+    free(c->field);
+    vec_free(&c->fields);
+    free(c);
+}
+
+/* 把未处理的数据移到缓冲区开头，需要时扩容，再从文件读入一块 */
+static void csv_fill(lcsv* c) {
+    if (c->start > 0) {
+        memmove(c->buf, c->buf + c->start, c->end - c->start);
+        c->end -= c->start;
+        c->start = 0;
+    }
+    if (c->end == c->cap) {
+        c->cap *= 2;
+        c->buf = realloc(c->buf, c->cap);
+    }
+
+    ssize_t n;
+    do {
+        n = read(c->fd, c->buf + c->end, c->cap - c->end);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) { c->eof = 1; return; }
+    c->end += n;
+}
+
+static lval* csv_str(const char* s, long n) {
+    lval* v = lval_alloc();
+    v->type = LVAL_STR;
+    v->str = malloc(n + 1);
+    memcpy(v->str, s, n);
+    v->str[n] = '\0';
+    return v;
+}
+
+/* 没有引号的字段：-?数字[.数字][e[+-]数字] 交给解析器的数字转换，其余是字符串 */
+static lval* csv_atom(char* s, long n) {
+    long i = 0;
+    if (i < n && s[i] == '-') { i++; }
+    long d = i;
+    while (i < n && s[i] >= '0' && s[i] <= '9') { i++; }
+    int ok = i > d;
+    if (ok && i < n && s[i] == '.') {
+        d = ++i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') { i++; }
+        ok = i > d;
+    }
+    if (ok && i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) { i++; }
+        d = i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') { i++; }
+        ok = i > d;
+    }
+    if (ok && i == n) {
+        Token tok = { TOK_NUM, s, (int)n, NULL };
+        return parse_atom(tok);
+    }
+    return csv_str(s, n);
+}
+
+static void csv_field_put(lcsv* c, long* len, const char* s, long n) {
+    if (*len + n + 1 > c->field_cap) {
+        while (*len + n + 1 > c->field_cap) { c->field_cap *= 2; }
+        c->field = realloc(c->field, c->field_cap);
+    }
+    memcpy(c->field + *len, s, n);
+    *len += n;
+}
+
+static void csv_drop_fields(lcsv* c) {
+    for (int i = 0; i < c->fields.count; i++) { lval_del(c->fields.items[i]); }
+    c->fields.count = 0;
+}
+
+/* 从 c->start 开始解析一条记录。
+   返回 1 并设置 *row 表示得到一条记录 (或错误)；返回 0 表示缓冲区中的数据不够，需要再读入 */
+static int csv_parse_record(lcsv* c, lval** row) {
+    char* p = c->buf + c->start;
+    char* end = c->buf + c->end;
+
+    for (;;) {
+        if (p >= end) {
+            /* 只有逗号后面紧接着文件结束时才会到这里：最后一个字段是空的 */
+            if (!c->eof) { goto more; }
+            vec_push(&c->fields, csv_str("", 0));
+            break;
+        }
+
+        if (*p == '"') {
+            long len = 0;
+            char* q = p + 1;
+            for (;;) {
+                char* quote = memchr(q, '"', end - q);
+                if (!quote) {
+                    if (!c->eof) { goto more; }
+                    csv_drop_fields(c);
+                    *row = lval_err("Malformed CSV: unterminated quoted field in record %ld.", c->record + 1);
+                    c->start = c->end;
+                    return 1;
+                }
+                csv_field_put(c, &len, q, quote - q);
+                if (quote + 1 >= end && !c->eof) { goto more; }
+                if (quote + 1 < end && quote[1] == '"') {
+                    csv_field_put(c, &len, "\"", 1);
+                    q = quote + 2;
+                    continue;
+                }
+                p = quote + 1;
+                break;
+            }
+            if (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+                csv_drop_fields(c);
+                *row = lval_err("Malformed CSV: text after a closing quote in record %ld.", c->record + 1);
+                /* 跳过这一行剩下的部分 */
+                char* nl = memchr(p, '\n', end - p);
+                c->start = nl ? nl + 1 - c->buf : c->end;
+                return 1;
+            }
+            vec_push(&c->fields, csv_str(c->field, len));
+        } else {
+            char* q = p;
+            while (q < end && *q != ',' && *q != '\n' && *q != '\r') { q++; }
+            if (q >= end && !c->eof) { goto more; }
+            vec_push(&c->fields, csv_atom(p, q - p));
+            p = q;
+        }
+
+        if (p >= end) { break; }
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (*p == '\r') {
+            p++;
+            if (p >= end && !c->eof) { goto more; }
+            if (p < end && *p == '\n') { p++; }
+        } else {
+            p++;
+        }
+        break;
+    }
+
+    lval* q = lval_qexpr();
+    q->cell = malloc(sizeof(lval*) * c->fields.count);
+    memcpy(q->cell, c->fields.items, sizeof(lval*) * c->fields.count);
+    q->count = c->fields.count;
+    c->fields.count = 0;
+    c->start = p - c->buf;
+    c->record++;
+    *row = lval_pack(q);
+    return 1;
+
+more:
+    csv_drop_fields(c);
+    return 0;
+}
+
+/* 读出下一条记录，文件结束时返回 NULL，格式错误时返回错误 */
+lval* lcsv_next(lcsv* c) {
+    for (;;) {
+        /* 跳过空行 */
+        while (c->start < c->end && (c->buf[c->start] == '\n' || c->buf[c->start] == '\r')) { c->start++; }
+        if (c->start == c->end) {
+            if (c->eof) { return NULL; }
+            csv_fill(c);
+            continue;
+        }
+        lval* row;
+        if (csv_parse_record(c, &row)) { return row; }
+        csv_fill(c);
+    }
+}
+
+/* (csv-fold f z "file" [skip])：依次用 f 把每条记录累加到 z 上，跳过前 skip 条记录 (例如表头) */
+lval* builtin_csv_fold(lenv* e, lval* a) {
+    LASSERT(a, a->count == 3 || a->count == 4,
+        "Function 'csv-fold' passed incorrect number of arguments. Got %i, Expected 3 or 4.", a->count);
+    LASSERT_TYPE("csv-fold", a, 0, LVAL_FUN);
+    LASSERT_TYPE("csv-fold", a, 2, LVAL_STR);
+    if (a->count == 4) { LASSERT_TYPE("csv-fold", a, 3, LVAL_NUM); }
+
+    lcsv* c = lcsv_open(a->cell[2]->str);
+    if (!c) {
+        lval* err = lval_err("Function 'csv-fold' could not open file '%s'.", a->cell[2]->str);
+        lval_del(a);
+        return err;
+    }
+    long skip = a->count == 4 ? a->cell[3]->num : 0;
+
+    lval* f = lval_pop(a, 0);
+    lval* acc = lval_pop(a, 0);
+    lval_del(a);
+
+    lval* row;
+    while ((row = lcsv_next(c))) {
+        if (row->type == LVAL_ERR) {
+            lval_del(acc);
+            acc = row;
+            break;
+        }
+        if (c->record <= skip) {
+            lval_del(row);
+            continue;
+        }
+        acc = lval_call(e, lval_copy(f), lval_add(lval_add(lval_sexpr(), acc), row));
+        if (acc->type == LVAL_ERR) { break; }
+    }
+    lcsv_close(c);
+    lval_del(f);
+    return acc;
+}
@@ -0,0 +1,527 @@
+#include "config.h"
+#include "error.h"
+#include <limits.h>
+#include <math.h>
+
+/*
+   json.c
+   原生的 json-parse / json-emit。
+   对象 <-> 字典 (LVAL_DICT)，数组 <-> Q-Expression，整数 <-> Number，带小数点或指数的数和超出 long 范围的整数 <-> Decimal，
+   字符串 <-> String，true/false -> 1/0，null -> 符号 null。
+   解析是单遍的：嵌套用显式栈保存，不递归；数组元素先放进一个共用的动态数组，
+   遇到 ']' 时一次性拷贝成列表，字符串内容用 tok_find_quote (SSE2/AVX2) 成块扫描。
+   输出经过 lbuf (lbuf.c)，写文件时缓冲区满了才调用一次 fwrite。
+*/
+
+/* 对象/数组的最大嵌套深度 */
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH 10000
+#endif
+
+/* --- 解析 --- */
+
+typedef struct {
+  const char* src;
+  const char* p;
+  const char* end;
+  lval* err;
+} json_parser;
+
+typedef struct {
+  lval* obj;    /* 正在构造的对象；数组时为 NULL */
+  char* key;    /* 对象中等待值的键 */
+  int base;     /* 数组元素在共用动态数组中的起点 */
+} json_frame;
+
+static void json_error(json_parser* jp, const char* what) {
+  if (jp->err) { return; }
+  if (jp->p >= jp->end) {
+    jp->err = lval_err("Function 'json-parse' failed: %s (input ends at byte %ld).", what, (long)(jp->end - jp->src));
+  } else {
+    jp->err = lval_err("Function 'json-parse' failed: %s at byte %ld ('%c').",
+      what, (long)(jp->p - jp->src), *jp->p);
+  }
+}
+
+static void json_skip_ws(json_parser* jp) {
+  while (jp->p < jp->end && (*jp->p == ' ' || *jp->p == '\n' || *jp->p == '\r' || *jp->p == '\t')) {
+    jp->p++;
+  }
+}
+
+static int json_hex4(const char* p) {
+  int v = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = p[i];
+    int d = c >= '0' && c <= '9' ? c - '0'
+          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+          : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (d < 0) { return -1; }
+    v = v * 16 + d;
+  }
+  return v;
+}
+
+static char* utf8_put(char* q, unsigned cp) {
+  if (cp < 0x80) {
+    *q++ = cp;
+  } else if (cp < 0x800) {
+    *q++ = 0xC0 | (cp >> 6);
+    *q++ = 0x80 | (cp & 0x3F);
+  } else if (cp < 0x10000) {
+    *q++ = 0xE0 | (cp >> 12);
+    *q++ = 0x80 | ((cp >> 6) & 0x3F);
+    *q++ = 0x80 | (cp & 0x3F);
+  } else {
+    *q++ = 0xF0 | (cp >> 18);
+    *q++ = 0x80 | ((cp >> 12) & 0x3F);
+    *q++ = 0x80 | ((cp >> 6) & 0x3F);
+    *q++ = 0x80 | (cp & 0x3F);
+  }
+  return q;
+}
+
+/* 读一个字符串 (jp->p 指向开头的引号)，返回新分配的内容，出错时返回 NULL */
+static char* json_string(json_parser* jp) {
+  const char* s = jp->p + 1;
+  const char* e = tok_find_quote(s, jp->end);
+
+  /* 没有转义时直接复制 */
+  if (e < jp->end && *e == '"') {
+    char* str = malloc(e - s + 1);
+    memcpy(str, s, e - s);
+    str[e - s] = '\0';
+    jp->p = e + 1;
+    return str;
+  }
+
+  /* 先找到结束的引号，转义后的内容不会比原文长 */
+  while (e < jp->end && *e == '\\') {
+    e = e + 2 < jp->end ? tok_find_quote(e + 2, jp->end) : jp->end;
+  }
+  if (e >= jp->end) {
+    json_error(jp, "unterminated string");
+    return NULL;
+  }
+
+  char* str = malloc(e - s + 1);
+  char* q = str;
+  for (const char* p = s; p < e; ) {
+    if (*p != '\\') {
+      *q++ = *p++;
+      continue;
+    }
+    jp->p = p;
+    switch (p[1]) {
+      case '"': *q++ = '"'; break;
+      case '\\': *q++ = '\\'; break;
+      case '/': *q++ = '/'; break;
+      case 'b': *q++ = '\b'; break;
+      case 'f': *q++ = '\f'; break;
+      case 'n': *q++ = '\n'; break;
+      case 'r': *q++ = '\r'; break;
+      case 't': *q++ = '\t'; break;
+      case 'u': {
+        int cp = e - p >= 6 ? json_hex4(p + 2) : -1;
+        if (cp < 0) { json_error(jp, "invalid \\u escape"); free(str); return NULL; }
+        if (cp == 0) { json_error(jp, "\\u0000 is not supported in strings"); free(str); return NULL; }
+        p += 6;
+        /* 代理对合成一个码点，单独出现的代理项换成 U+FFFD */
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+          int lo = e - p >= 6 && p[0] == '\\' && p[1] == 'u' ? json_hex4(p + 2) : -1;
+          if (lo >= 0xDC00 && lo <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            p += 6;
+          } else {
+            cp = 0xFFFD;
+          }
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+          cp = 0xFFFD;
+        }
+        q = utf8_put(q, cp);
+        continue;
+      }
+      default:
+        json_error(jp, "invalid escape");
+        free(str);
+        return NULL;
+    }
+    p += 2;
+  }
+  *q = '\0';
+  jp->p = e + 1;
+  return str;
+}
+
+/* 对象的键和后面的冒号 */
+static char* json_key(json_parser* jp) {
+  json_skip_ws(jp);
+  if (jp->p >= jp->end || *jp->p != '"') {
+    json_error(jp, "expected a string key");
+    return NULL;
+  }
+  char* key = json_string(jp);
+  if (!key) { return NULL; }
+  json_skip_ws(jp);
+  if (jp->p >= jp->end || *jp->p != ':') {
+    json_error(jp, "expected ':'");
+    free(key);
+    return NULL;
+  }
+  jp->p++;
+  return key;
+}
+
+static int json_digits(json_parser* jp) {
+  const char* start = jp->p;
+  while (jp->p < jp->end && *jp->p >= '0' && *jp->p <= '9') { jp->p++; }
+  return jp->p > start;
+}
+
+/* 字符串、数字和 true/false/null */
+/* 整数字面量 [-]digits 是否在 long 的范围内 (按负数累加，LONG_MIN 也能表示) */
+static int json_fits_long(const char* p, const char* end) {
+  int neg = *p == '-';
+  long x = 0;
+  for (p += neg; p < end; p++) {
+    if (__builtin_mul_overflow(x, 10, &x) || __builtin_sub_overflow(x, *p - '0', &x)) { return 0; }
+  }
+  return neg || x != LONG_MIN;
+}
+
+/* 超出 long 范围的整数不截断，按 Decimal 读入 (与 JavaScript 的 JSON.parse 一样取最接近的 double) */
+static lval* json_big_int(const char* p, const char* end) {
+  long n = end - p;
+  char local[64];
+  char* buf = n < (long)sizeof(local) ? local : malloc(n + 1);
+  memcpy(buf, p, n);
+  buf[n] = '\0';
+  double d = strtod(buf, NULL);
+  if (buf != local) { free(buf); }
+  return lval_dec(d);
+}
+
+static lval* json_scalar(json_parser* jp) {
+  char c = *jp->p;
+
+  if (c == '"') {
+    char* s = json_string(jp);
+    if (!s) { return NULL; }
+    lval* v = lval_alloc();
+    v->type = LVAL_STR;
+    v->str = s;
+    return v;
+  }
+
+  if (c == '-' || (c >= '0' && c <= '9')) {
+    /* 按 JSON 的语法检查后交给解析器的数字转换 (整数 -> Number，小数/指数 -> Decimal) */
+    const char* start = jp->p;
+    int integral = 1;
+    if (*jp->p == '-') { jp->p++; }
+    if (jp->p < jp->end && *jp->p == '0') {
+      jp->p++;
+    } else if (!json_digits(jp)) {
+      json_error(jp, "invalid number");
+      return NULL;
+    }
+    if (jp->p < jp->end && *jp->p == '.') {
+      integral = 0;
+      jp->p++;
+      if (!json_digits(jp)) { json_error(jp, "invalid number"); return NULL; }
+    }
+    if (jp->p < jp->end && (*jp->p == 'e' || *jp->p == 'E')) {
+      integral = 0;
+      jp->p++;
+      if (jp->p < jp->end && (*jp->p == '+' || *jp->p == '-')) { jp->p++; }
+      if (!json_digits(jp)) { json_error(jp, "invalid number"); return NULL; }
+    }
+    if (integral && !json_fits_long(start, jp->p)) {
+      return json_big_int(start, jp->p);
+    }
+    Token tok = { TOK_NUM, (char*)start, (int)(jp->p - start), NULL };
+    return parse_atom(tok);
+  }
+
+  long left = jp->end - jp->p;
+  if (left >= 4 && memcmp(jp->p, "true", 4) == 0) { jp->p += 4; return lval_num(1); }
+  if (left >= 5 && memcmp(jp->p, "false", 5) == 0) { jp->p += 5; return lval_num(0); }
+  if (left >= 4 && memcmp(jp->p, "null", 4) == 0) { jp->p += 4; return lval_sym("null"); }
+
+  json_error(jp, "unexpected character");
+  return NULL;
+}
+
+/* 数组结束：把共用动态数组中属于它的元素一次性交给列表 */
+static lval* json_close_array(lval_vec* items, int base) {
+  int n = items->count - base;
+  lval* q = lval_qexpr();
+  q->cell = malloc(sizeof(lval*) * (n ? n : 1));
+  memcpy(q->cell, items->items + base, sizeof(lval*) * n);
+  q->count = n;
+  items->count = base;
+  return lval_pack(q);
+}
+
+static lval* json_parse(const char* s, long len) {
+  json_parser jp = { s, s, s + len, NULL };
+  lval_vec items = {0};
+  json_frame* frames = NULL;
+  int nframes = 0;
+  int capframes = 0;
+  lval* result = NULL;
+  tokenizer_init();
+
+  while (!result && !jp.err) {
+    /* 1. 读一个值；遇到 '{' / '[' 时入栈，继续读它的第一个元素 */
+    lval* x = NULL;
+    json_skip_ws(&jp);
+    if (jp.p >= jp.end) {
+      json_error(&jp, "unexpected end of input");
+      break;
+    }
+
+    char c = *jp.p;
+    if (c == '{' || c == '[') {
+      if (nframes == JSON_MAX_DEPTH) {
+        json_error(&jp, "nesting too deep");
+        break;
+      }
+      if (nframes == capframes) {
+        capframes = capframes ? capframes * 2 : 16;
+        frames = realloc(frames, sizeof(json_frame) * capframes);
+      }
+      json_frame* f = &frames[nframes++];
+      f->obj = c == '{' ? lval_dict() : NULL;
+      f->key = NULL;
+      f->base = items.count;
+      jp.p++;
+      json_skip_ws(&jp);
+
+      if (jp.p < jp.end && *jp.p == (c == '{' ? '}' : ']')) {
+        jp.p++;
+        x = f->obj ? f->obj : json_close_array(&items, f->base);
+        nframes--;
+      } else {
+        if (f->obj && !(f->key = json_key(&jp))) { break; }
+        continue;
+      }
+    } else {
+      x = json_scalar(&jp);
+      if (!x) { break; }
+    }
+
+    /* 2. 把值放进外层容器；容器结束时它本身又成为外层的一个值 */
+    while (x) {
+      if (nframes == 0) {
+        result = x;
+        break;
+      }
+      json_frame* f = &frames[nframes - 1];
+      if (f->obj) {
+        lval_dict_put(f->obj, f->key, x);
+        f->key = NULL;
+      } else {
+        vec_push(&items, x);
+      }
+      x = NULL;
+
+      json_skip_ws(&jp);
+      if (jp.p >= jp.end) {
+        json_error(&jp, "unexpected end of input");
+        break;
+      }
+      char sep = *jp.p++;
+      if (sep == ',') {
+        if (f->obj) { f->key = json_key(&jp); }
+        break;
+      }
+      if (sep == (f->obj ? '}' : ']')) {
+        x = f->obj ? f->obj : json_close_array(&items, f->base);
+        nframes--;
+        continue;
+      }
+      jp.p--;
+      json_error(&jp, f->obj ? "expected ',' or '}'" : "expected ',' or ']'");
+    }
+  }
+
+  if (result) {
+    json_skip_ws(&jp);
+    if (jp.p < jp.end) { json_error(&jp, "trailing characters after the value"); }
+  }
+
+  /* 出错时释放所有未完成的容器和已经读出的元素 */
+  if (jp.err) {
+    lval_del(result);
+    result = jp.err;
+    for (int i = 0; i < nframes; i++) {
+      lval_del(frames[i].obj);
+      free(frames[i].key);
+    }
+    for (int i = 0; i < items.count; i++) { lval_del(items.items[i]); }
+  }
+  free(frames);
+  vec_free(&items);
+  return result;
+}
+
+/* --- 输出 --- */
+
+/* 与 %g 版式相同的最短表示之外，整数值补上 ".0"，读回时仍是 Decimal。
+   NaN/Inf 在 JSON 里没有对应，写成 null */
+static void jw_double(lbuf* w, double d) {
+  if (!isfinite(d)) {
+    lbuf_put(w, "null", 4);
+    return;
+  }
+  lbuf_double(w, d);
+  /* 刚写出的数字在缓冲区末尾，向前找到它的开头 */
+  long i = w->len;
+  while (i > 0 && ((w->data[i-1] >= '0' && w->data[i-1] <= '9') || w->data[i-1] == '-')) { i--; }
+  if (i == 0 || (w->data[i-1] != '.' && w->data[i-1] != 'e' && w->data[i-1] != '+')) {
+    lbuf_put(w, ".0", 2);
+  }
+}
+
+static void jw_string(lbuf* w, const char* s) {
+  lbuf_putc(w, '"');
+  const char* run = s;
+  for (;; s++) {
+    unsigned char c = *s;
+    if (c >= 0x20 && c != '"' && c != '\\') { continue; }
+    /* 不需要转义的部分整段复制 */
+    lbuf_put(w, run, s - run);
+    if (c == '\0') { break; }
+    char esc[8];
+    switch (c) {
+      case '"': lbuf_put(w, "\\\"", 2); break;
+      case '\\': lbuf_put(w, "\\\\", 2); break;
+      case '\n': lbuf_put(w, "\\n", 2); break;
+      case '\r': lbuf_put(w, "\\r", 2); break;
+      case '\t': lbuf_put(w, "\\t", 2); break;
+      case '\b': lbuf_put(w, "\\b", 2); break;
+      case '\f': lbuf_put(w, "\\f", 2); break;
+      default:
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        lbuf_put(w, esc, 6);
+    }
+    run = s + 1;
+  }
+  lbuf_putc(w, '"');
+}
+
+static void jw_packed(lbuf* w, lval_arr_t* a, long count) {
+  lbuf_putc(w, '[');
+  for (long i = 0; i < count; i++) {
+    if (i) { lbuf_putc(w, ','); }
+    if (a->kind == ARR_I64) {
+      lbuf_long(w, ((long*)a->data)[i]);
+    } else {
+      jw_double(w, ((double*)a->data)[i]);
+    }
+  }
+  lbuf_putc(w, ']');
+}
+
+/* 写出一个值，不能表示成 JSON 时返回错误 */
+static lval* json_emit(lbuf* w, lval* v, int depth) {
+  if (depth > JSON_MAX_DEPTH) {
+    return lval_err("Function 'json-emit' value nesting exceeds the maximum of %d.", JSON_MAX_DEPTH);
+  }
+  switch (v->type) {
+    case LVAL_NUM: lbuf_long(w, v->num); return NULL;
+    case LVAL_DEC: jw_double(w, v->dec); return NULL;
+    case LVAL_STR: jw_string(w, v->str); return NULL;
+    case LVAL_SYM:
+      /* null/true/false 原样写出，其他符号当作字符串 */
+      if (strcmp(v->sym, "null") == 0 || strcmp(v->sym, "true") == 0 || strcmp(v->sym, "false") == 0) {
+        lbuf_put(w, v->sym, strlen(v->sym));
+      } else {
+        jw_string(w, v->sym);
+      }
+      return NULL;
+    case LVAL_ARR:
+      jw_packed(w, v->arr, v->arr->count);
+      return NULL;
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      if (v->arr && v->arr->kind != ARR_LVAL) {
+        jw_packed(w, v->arr, v->count);
+        return NULL;
+      }
+      lbuf_putc(w, '[');
+      for (int i = 0; i < v->count; i++) {
+        if (i) { lbuf_putc(w, ','); }
+        lval* err = json_emit(w, lval_elems(v)[i], depth + 1);
+        if (err) { return err; }
+      }
+      lbuf_putc(w, ']');
+      return NULL;
+    case LVAL_DICT:
+      lbuf_putc(w, '{');
+      for (int i = 0; i < v->dict->count; i++) {
+        if (i) { lbuf_putc(w, ','); }
+        jw_string(w, v->dict->keys[i]);
+        lbuf_putc(w, ':');
+        lval* err = json_emit(w, v->dict->vals[i], depth + 1);
+        if (err) { return err; }
+      }
+      lbuf_putc(w, '}');
+      return NULL;
+  }
+  return lval_err("Function 'json-emit' cannot encode a value of type %s.", ltype_name(v->type));
+}
+
+/* --- 内置函数 --- */
+
+lval* builtin_json_parse(lenv* e, lval* a) {
+  LASSERT_NUM("json-parse", a, 1);
+  int t = a->cell[0]->type;
+  LASSERT(a, t == LVAL_STR || t == LVAL_BYTES || t == LVAL_VIEW,
+    "Function 'json-parse' passed incorrect type for argument 0. Got %s, Expected %s, %s or %s.",
+    ltype_name(t), ltype_name(LVAL_STR), ltype_name(LVAL_BYTES), ltype_name(LVAL_VIEW));
+
+  /* 视图直接在映射的页面上解析 */
+  const char* s;
+  long n;
+  if (!lval_str_bytes(a->cell[0], &s, &n)) {
+    s = (const char*)a->cell[0]->bytes->data;
+    n = a->cell[0]->bytes->len;
+  }
+  lval* x = json_parse(s, n);
+  lval_del(a);
+  return x;
+}
+
+lval* builtin_json_emit(lenv* e, lval* a) {
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function 'json-emit' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
+  if (a->count == 2) {
+    LASSERT_TYPE("json-emit", a, 1, LVAL_FILE);
+    LASSERT(a, a->cell[1]->file_rc->file != NULL, "Cannot write to a closed file!");
+  }
+
+  lbuf w;
+  lbuf_init(&w, a->count == 2 ? a->cell[1]->file_rc->file : NULL);
+  lval* err = json_emit(&w, a->cell[0], 0);
+  if (err) {
+    w.out = NULL;
+    lbuf_free(&w);
+    lval_del(a);
+    return err;
+  }
+
+  /* 写文件：把剩下的部分写出 */
+  if (w.out) {
+    lbuf_free(&w);
+    lval_del(a);
+    return lval_sexpr();
+  }
+
+  /* 返回字符串：缓冲区直接交给 String */
+  lval* s = lval_alloc();
+  s->type = LVAL_STR;
+  s->str = lbuf_take(&w);
+  lval_del(a);
+  return s;
+}
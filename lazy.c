@@ -0,0 +1,381 @@
+#include "config.h"
+#include "error.h"
+#include <limits.h>
+
+/*
+   lazy.c
+   惰性序列 (LVAL_SEQ)。
+   range / iterate / 列表 / CSV 文件 (csv-rows) / 文件句柄的各行 (file-lines) 作为源，lazy-map / lazy-filter / take 在上面追加阶段节点，
+   都只是构造描述，不计算任何元素。
+   into / fold 这类终结操作创建一个迭代器：把节点链展开成一个阶段数组，
+   每次从源拉取一个元素并依次穿过所有阶段 (融合的流水线)，
+   中间不产生任何 Q-Expression，所以内存占用与序列长度无关。
+*/
+
+static lval_seq_t* seq_node(int kind, lval_seq_t* parent) {
+  lval_seq_t* s = malloc(sizeof(lval_seq_t));
+  s->ref_count = 1;
+  s->kind = kind;
+  s->parent = parent;
+  s->fn = NULL;
+  s->val = NULL;
+  s->start = 0;
+  s->end = 0;
+  s->step = 0;
+  return s;
+}
+
+static lval* lval_seq(lval_seq_t* s) {
+  lval* v = lval_alloc();
+  v->type = LVAL_SEQ;
+  v->seq = s;
+  return v;
+}
+
+void lval_seq_release(lval_seq_t* s) {
+  /* 沿着上游链逐个释放，避免长链递归 */
+  while (s) {
+    s->ref_count--;
+    if (s->ref_count > 0) { return; }
+    lval_seq_t* parent = s->parent;
+    lval_del(s->fn);
+    lval_del(s->val);
+    free(s);
+    s = parent;
+  }
+}
+
+/* 取得参数 v 对应的序列节点 (新引用)；Q-Expression 会被包装成列表源 */
+static lval_seq_t* seq_of(lval* v) {
+  if (v->type == LVAL_SEQ) {
+    v->seq->ref_count++;
+    return v->seq;
+  }
+  lval_seq_t* s = seq_node(SEQ_LIST, NULL);
+  s->val = lval_copy(v);
+  return s;
+}
+
+/* --- 迭代器 --- */
+
+typedef struct {
+  lenv* e;
+  lval_seq_t* src;
+  int nstages;
+  lval_seq_t** stages; /* 从上游到下游 */
+  long* taken;         /* 每个 take 阶段已放行的数量 */
+  long pos;            /* range 的当前值 / 列表下标 */
+  lval* cur;           /* iterate 的当前值 */
+  lcsv* csv;           /* csv 源打开的文件，每个迭代器各自从头读 */
+  int done;
+  lval* err;
+} seq_iter;
+
+static void seq_iter_init(seq_iter* it, lenv* e, lval_seq_t* s) {
+  it->e = e;
+  it->nstages = 0;
+  for (lval_seq_t* n = s; n->parent; n = n->parent) { it->nstages++; }
+
+  it->stages = malloc(sizeof(lval_seq_t*) * (it->nstages ? it->nstages : 1));
+  it->taken = calloc(it->nstages ? it->nstages : 1, sizeof(long));
+  int i = it->nstages;
+  lval_seq_t* n = s;
+  for (; n->parent; n = n->parent) { it->stages[--i] = n; }
+
+  it->src = n;
+  it->pos = n->kind == SEQ_RANGE ? n->start : 0;
+  it->cur = NULL;
+  it->csv = NULL;
+  it->done = 0;
+  it->err = NULL;
+
+  if (n->kind == SEQ_CSV) {
+    it->csv = lcsv_open(n->val->str);
+    if (!it->csv) {
+      it->err = lval_err("Function 'csv-rows' could not open file '%s'.", n->val->str);
+      it->done = 1;
+    }
+  }
+}
+
+static void seq_iter_free(seq_iter* it) {
+  free(it->stages);
+  free(it->taken);
+  lval_del(it->cur);
+  if (it->csv) { lcsv_close(it->csv); }
+}
+
+static lval* seq_apply(seq_iter* it, lval* fn, lval* x) {
+  lval* r = lval_call(it->e, lval_copy(fn), lval_add(lval_sexpr(), x));
+  if (r->type == LVAL_ERR) {
+    it->err = r;
+    return NULL;
+  }
+  return r;
+}
+
+/* 从源取下一个元素，NULL 表示源已耗尽或出错 */
+static lval* seq_pull_source(seq_iter* it) {
+  lval_seq_t* s = it->src;
+  switch (s->kind) {
+    case SEQ_RANGE: {
+      if ((s->step > 0 && it->pos >= s->end) || (s->step < 0 && it->pos <= s->end)) { return NULL; }
+      lval* x = lval_num(it->pos);
+      it->pos += s->step;
+      return x;
+    }
+    case SEQ_ITERATE:
+      if (it->cur == NULL) {
+        it->cur = lval_copy(s->val);
+      } else {
+        it->cur = seq_apply(it, s->fn, it->cur);
+        if (!it->cur) { return NULL; }
+      }
+      return lval_copy(it->cur);
+    case SEQ_LIST:
+      if (it->pos >= s->val->count) { return NULL; }
+      it->pos++;
+      return s->val->arr ? lval_packed_nth(s->val, it->pos - 1) : lval_copy(s->val->cell[it->pos - 1]);
+    case SEQ_CSV:
+      for (;;) {
+        lval* row = lcsv_next(it->csv);
+        if (row && row->type == LVAL_ERR) {
+          it->err = row;
+          return NULL;
+        }
+        /* 跳过开头的 start 条记录 (例如表头) */
+        if (row && it->pos < s->start) {
+          it->pos++;
+          lval_del(row);
+          continue;
+        }
+        return row;
+      }
+    case SEQ_LINES: {
+      /* 视图：每行是同一映射上的新视图，pos 是下一行的偏移 */
+      if (s->val->type == LVAL_VIEW) { return lval_view_line(s->val, &it->pos); }
+      /* 文件：从句柄的当前位置读，读过的行不会再出现 */
+      if (!s->val->file_rc->file) {
+        it->err = lval_err("Cannot read from a closed file!");
+        return NULL;
+      }
+      lval* line = lfile_read_line(s->val->file_rc);
+      if (line && line->type == LVAL_ERR) {
+        it->err = line;
+        return NULL;
+      }
+      return line;
+    }
+  }
+  return NULL;
+}
+
+/* 取序列的下一个元素，NULL 表示结束；出错时 it->err 非空 */
+static lval* seq_next(seq_iter* it) {
+  while (!it->done) {
+    /* 任何一个 take 阶段放行数量已满，下游不可能再得到元素，不必再从源拉取 */
+    for (int i = 0; i < it->nstages; i++) {
+      if (it->stages[i]->kind == SEQ_TAKE && it->taken[i] >= it->stages[i]->end) { it->done = 1; }
+    }
+    if (it->done) { break; }
+
+    lval* x = seq_pull_source(it);
+    if (!x) { it->done = 1; break; }
+
+    int i = 0;
+    for (; i < it->nstages && x; i++) {
+      lval_seq_t* st = it->stages[i];
+      if (st->kind == SEQ_MAP) {
+        x = seq_apply(it, st->fn, x);
+      } else if (st->kind == SEQ_FILTER) {
+        lval* keep = seq_apply(it, st->fn, lval_copy(x));
+        if (!keep || !lval_is_true(keep)) { lval_del(x); x = NULL; }
+        lval_del(keep);
+      } else if (st->kind == SEQ_TAKE) {
+        it->taken[i]++;
+      }
+    }
+
+    if (it->err) { it->done = 1; break; }
+    if (x) { return x; }
+  }
+  return NULL;
+}
+
+/* --- 构造序列 --- */
+
+lval* builtin_range(lenv* e, lval* a) {
+  LASSERT(a, a->count <= 3,
+    "Function 'range' passed incorrect number of arguments. Got %i, Expected 0 to 3.", a->count);
+  for (int i = 0; i < a->count; i++) { LASSERT_TYPE("range", a, i, LVAL_NUM); }
+
+  lval_seq_t* s = seq_node(SEQ_RANGE, NULL);
+  s->step = 1;
+  s->end = LONG_MAX; /* 不带参数时是无限序列 0, 1, 2, ... */
+  if (a->count == 1) { s->end = a->cell[0]->num; }
+  if (a->count >= 2) { s->start = a->cell[0]->num; s->end = a->cell[1]->num; }
+  if (a->count == 3) { s->step = a->cell[2]->num; }
+
+  if (s->step == 0) {
+    lval_seq_release(s);
+    lval_del(a);
+    return lval_err("Function 'range' passed a step of 0.");
+  }
+  lval_del(a);
+  return lval_seq(s);
+}
+
+lval* builtin_iterate(lenv* e, lval* a) {
+  LASSERT_NUM("iterate", a, 2);
+  LASSERT_TYPE("iterate", a, 0, LVAL_FUN);
+
+  lval_seq_t* s = seq_node(SEQ_ITERATE, NULL);
+  s->fn = lval_pop(a, 0);
+  s->val = lval_take(a, 0);
+  return lval_seq(s);
+}
+
+/* (csv-rows "file" [skip])：文件的每条记录 (Q-Expression)，终结操作时才打开文件逐条读取 */
+lval* builtin_csv_rows(lenv* e, lval* a) {
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function 'csv-rows' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
+  LASSERT_TYPE("csv-rows", a, 0, LVAL_STR);
+  if (a->count == 2) { LASSERT_TYPE("csv-rows", a, 1, LVAL_NUM); }
+
+  lval_seq_t* s = seq_node(SEQ_CSV, NULL);
+  if (a->count == 2) { s->start = a->cell[1]->num; }
+  s->val = lval_pop(a, 0);
+  lval_del(a);
+  return lval_seq(s);
+}
+
+/* (file-lines file)：文件句柄从当前位置开始的各行 (String)，终结操作时逐行读取；
+   参数是 mmap-open 的视图时，各行是不复制的视图 */
+lval* builtin_file_lines(lenv* e, lval* a) {
+  LASSERT_NUM("file-lines", a, 1);
+  LASSERT(a, a->cell[0]->type == LVAL_FILE || a->cell[0]->type == LVAL_VIEW,
+    "Function 'file-lines' passed incorrect type for argument 0. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[0]->type), ltype_name(LVAL_FILE), ltype_name(LVAL_VIEW));
+
+  lval_seq_t* s = seq_node(SEQ_LINES, NULL);
+  s->val = lval_take(a, 0);
+  return lval_seq(s);
+}
+
+static lval* seq_stage(lval* a, int kind, char* func) {
+  LASSERT_NUM(func, a, 2);
+  LASSERT_TYPE(func, a, 0, LVAL_FUN);
+  LASSERT(a, a->cell[1]->type == LVAL_SEQ || a->cell[1]->type == LVAL_QEXPR,
+    "Function '%s' passed incorrect type for argument 1. Got %s, Expected %s or %s.",
+    func, ltype_name(a->cell[1]->type), ltype_name(LVAL_SEQ), ltype_name(LVAL_QEXPR));
+
+  lval_seq_t* s = seq_node(kind, seq_of(a->cell[1]));
+  s->fn = lval_pop(a, 0);
+  lval_del(a);
+  return lval_seq(s);
+}
+
+lval* builtin_lazy_map(lenv* e, lval* a) {
+  return seq_stage(a, SEQ_MAP, "lazy-map");
+}
+
+lval* builtin_lazy_filter(lenv* e, lval* a) {
+  return seq_stage(a, SEQ_FILTER, "lazy-filter");
+}
+
+lval* builtin_take(lenv* e, lval* a) {
+  LASSERT_NUM("take", a, 2);
+  LASSERT_TYPE("take", a, 0, LVAL_NUM);
+  LASSERT(a, a->cell[1]->type == LVAL_SEQ || a->cell[1]->type == LVAL_QEXPR,
+    "Function 'take' passed incorrect type for argument 1. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[1]->type), ltype_name(LVAL_SEQ), ltype_name(LVAL_QEXPR));
+
+  long n = a->cell[0]->num;
+  LASSERT(a, n >= 0, "Function 'take' passed negative count %li.", n);
+
+  /* 对列表保持原来的语义：直接返回前 n 个元素 */
+  if (a->cell[1]->type == LVAL_QEXPR) {
+    lval* q = lval_take(a, 1);
+    if (n >= q->count) { return q; }
+    if (q->arr) {
+      lval_packed_slice(q, 0, n);
+      return q;
+    }
+    for (long i = n; i < q->count; i++) { lval_del(q->cell[i]); }
+    q->count = n;
+    q->cell = realloc(q->cell, sizeof(lval*) * n);
+    return q;
+  }
+
+  lval_seq_t* s = seq_node(SEQ_TAKE, seq_of(a->cell[1]));
+  s->end = n;
+  lval_del(a);
+  return lval_seq(s);
+}
+
+/* --- 终结操作 --- */
+
+lval* builtin_into(lenv* e, lval* a) {
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function 'into' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
+  if (a->count == 2) { LASSERT_TYPE("into", a, 0, LVAL_QEXPR); }
+  LASSERT(a, a->cell[a->count-1]->type == LVAL_SEQ || a->cell[a->count-1]->type == LVAL_QEXPR,
+    "Function 'into' passed incorrect type for argument %i. Got %s, Expected %s.",
+    a->count-1, ltype_name(a->cell[a->count-1]->type), ltype_name(LVAL_SEQ));
+
+  lval* q = a->count == 2 ? lval_unpack(lval_pop(a, 0)) : lval_qexpr();
+  lval_seq_t* s = seq_of(a->cell[0]);
+  lval_del(a);
+
+  /* 先收集到动态数组里，最后一次性交给列表，避免逐个 realloc */
+  lval_vec items = {0};
+  for (int i = 0; i < q->count; i++) { vec_push(&items, q->cell[i]); }
+
+  seq_iter it;
+  seq_iter_init(&it, e, s);
+  lval* x;
+  while ((x = seq_next(&it))) { vec_push(&items, x); }
+  lval* err = it.err;
+  seq_iter_free(&it);
+  lval_seq_release(s);
+
+  free(q->cell);
+  q->cell = realloc(items.items, sizeof(lval*) * (items.count ? items.count : 1));
+  q->count = items.count;
+
+  if (err) {
+    lval_del(q);
+    return err;
+  }
+  return lval_pack(q);
+}
+
+lval* builtin_fold(lenv* e, lval* a) {
+  LASSERT_NUM("fold", a, 3);
+  LASSERT_TYPE("fold", a, 0, LVAL_FUN);
+  LASSERT(a, a->cell[2]->type == LVAL_SEQ || a->cell[2]->type == LVAL_QEXPR,
+    "Function 'fold' passed incorrect type for argument 2. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[2]->type), ltype_name(LVAL_SEQ), ltype_name(LVAL_QEXPR));
+
+  lval* f = lval_pop(a, 0);
+  lval* acc = lval_pop(a, 0);
+  lval_seq_t* s = seq_of(a->cell[0]);
+  lval_del(a);
+
+  seq_iter it;
+  seq_iter_init(&it, e, s);
+  lval* x;
+  while ((x = seq_next(&it))) {
+    lval* args = lval_add(lval_add(lval_sexpr(), acc), x);
+    acc = lval_call(e, lval_copy(f), args);
+    if (acc->type == LVAL_ERR) { break; }
+  }
+  if (it.err) {
+    lval_del(acc);
+    acc = it.err;
+  }
+  seq_iter_free(&it);
+  lval_seq_release(s);
+  lval_del(f);
+  return acc;
+}
@@ -0,0 +1,346 @@
+#include "config.h"
+#include <math.h>
+
+/*
+   lbuf.c
+   只追加的输出缓冲区。
+   lval 的打印 (print / show / fprint / json-emit) 先把文本写进缓冲区，
+   写满 LBUF_SIZE 或结束时才一次 fwrite 到目标文件，代替逐个字符的 putchar / printf；
+   目标为 NULL 时缓冲区只在内存中增长，用来生成字符串。
+   整数用查表的两位一组转换，小数用 Grisu2 生成能精确读回的最短数字串 (版式与 %g 相同)。
+*/
+
+void lbuf_init(lbuf* b, FILE* out) {
+  b->data = NULL;
+  b->len = 0;
+  b->cap = 0;
+  b->out = out;
+}
+
+void lbuf_flush(lbuf* b) {
+  if (b->out && b->len > 0) {
+    fwrite(b->data, 1, b->len, b->out);
+    b->len = 0;
+  }
+}
+
+/* 写文件时先把已有内容写出；放不下时扩容 */
+void lbuf_reserve(lbuf* b, long n) {
+  if (b->len + n <= b->cap) { return; }
+  lbuf_flush(b);
+  if (b->len + n <= b->cap) { return; }
+  long cap = b->cap ? b->cap : LBUF_SIZE;
+  while (b->len + n > cap) { cap *= 2; }
+  b->data = realloc(b->data, cap);
+  b->cap = cap;
+}
+
+/* 写出剩余内容并释放缓冲区 */
+void lbuf_free(lbuf* b) {
+  lbuf_flush(b);
+  free(b->data);
+  b->data = NULL;
+  b->len = b->cap = 0;
+}
+
+/* 取出内容作为以 '\0' 结尾的字符串 (调用者负责释放)，缓冲区清空 */
+char* lbuf_take(lbuf* b) {
+  lbuf_reserve(b, 1);
+  b->data[b->len] = '\0';
+  char* s = realloc(b->data, b->len + 1);
+  b->data = NULL;
+  b->len = b->cap = 0;
+  return s;
+}
+
+/* 取出内容作为 String 返回，缓冲区清空但保留容量，供下一次使用 (to-string 等反复调用时不必每次重新分配)。
+   只有超过 LBUF_KEEP 的大结果直接把缓冲区交给 String，不复制，也不长期占用大块内存 */
+lval* lbuf_str(lbuf* b) {
+  lval* v = lval_alloc();
+  v->type = LVAL_STR;
+  if (b->cap > LBUF_KEEP) {
+    v->str = lbuf_take(b);
+    return v;
+  }
+  v->str = malloc(b->len + 1);
+  memcpy(v->str, b->data, b->len);
+  v->str[b->len] = '\0';
+  b->len = 0;
+  return v;
+}
+
+void lbuf_put(lbuf* b, const char* s, long n) {
+  if (n == 0) { return; }
+  lbuf_reserve(b, n);
+  memcpy(b->data + b->len, s, n);
+  b->len += n;
+}
+
+void lbuf_putc(lbuf* b, char c) {
+  if (b->len == b->cap) { lbuf_reserve(b, 1); }
+  b->data[b->len++] = c;
+}
+
+void lbuf_puts(lbuf* b, const char* s) {
+  lbuf_put(b, s, strlen(s));
+}
+
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+void lbuf_long(lbuf* b, long x) {
+  char tmp[24];
+  char* q = tmp + sizeof(tmp);
+  unsigned long u = x < 0 ? -(unsigned long)x : (unsigned long)x;
+  while (u >= 100) {
+    const char* d = digit_pairs + (u % 100) * 2;
+    u /= 100;
+    *--q = d[1];
+    *--q = d[0];
+  }
+  if (u >= 10) {
+    *--q = digit_pairs[u * 2 + 1];
+    *--q = digit_pairs[u * 2];
+  } else {
+    *--q = '0' + u;
+  }
+  if (x < 0) { *--q = '-'; }
+  lbuf_put(b, q, tmp + sizeof(tmp) - q);
+}
+
+/* --- 小数的最短表示 (Grisu2) ---
+   在 d 的舍入区间内生成尽量短的十进制数字串，用 64 位整数和一张 10 的幂表完成，
+   不经过 snprintf/strtod。得到的数字总能精确读回 d，绝大多数情况下也是最短的。 */
+
+typedef struct {
+  unsigned long f;
+  int e;
+} diyfp;
+
+/* 10^(-348 + 8i) 的 64 位规格化近似值 */
+static const unsigned long cached_pow_f[87] = {
+  0xfa8fd5a0081c0288UL, 0xbaaee17fa23ebf76UL, 0x8b16fb203055ac76UL,
+  0xcf42894a5dce35eaUL, 0x9a6bb0aa55653b2dUL, 0xe61acf033d1a45dfUL,
+  0xab70fe17c79ac6caUL, 0xff77b1fcbebcdc4fUL, 0xbe5691ef416bd60cUL,
+  0x8dd01fad907ffc3cUL, 0xd3515c2831559a83UL, 0x9d71ac8fada6c9b5UL,
+  0xea9c227723ee8bcbUL, 0xaecc49914078536dUL, 0x823c12795db6ce57UL,
+  0xc21094364dfb5637UL, 0x9096ea6f3848984fUL, 0xd77485cb25823ac7UL,
+  0xa086cfcd97bf97f4UL, 0xef340a98172aace5UL, 0xb23867fb2a35b28eUL,
+  0x84c8d4dfd2c63f3bUL, 0xc5dd44271ad3cdbaUL, 0x936b9fcebb25c996UL,
+  0xdbac6c247d62a584UL, 0xa3ab66580d5fdaf6UL, 0xf3e2f893dec3f126UL,
+  0xb5b5ada8aaff80b8UL, 0x87625f056c7c4a8bUL, 0xc9bcff6034c13053UL,
+  0x964e858c91ba2655UL, 0xdff9772470297ebdUL, 0xa6dfbd9fb8e5b88fUL,
+  0xf8a95fcf88747d94UL, 0xb94470938fa89bcfUL, 0x8a08f0f8bf0f156bUL,
+  0xcdb02555653131b6UL, 0x993fe2c6d07b7facUL, 0xe45c10c42a2b3b06UL,
+  0xaa242499697392d3UL, 0xfd87b5f28300ca0eUL, 0xbce5086492111aebUL,
+  0x8cbccc096f5088ccUL, 0xd1b71758e219652cUL, 0x9c40000000000000UL,
+  0xe8d4a51000000000UL, 0xad78ebc5ac620000UL, 0x813f3978f8940984UL,
+  0xc097ce7bc90715b3UL, 0x8f7e32ce7bea5c70UL, 0xd5d238a4abe98068UL,
+  0x9f4f2726179a2245UL, 0xed63a231d4c4fb27UL, 0xb0de65388cc8ada8UL,
+  0x83c7088e1aab65dbUL, 0xc45d1df942711d9aUL, 0x924d692ca61be758UL,
+  0xda01ee641a708deaUL, 0xa26da3999aef774aUL, 0xf209787bb47d6b85UL,
+  0xb454e4a179dd1877UL, 0x865b86925b9bc5c2UL, 0xc83553c5c8965d3dUL,
+  0x952ab45cfa97a0b3UL, 0xde469fbd99a05fe3UL, 0xa59bc234db398c25UL,
+  0xf6c69a72a3989f5cUL, 0xb7dcbf5354e9beceUL, 0x88fcf317f22241e2UL,
+  0xcc20ce9bd35c78a5UL, 0x98165af37b2153dfUL, 0xe2a0b5dc971f303aUL,
+  0xa8d9d1535ce3b396UL, 0xfb9b7cd9a4a7443cUL, 0xbb764c4ca7a44410UL,
+  0x8bab8eefb6409c1aUL, 0xd01fef10a657842cUL, 0x9b10a4e5e9913129UL,
+  0xe7109bfba19c0c9dUL, 0xac2820d9623bf429UL, 0x80444b5e7aa7cf85UL,
+  0xbf21e44003acdd2dUL, 0x8e679c2f5e44ff8fUL, 0xd433179d9c8cb841UL,
+  0x9e19db92b4e31ba9UL, 0xeb96bf6ebadf77d9UL, 0xaf87023b9bf0ee6bUL,
+};
+static const short cached_pow_e[87] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const unsigned pow10_u32[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+/* 小数部分的舍入要把 wp_w 放大 10^-kappa 倍，最多可以生成 17 位以上的小数 */
+static const unsigned long pow10_u64[] = {
+  1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL,
+  10000000000UL, 100000000000UL, 1000000000000UL, 10000000000000UL, 100000000000000UL,
+  1000000000000000UL, 10000000000000000UL, 100000000000000000UL, 1000000000000000000UL,
+  10000000000000000000UL,
+};
+
+static diyfp diyfp_mul(diyfp x, diyfp y) {
+  unsigned __int128 p = (unsigned __int128)x.f * y.f;
+  unsigned long h = (unsigned long)(p >> 64);
+  if ((unsigned long)p >> 63) { h++; }
+  return (diyfp){ h, x.e + y.e + 64 };
+}
+
+static diyfp diyfp_normalize(diyfp x) {
+  int s = __builtin_clzl(x.f);
+  return (diyfp){ x.f << s, x.e - s };
+}
+
+static void grisu_round(char* buf, int len, unsigned long delta, unsigned long rest,
+                        unsigned long ten_kappa, unsigned long wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+/* d > 0 且有限：数字写入 buf，返回位数，*K 是最后一位的十进制指数 */
+static int grisu2(double d, char* buf, int* K) {
+  unsigned long u;
+  memcpy(&u, &d, sizeof(u));
+  int be = (int)((u >> 52) & 0x7FF);
+  unsigned long frac = u & 0xFFFFFFFFFFFFFUL;
+  diyfp v = be ? (diyfp){ frac | (1UL << 52), be - 1075 } : (diyfp){ frac, -1074 };
+
+  /* 舍入区间的两个边界 */
+  diyfp plus = { (v.f << 1) + 1, v.e - 1 };
+  while (!(plus.f & (1UL << 53))) { plus.f <<= 1; plus.e--; }
+  plus.f <<= 10;
+  plus.e -= 10;
+  diyfp minus = v.f == (1UL << 52) ? (diyfp){ (v.f << 2) - 1, v.e - 2 } : (diyfp){ (v.f << 1) - 1, v.e - 1 };
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  /* 乘以合适的 10^-k，让结果的二进制指数落在 [-60, -32] */
+  double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  if (dk - k > 0.0) { k++; }
+  int index = (k >> 3) + 1;
+  *K = -(-348 + index * 8);
+  diyfp c = { cached_pow_f[index], cached_pow_e[index] };
+
+  diyfp W = diyfp_mul(diyfp_normalize(v), c);
+  diyfp Wp = diyfp_mul(plus, c);
+  diyfp Wm = diyfp_mul(minus, c);
+  Wm.f++;
+  Wp.f--;
+
+  unsigned long delta = Wp.f - Wm.f;
+  unsigned long wp_w = Wp.f - W.f;
+  int shift = -Wp.e;
+  unsigned long one = 1UL << shift;
+  unsigned p1 = (unsigned)(Wp.f >> shift);
+  unsigned long p2 = Wp.f & (one - 1);
+  int len = 0;
+
+  int kappa = 10;
+  while (kappa > 0 && p1 < pow10_u32[kappa - 1]) { kappa--; }
+  while (kappa > 0) {
+    unsigned digit = p1 / pow10_u32[kappa - 1];
+    p1 %= pow10_u32[kappa - 1];
+    if (digit || len) { buf[len++] = '0' + digit; }
+    kappa--;
+    unsigned long rest = ((unsigned long)p1 << shift) + p2;
+    if (rest <= delta) {
+      *K += kappa;
+      grisu_round(buf, len, delta, rest, (unsigned long)pow10_u32[kappa] << shift, wp_w);
+      return len;
+    }
+  }
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    unsigned digit = (unsigned)(p2 >> shift);
+    if (digit || len) { buf[len++] = '0' + digit; }
+    p2 &= one - 1;
+    kappa--;
+    if (p2 < delta) {
+      *K += kappa;
+      grisu_round(buf, len, delta, p2, one, -kappa < 20 ? wp_w * pow10_u64[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+/* 能精确读回的最短表示，版式与 %g 相同：精度取 max(15, 位数)，
+   十进制指数小于 -4 或不小于精度时用指数形式，否则用定点形式，整数值不带小数点 */
+void lbuf_double(lbuf* b, double d) {
+  char tmp[40];
+  if (!isfinite(d) || d == 0) {
+    lbuf_put(b, tmp, snprintf(tmp, sizeof(tmp), "%g", d));
+    return;
+  }
+
+  char digits[24];
+  int K;
+  int len = grisu2(fabs(d), digits, &K);
+  int x = len + K - 1;              /* 第一位数字的十进制指数 */
+  int prec = len > 15 ? len : 15;
+
+  char* q = tmp;
+  if (d < 0) { *q++ = '-'; }
+  if (x < -4 || x >= prec) {
+    *q++ = digits[0];
+    if (len > 1) {
+      *q++ = '.';
+      memcpy(q, digits + 1, len - 1);
+      q += len - 1;
+    }
+    *q++ = 'e';
+    *q++ = x < 0 ? '-' : '+';
+    int ax = x < 0 ? -x : x;
+    if (ax >= 100) { *q++ = '0' + ax / 100; }
+    *q++ = '0' + ax / 10 % 10;
+    *q++ = '0' + ax % 10;
+  } else if (x < 0) {
+    *q++ = '0';
+    *q++ = '.';
+    for (int i = -1; i > x; i--) { *q++ = '0'; }
+    memcpy(q, digits, len);
+    q += len;
+  } else if (len <= x + 1) {
+    memcpy(q, digits, len);
+    q += len;
+    for (int i = len; i <= x; i++) { *q++ = '0'; }
+  } else {
+    memcpy(q, digits, x + 1);
+    q += x + 1;
+    *q++ = '.';
+    memcpy(q, digits + x + 1, len - x - 1);
+    q += len - x - 1;
+  }
+  lbuf_put(b, tmp, q - tmp);
+}
+
+/* 字符串加上引号和转义写出 (与 lval_str_escape 相同的规则)，不需要转义的部分整段复制 */
+void lbuf_escaped(lbuf* b, const char* s) {
+  lbuf_escaped_n(b, s, strlen(s));
+}
+
+/* 同上，长度为 n 的字节串 (不要求以 '\0' 结尾，例如内存映射视图) */
+void lbuf_escaped_n(lbuf* b, const char* s, long n) {
+  lbuf_putc(b, '"');
+  const char* end = s + n;
+  const char* run = s;
+  for (; s < end; s++) {
+    char e;
+    switch (*s) {
+      case '\a': e = 'a'; break;
+      case '\b': e = 'b'; break;
+      case '\f': e = 'f'; break;
+      case '\n': e = 'n'; break;
+      case '\r': e = 'r'; break;
+      case '\t': e = 't'; break;
+      case '\v': e = 'v'; break;
+      case '\\': e = '\\'; break;
+      case '"': e = '"'; break;
+      default: continue;
+    }
+    lbuf_put(b, run, s - run);
+    char esc[2] = { '\\', e };
+    lbuf_put(b, esc, 2);
+    run = s + 1;
+  }
+  lbuf_put(b, run, end - run);
+  lbuf_putc(b, '"');
+}
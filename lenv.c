@@ -55,7 +55,7 @@ void lenv_put(lenv* e, lval* k, lval* v) {
     /* And replace with variable supplied by user */
     if (strcmp(e->syms[i], k->sym) == 0) {
       lval_del(e->vals[i]);
-      e->vals[i] = lval_copy(v);
+      e->vals[i] = lval_share(lval_copy(v));
       return;
     }
   }
@@ -65,7 +65,7 @@ void lenv_put(lenv* e, lval* k, lval* v) {
   e->syms = realloc(e->syms, sizeof(char*) * e->count);
 
   /* Copy contents of lval and symbol string into new location */
-  e->vals[e->count-1] = lval_copy(v);
+  e->vals[e->count-1] = lval_share(lval_copy(v));
   e->syms[e->count-1] = malloc(strlen(k->sym)+1);
   strcpy(e->syms[e->count-1], k->sym);
 }
@@ -90,6 +90,11 @@ void lenv_add_builtins(lenv* e) {
   lenv_add_builtin(e, "cons", builtin_cons);
   lenv_add_builtin(e, "len", builtin_len);
   lenv_add_builtin(e, "init", builtin_init);
+  lenv_add_builtin(e, "nth", builtin_nth);
+  lenv_add_builtin(e, "set-nth", builtin_set_nth);
+  lenv_add_builtin(e, "slice", builtin_slice);
+  lenv_add_builtin(e, "sort", builtin_sort);
+  lenv_add_builtin(e, "sort-by", builtin_sort_by);
   lenv_add_builtin(e, "def", builtin_def);
   lenv_add_builtin(e, "=",   builtin_put);
 
@@ -133,15 +138,106 @@ void lenv_add_builtins(lenv* e) {
   lenv_add_builtin(e, "print", builtin_print);
   lenv_add_builtin(e, "read", builtin_read);
   lenv_add_builtin(e, "show", builtin_show);
+  lenv_add_builtin(e, "to-string", builtin_to_string);
+  lenv_add_builtin(e, "show-str", builtin_show_str);
 
   /* File Functions */
   lenv_add_builtin(e, "fopen", builtin_fopen);
   lenv_add_builtin(e, "fclose", builtin_fclose);
   lenv_add_builtin(e, "fread", builtin_fread);
   lenv_add_builtin(e, "fwrite", builtin_fwrite);
+  lenv_add_builtin(e, "fprint", builtin_fprint);
+  lenv_add_builtin(e, "fwrite-all", builtin_fwrite_all);
+  lenv_add_builtin(e, "flush", builtin_flush);
+  lenv_add_builtin(e, "fread-line", builtin_fread_line);
+  lenv_add_builtin(e, "fread-bytes", builtin_fread_bytes);
+  lenv_add_builtin(e, "fread-many", builtin_fread_many);
+  lenv_add_builtin(e, "file-lines", builtin_file_lines);
+  lenv_add_builtin(e, "file-fold-lines", builtin_file_fold_lines);
+  lenv_add_builtin(e, "mmap-open", builtin_mmap_open);
+  lenv_add_builtin(e, "substring", builtin_substring);
+  lenv_add_builtin(e, "string-find", builtin_string_find);
   lenv_add_builtin(e, "fseek", builtin_fseek);
   lenv_add_builtin(e, "ftell", builtin_ftell);
   lenv_add_builtin(e, "rewind", builtin_rewind);
+  lenv_add_builtin(e, "csv-rows", builtin_csv_rows);
+  lenv_add_builtin(e, "csv-fold", builtin_csv_fold);
+
+  /* Packed Array Functions */
+  lenv_add_builtin(e, "arr-i64", builtin_arr_i64);
+  lenv_add_builtin(e, "arr-f64", builtin_arr_f64);
+  lenv_add_builtin(e, "arr->list", builtin_arr_to_list);
+  lenv_add_builtin(e, "arr+", builtin_arr_add);
+  lenv_add_builtin(e, "arr-", builtin_arr_sub);
+  lenv_add_builtin(e, "arr*", builtin_arr_mul);
+  lenv_add_builtin(e, "arr/", builtin_arr_div);
+  lenv_add_builtin(e, "dot", builtin_arr_dot);
+  lenv_add_builtin(e, "arr-sum", builtin_arr_sum);
+  lenv_add_builtin(e, "arr-min", builtin_arr_min);
+  lenv_add_builtin(e, "arr-max", builtin_arr_max);
+  lenv_add_builtin(e, "scale", builtin_arr_scale);
+  lenv_add_builtin(e, "cumsum", builtin_arr_cumsum);
+
+  /* Lazy Sequence Functions */
+  lenv_add_builtin(e, "range", builtin_range);
+  lenv_add_builtin(e, "iterate", builtin_iterate);
+  lenv_add_builtin(e, "lazy-map", builtin_lazy_map);
+  lenv_add_builtin(e, "lazy-filter", builtin_lazy_filter);
+  lenv_add_builtin(e, "take", builtin_take);
+  lenv_add_builtin(e, "into", builtin_into);
+  lenv_add_builtin(e, "fold", builtin_fold);
+
+  /* Dictionary Functions */
+  lenv_add_builtin(e, "dict", builtin_dict);
+  lenv_add_builtin(e, "dict-get", builtin_dict_get);
+  lenv_add_builtin(e, "dict-set", builtin_dict_set);
+  lenv_add_builtin(e, "dict-has", builtin_dict_has);
+  lenv_add_builtin(e, "dict-keys", builtin_dict_keys);
+  lenv_add_builtin(e, "dict-vals", builtin_dict_vals);
+
+  /* JSON Functions */
+  lenv_add_builtin(e, "json-parse", builtin_json_parse);
+  lenv_add_builtin(e, "json-emit", builtin_json_emit);
+
+  /* Serialization Functions */
+  lenv_add_builtin(e, "serialize", builtin_serialize);
+  lenv_add_builtin(e, "deserialize", builtin_deserialize);
+
+  /* Binary Data Functions */
+  lenv_add_builtin(e, "bytes-ref", builtin_bytes_ref);
+  lenv_add_builtin(e, "bytes-unpack", builtin_bytes_unpack);
+  lenv_add_builtin(e, "u8", builtin_u8);
+  lenv_add_builtin(e, "i8", builtin_i8);
+  lenv_add_builtin(e, "u16-le", builtin_u16_le);
+  lenv_add_builtin(e, "u16-be", builtin_u16_be);
+  lenv_add_builtin(e, "i16-le", builtin_i16_le);
+  lenv_add_builtin(e, "i16-be", builtin_i16_be);
+  lenv_add_builtin(e, "u32-le", builtin_u32_le);
+  lenv_add_builtin(e, "u32-be", builtin_u32_be);
+  lenv_add_builtin(e, "i32-le", builtin_i32_le);
+  lenv_add_builtin(e, "i32-be", builtin_i32_be);
+  lenv_add_builtin(e, "u64-le", builtin_u64_le);
+  lenv_add_builtin(e, "u64-be", builtin_u64_be);
+  lenv_add_builtin(e, "f32-le", builtin_f32_le);
+  lenv_add_builtin(e, "f32-be", builtin_f32_be);
+  lenv_add_builtin(e, "f64-le", builtin_f64_le);
+  lenv_add_builtin(e, "f64-be", builtin_f64_be);
+
+  /* Event Loop Functions */
+  lenv_add_builtin(e, "on-readable", builtin_on_readable);
+  lenv_add_builtin(e, "on-writable", builtin_on_writable);
+  lenv_add_builtin(e, "unwatch", builtin_unwatch);
+  lenv_add_builtin(e, "after", builtin_after);
+  lenv_add_builtin(e, "every", builtin_every);
+  lenv_add_builtin(e, "cancel", builtin_cancel);
+  lenv_add_builtin(e, "run-loop", builtin_run_loop);
+  lenv_add_builtin(e, "stop-loop", builtin_stop_loop);
+  lenv_add_builtin(e, "fread-nb", builtin_fread_nb);
+  lenv_add_builtin(e, "fwrite-nb", builtin_fwrite_nb);
+  lenv_add_builtin(e, "pipe", builtin_pipe);
+  lenv_add_builtin(e, "socketpair", builtin_socketpair);
+  lenv_add_builtin(e, "serve", builtin_serve);
+  lenv_add_builtin(e, "connect", builtin_connect);
 }
 
 void lenv_def(lenv* e, lval* k, lval* v) {
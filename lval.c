@@ -1,5 +1,6 @@
 #include "config.h"
 #include "pool.h"
+#include <assert.h>
 
 /* Linux/Mac 专用头文件 */
 #include <editline/readline.h>
@@ -34,12 +35,13 @@ char* lval_str_escape(char* s) {
 
 /* 在 lval.c 中添加 */
 
-char* lval_str_unescape(char* s) {
-  char* buffer = malloc(strlen(s) + 1);
-  char* p = buffer;
-  
-  while (*s) {
-    if (*s == '\\') {
+/* 把 [s, s+n) 反转义写入 dst，返回写入的长度 (不含结尾的 '\0') */
+static int str_unescape_into(char* dst, char* s, int n) {
+  char* p = dst;
+  char* end = s + n;
+
+  while (s < end) {
+    if (*s == '\\' && s + 1 < end) {
       s++;
       switch (*s) {
         case 'a': *p++ = '\a'; break;
@@ -59,8 +61,14 @@ char* lval_str_unescape(char* s) {
     s++;
   }
   *p = '\0';
-  
-  buffer = realloc(buffer, strlen(buffer) + 1);
+  return p - dst;
+}
+
+char* lval_str_unescape(char* s) {
+  int n = strlen(s);
+  char* buffer = malloc(n + 1);
+  int len = str_unescape_into(buffer, s, n);
+  buffer = realloc(buffer, len + 1);
   return buffer;
 }
 
@@ -68,12 +76,18 @@ char* ltype_name(int t) {
   switch(t) {
     case LVAL_FUN: return "Function";
     case LVAL_NUM: return "Number";
+    case LVAL_DEC: return "Decimal";
     case LVAL_ERR: return "Error";
     case LVAL_SYM: return "Symbol";
     case LVAL_SEXPR: return "S-Expression";
     case LVAL_QEXPR: return "Q-Expression";
     case LVAL_STR: return "String";
     case LVAL_FILE: return "File";
+    case LVAL_ARR: return "Array";
+    case LVAL_SEQ: return "Sequence";
+    case LVAL_BYTES: return "Bytes";
+    case LVAL_DICT: return "Dictionary";
+    case LVAL_VIEW: return "View";
     default: return "Unknown";
   }
 }
@@ -127,15 +141,40 @@ lval* lval_sym(char* s) {
   return v;
 }
 
+/* 直接从源码片段构造，解析器用它们避免先复制出一个临时字符串 */
+lval* lval_sym_n(char* s, int n) {
+  lval* v = lval_alloc();
+  v->type = LVAL_SYM;
+  v->sym = malloc(n + 1);
+  memcpy(v->sym, s, n);
+  v->sym[n] = '\0';
+  return v;
+}
+
+/* 字符串字面量的内容 (不含引号)，反转义直接写入最终的缓冲区 */
+lval* lval_str_n(char* s, int n) {
+  lval* v = lval_alloc();
+  v->type = LVAL_STR;
+  v->str = malloc(n + 1);
+  str_unescape_into(v->str, s, n);
+  return v;
+}
+
 lval* lval_sexpr(void) {
   lval* v = lval_alloc();
   v->type = LVAL_SEXPR;
   v->count = 0;
   v->cell = NULL;
+  v->arr = NULL;
   return v;
 }
 
 lval* lval_add(lval* v, lval* x) {
+  /* 紧凑存储的列表：同类数字直接追加，否则退回通用表示 */
+  if (v->arr) {
+    if (lval_packed_insert(v, x, 0)) { return v; }
+    lval_unpack(v);
+  }
   v->count++;
   v->cell = realloc(v->cell, sizeof(lval*) * v->count);
   v->cell[v->count-1] = x;
@@ -143,6 +182,10 @@ lval* lval_add(lval* v, lval* x) {
 }
 
 lval* lval_offer(lval* v, lval* x) {
+  if (v->arr) {
+    if (lval_packed_insert(v, x, 1)) { return v; }
+    lval_unpack(v);
+  }
   v->count++;
   v->cell = realloc(v->cell, sizeof(lval*) * v->count);
   memmove(&v->cell[1], &v->cell[0], sizeof(lval*) * (v->count-1));
@@ -166,6 +209,7 @@ lval* lval_copy(lval* v) {
       }
       break;
     case LVAL_NUM: x->num = v->num; break;
+    case LVAL_DEC: x->dec = v->dec; break;
 
     /* Copy Strings using malloc and strcpy */
     case LVAL_ERR:
@@ -178,6 +222,14 @@ lval* lval_copy(lval* v) {
     case LVAL_QEXPR:
     case LVAL_SEXPR:
       x->count = v->count;
+      /* 紧凑存储只增加引用计数 */
+      if (v->arr) {
+        x->arr = v->arr;
+        x->arr->ref_count++;
+        x->cell = NULL;
+        break;
+      }
+      x->arr = NULL;
       x->cell = malloc(sizeof(lval*) * x->count);
       for (int i = 0; i < x->count; i++) {
         x->cell[i] = lval_copy(v->cell[i]);
@@ -189,6 +241,34 @@ lval* lval_copy(lval* v) {
         x->file_rc = v->file_rc;
         x->file_rc->ref_count++;
         break;
+
+    /* 数组存储只读共享，复制时只增加引用计数 */
+    case LVAL_ARR:
+        x->arr = v->arr;
+        x->arr->ref_count++;
+        break;
+
+    /* 序列是不可变的描述，复制时共享节点 */
+    case LVAL_SEQ:
+        x->seq = v->seq;
+        x->seq->ref_count++;
+        break;
+
+    case LVAL_BYTES:
+        x->bytes = v->bytes;
+        x->bytes->ref_count++;
+        break;
+
+    case LVAL_DICT:
+        x->dict = v->dict;
+        x->dict->ref_count++;
+        break;
+
+    /* 视图不可变，复制时共享 */
+    case LVAL_VIEW:
+        x->view = v->view;
+        x->view->ref_count++;
+        break;
   }
   
   return x;
@@ -205,6 +285,7 @@ void lval_del(lval* v) {
     switch (curr->type) {
       case LVAL_SEXPR:
       case LVAL_QEXPR:
+        if (curr->arr) { break; }
         for (int j = 0;j < curr->count;j++) {
           vec_push(&stack, curr->cell[j]);
         }
@@ -218,6 +299,7 @@ void lval_del(lval* v) {
           if (e) {
             for (int j = 0;j < e->count;j++) {
               vec_push(&stack, e->vals[j]);
+              free(e->syms[j]);
             }
             free(e->syms);
             free(e->vals);
@@ -226,6 +308,16 @@ void lval_del(lval* v) {
           }
         }
         break;
+      case LVAL_DICT:
+        /* 共享的字典只去掉一个引用，最后一个引用才删除值 */
+        if (!lval_dict_release(curr->dict)) {
+          curr->dict = NULL;
+          break;
+        }
+        for (int j = 0;j < curr->dict->count;j++) {
+          vec_push(&stack, curr->dict->vals[j]);
+        }
+        break;
     }
   }
   for (int i = stack.count - 1;i >= 0;i--) {
@@ -237,15 +329,33 @@ void lval_del(lval* v) {
       case LVAL_STR : free(curr->str); break;
       case LVAL_SEXPR:
       case LVAL_QEXPR:
+        if (curr->arr) { lval_arr_release(curr->arr); }
         free(curr->cell); break;
       case LVAL_FILE:
         curr->file_rc->ref_count--;
         if (curr->file_rc->ref_count == 0) {
-          fclose(curr->file_rc->file);
+          if (curr->file_rc->file) { fclose(curr->file_rc->file); }
+          free(curr->file_rc->buf);
+          free(curr->file_rc->line);
           free(curr->file_rc->mode);
           free(curr->file_rc);
         }
         break;
+      case LVAL_ARR:
+        lval_arr_release(curr->arr);
+        break;
+      case LVAL_SEQ:
+        lval_seq_release(curr->seq);
+        break;
+      case LVAL_BYTES:
+        lval_bytes_release(curr->bytes);
+        break;
+      case LVAL_DICT:
+        if (curr->dict) { lval_dict_free(curr->dict); }
+        break;
+      case LVAL_VIEW:
+        lval_view_release(curr->view);
+        break;
     }
     lval_release(curr);
   }
@@ -265,6 +375,7 @@ lval* lval_qexpr(void) {
   v->type = LVAL_QEXPR;
   v->count = 0;
   v->cell = NULL;
+  v->arr = NULL;
   return v;
 }
 
@@ -307,26 +418,107 @@ lval* lval_read(mpc_ast_t* t) {
 // v: 要打印的列表 (S-Expression)
 // open: 开头的字符 (比如 '(' )
 // close: 结尾的字符 (比如 ')' )
-void lval_expr_print(lval* v, char open, char close) {
-  
-  putchar(open); // 1. 先打印开头的括号
+void lval_expr_write(lbuf* b, lval* v, char open, char close) {
+
+  if (v->arr) { lval_packed_write(b, v, open, close); return; }
+
+  lbuf_putc(b, open); // 1. 先打印开头的括号
   
   for(int i = 0; i < v->count; i++) { // 2. 遍历列表里的每一个子元素
     
     /* Print Value contained within */
-    lval_print(v->cell[i]); // 3. 递归调用打印函数，打印子元素
-                            // (比如列表里有个数字 5，就去打印 5)
+    lval_write(b, v->cell[i]); // 3. 递归调用打印函数，打印子元素
+                               // (比如列表里有个数字 5，就去打印 5)
 
     /* Don't print trailing space if last element */
     if(i != (v->count - 1)) { // 4. 如果不是最后一个元素，就在后面加个空格
-      putchar(' ');           // 这样输出就是 (1 2 3) 而不是 (1 2 3 )
+      lbuf_putc(b, ' ');      // 这样输出就是 (1 2 3) 而不是 (1 2 3 )
     }
   }
   
-  putchar(close); // 5. 最后打印结尾的括号
+  lbuf_putc(b, close); // 5. 最后打印结尾的括号
 }
 
-lval* lval_eval(lenv* e, lval* v) {
+/* 把已求值的实参 v 绑定到自定义函数 f 的形参上 (f 和 v 都被消耗)。
+   参数齐全时返回 NULL，并通过 body/next_e 给出接下来要求值的函数体和环境；
+   否则返回错误或部分应用的函数。 */
+static lval* lval_bind(lenv* e, lval* f, lval* v, lval** body, lenv** next_e) {
+  lval_unpack(f->formals);
+  int given = v->count;
+  int total = f->formals->count;
+  while (v->count) {
+    if (f->formals->count == 0) {
+      lval_del(f);
+      lval_del(v);
+      return lval_err("Function passed too many arguments. Got %i, Expected %i.", given, total);
+    }
+
+    lval* sym = lval_pop(f->formals, 0);
+
+    if(strcmp(sym->sym, "&") == 0) {
+      if (f->formals->count != 1) {
+        lval_del(sym);
+        lval_del(v);
+        lval_del(f);
+        return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
+      }
+
+      /* builtin_list 原地把 v 变成 Q-Expression，lenv_put 存的是副本，v 在循环后释放 */
+      lval* nsym = lval_pop(f->formals, 0);
+      lenv_put(f->env, nsym, builtin_list(e, v));
+      lval_del(sym);
+      lval_del(nsym);
+      break;
+    }
+    lval* val = lval_pop(v, 0);
+    lenv_put(f->env, sym, val);
+    lval_del(sym);
+    lval_del(val);
+  }
+  lval_del(v);
+
+  /* 如果形参列表空了，说明参数都齐了，可以执行函数体了！ */
+  if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0) {
+    if (f->formals->count != 2) {
+      lval_del(f);
+      return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
+    }
+    lval_del(lval_pop(f->formals, 0));
+    lval* sym = lval_pop(f->formals, 0);
+    lval* val = lval_qexpr();
+    lenv_put(f->env, sym, val);
+    lval_del(sym);
+    lval_del(val);
+  }
+
+  if (f->formals->count > 0) { return f; }
+
+  /* TCO: Path Compression for Environment to prevent stack overflow in lenv_get */
+  if (e->par) {
+    f->env->par = e->par;
+  } else {
+    f->env->par = e;
+  }
+
+  *body = lval_copy(f->body);
+  (*body)->type = LVAL_SEXPR;
+  *next_e = f->env;
+
+  f->env = NULL;
+  lval_del(f);
+  return NULL;
+}
+
+/* 函数环境的生命周期：调用自定义函数时，lval_bind 把函数的环境交出来作为函数体的求值环境，
+   这个环境只属于这一次调用。lval_bind 做了路径压缩，函数环境的父环境总是全局环境 (没有父环境的根环境)：
+   它不会成为别的环境的父环境，函数值复制时复制的是自己的环境，所以调用结束后没有任何东西指向它。
+   尾调用切换到的函数环境由 *owned 持有，切换到下一个函数体或求值结束时释放；
+   不释放的话每调用一次 lambda 都会泄漏一个环境和绑定在里面的参数。 */
+static void lenv_check_call(lenv* e) {
+  assert(e->par && !e->par->par);
+}
+
+static lval* lval_eval_loop(lenv* e, lval* v, lenv** owned) {
 
   while(1) {
     if (v->type == LVAL_SYM) {
@@ -338,6 +530,7 @@ lval* lval_eval(lenv* e, lval* v) {
       return x;
     }
     if (v->type == LVAL_SEXPR) {
+      lval_unpack(v);
       /* Evaluate Children (Recursive, not tail call) */
       /* 这里必须递归，因为参数本身可能是复杂的表达式 */
       for (int i = 0;i < v->count;i++) {
@@ -409,126 +602,107 @@ lval* lval_eval(lenv* e, lval* v) {
         return result;
       }
 
-      /* 如果是自定义函数 */
-      /* 参数绑定到env中 */
-
-      int given = v->count;
-      int total = f->formals->count;
-      while (v->count) {
-        if (f->formals->count == 0) {
-          lval_del(f);
-          lval_del(v);
-          return lval_err("Function passed too many arguments. Got %i, Expected %i.", given, total);
-        }
-
-        lval* sym = lval_pop(f->formals, 0);
-
-        if(strcmp(sym->sym, "&") == 0) {
-          if (f->formals->count != 1) {
-            lval_del(v);
-            lval_del(f);
-            return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
-          }
-
-          lval* nsym = lval_pop(f->formals, 0);
-          lenv_put(f->env, nsym, builtin_list(e, v));
-          builtin_list(e, v);
-          lval_del(nsym);
-          lval_del(nsym);
-          break;
-        }
-        lval* val = lval_pop(v, 0);
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
-        lval_del(val);
-      }
-      lval_del(v);
-
-      /* 如果形参列表空了，说明参数都齐了，可以执行函数体了！ */
-      if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0) {
-        if (f->formals->count != 2) {
-          lval_del(f);
-          return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
-        }
-        lval_del(lval_pop(f->formals, 0));
-        lval* sym = lval_pop(f->formals, 0);
-        lval* val = lval_qexpr();
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
-        lval_del(val);
-      }
-
-      if (f->formals->count == 0) {
-          
-          /* TCO: Path Compression for Environment to prevent stack overflow in lenv_get */
-          if (e->par) {
-            f->env->par = e->par;
-          } else {
-            f->env->par = e;
-          }
-          
-          lval* body = lval_copy(f->body);
-          body->type = LVAL_SEXPR;
-          
-          lenv* next_e = f->env;
-          
-          f->env = NULL; 
-          lval_del(f);
-          
-          v = body;
-          e = next_e;
-          continue; 
-          
-      } else {
-        return f;
-      }
+      /* 如果是自定义函数，绑定参数后在新环境中继续求值函数体 (TCO) */
+      lval* body;
+      lenv* next_e;
+      lval* r = lval_bind(e, f, v, &body, &next_e);
+      if (r) { return r; }
+      lenv_check_call(next_e);
+      if (*owned) { lenv_del(*owned); }
+      *owned = next_e;
+      v = body;
+      e = next_e;
+      continue;
     }
     return v;
   }
 }
 
-void lval_print(lval* v) {
+lval* lval_eval(lenv* e, lval* v) {
+  lenv* owned = NULL;
+  lval* r = lval_eval_loop(e, v, &owned);
+  if (owned) { lenv_del(owned); }
+  return r;
+}
+
+/* 用已经求值好的参数 a 调用函数 f (f 和 a 都被消耗)，参数不会再被求值一次。
+   供需要从 C 代码回调 Lispy 函数的内置函数使用 (如 sort 的比较函数)。 */
+lval* lval_call(lenv* e, lval* f, lval* a) {
+  if (f->builtin) {
+    lval* r = f->builtin(e, a);
+    lval_del(f);
+    return r;
+  }
+
+  lval* body;
+  lenv* next_e;
+  lval* r = lval_bind(e, f, a, &body, &next_e);
+  if (r) { return r; }
+  lenv_check_call(next_e);
+  r = lval_eval(next_e, body);
+  lenv_del(next_e);
+  return r;
+}
+
+/* 把 v 的文本追加到缓冲区 b；print/show/fprint 和 lval_print 都通过它输出 */
+void lval_write(lbuf* b, lval* v) {
   switch (v->type) {
-    case LVAL_NUM : printf("%li", v->num); break;
-    case LVAL_DEC : printf("%g", v->dec); break;
-    case LVAL_ERR: printf("Error: %s", v->err); break;
-    case LVAL_SYM: printf("%s", v->sym); break;
-    case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
-    case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
+    case LVAL_NUM : lbuf_long(b, v->num); break;
+    case LVAL_DEC : lbuf_double(b, v->dec); break;
+    case LVAL_ERR: lbuf_puts(b, "Error: "); lbuf_puts(b, v->err); break;
+    case LVAL_SYM: lbuf_puts(b, v->sym); break;
+    case LVAL_SEXPR: lval_expr_write(b, v, '(', ')'); break;
+    case LVAL_QEXPR: lval_expr_write(b, v, '{', '}'); break;
     case LVAL_FUN:
         if (v->builtin) {
-            printf("<builtin>");
+            lbuf_puts(b, "<builtin>");
         } else {
-            printf("(\\ "); lval_print(v->formals);
-            putchar(' '); lval_print(v->body); putchar(')');
+            lbuf_puts(b, "(\\ "); lval_write(b, v->formals);
+            lbuf_putc(b, ' '); lval_write(b, v->body); lbuf_putc(b, ')');
         }  
       break;
-    case LVAL_STR: lval_print_str(v);break;
-    case LVAL_FILE: printf("<file %p>", v->file_rc->file); break;
+    case LVAL_STR: lbuf_escaped(b, v->str); break;
+    case LVAL_FILE: {
+      char tmp[32];
+      lbuf_put(b, tmp, snprintf(tmp, sizeof(tmp), "<file %p>", (void*)v->file_rc->file));
+      break;
+    }
+    case LVAL_ARR: lval_arr_write(b, v); break;
+    case LVAL_SEQ: lbuf_puts(b, "<seq>"); break;
+    case LVAL_BYTES:
+      lbuf_puts(b, "<bytes "); lbuf_long(b, v->bytes->len); lbuf_putc(b, '>');
+      break;
+    case LVAL_DICT: lval_dict_write(b, v); break;
+    case LVAL_VIEW: lbuf_escaped_n(b, v->view->map->data + v->view->off, v->view->len); break;
     break;
   }
 }
 
+void lval_print(lval* v) {
+  lbuf b;
+  lbuf_init(&b, stdout);
+  lval_write(&b, v);
+  lbuf_free(&b);
+}
+
+/* 字符串带引号和转义打印，直接写进输出缓冲区，不再复制两次 */
 void lval_print_str(lval* v) {
-  /* Make a Copy of the string */
-  char* escaped = malloc(strlen(v->str)+1);
-  strcpy(escaped, v->str);
-  /* Pass it through the escape function */
-  //escaped = mpcf_escape(escaped);
-  char* new_escaped = lval_str_escape(escaped);
-  free(escaped);
-  /* Print it between " characters */
-  printf("\"%s\"", new_escaped);
-  /* free the copied string */
-  free(new_escaped);
+  lbuf b;
+  lbuf_init(&b, stdout);
+  lbuf_escaped(&b, v->str);
+  lbuf_free(&b);
 }
 
 void lval_println(lval* v) {
-  lval_print(v);
-  printf("\n"); 
+  lbuf b;
+  lbuf_init(&b, stdout);
+  lval_write(&b, v);
+  lbuf_putc(&b, '\n');
+  lbuf_free(&b);
 }
 
 lval* lval_pop(lval* v, int i) {
+  lval_unpack(v);
   /* Find the item at "i" */
   lval* x = v->cell[i];
 
@@ -551,11 +725,18 @@ lval* lval_take(lval* v, int i) {
 }
 
 lval* lval_join(lval* x, lval* y) {
-  while(y->count) {
-    x = lval_add(x, lval_pop(y, 0));
-  }
+  /* 任一边是紧凑存储且另一边元素同类时，结果保持紧凑存储 */
+  if ((x->arr || y->arr) && lval_packed_join(x, y)) { return x; }
+  lval_unpack(x);
+  lval_unpack(y);
+
+  /* 一次性扩容并整体拷贝指针，避免逐个 pop 的 O(n^2) 移动 */
+  x->cell = realloc(x->cell, sizeof(lval*) * (x->count + y->count));
+  memcpy(&x->cell[x->count], y->cell, sizeof(lval*) * y->count);
+  x->count += y->count;
+  y->count = 0;
   lval_del(y);
-  return x;
+  return lval_pack(x);
 }
 
 #if 0
@@ -611,107 +792,14 @@ lval* lval_lambda(lval* formals, lval* body) {
     return v;
 }
 
-#if 0
-lval* lval_call(lenv* e, lval* f, lval* a) {
-    /* If Builtin then simply call that */
-    if (f->builtin) { return f->builtin(e, a); }
-
-    /* Record Argument Counts */
-    int given = a->count;
-    int total = f->formals->count;
-
-    /* While arguments still remain to be processed */
-    while (a->count) {
-
-        /* If we've ran out of formal arguments to bind */
-        if (f->formals->count == 0) {
-            lval_del(a);
-            return lval_err("Function passed too many arguments. "
-                            "Got %i, Expected %i.", given, total);
-        }
-
-        /* Pop the first symbol from the formals */
-        lval* sym = lval_pop(f->formals, 0);
-
-        /* Special Case to deal with '&' */
-        if (strcmp(sym->sym, "&") == 0) {
-
-            // 新增检查：如果没有实参了，报错！
-            if (a->count == 0) {
-                lval_del(a);
-                return lval_err("Function passed too few arguments. "
-                                "Expected at least one argument for '&'.");
-            }
-            /* Ensure '&' is not passed invalidly */
-            if (f->formals->count != 1) {
-                lval_del(a);
-                return lval_err("Function format invalid. "
-                                "Symbol '&' not followed by single symbol.");
-            }
-
-            /* Next formal should be bound to remaining arguments */
-            lval* nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym);
-            lval_del(nsym);
-            break;
-        }
-
-        /* Pop the next argument from the list */
-        lval* val = lval_pop(a, 0);
-
-        /* Bind a copy into the function's environment */
-        lenv_put(f->env, sym, lval_copy(val));
-
-        /* Delete symbol and value */
-        lval_del(sym);
-        lval_del(val);
-    }
-
-    /* Argument list is now bound so can be cleaned up */
-    lval_del(a);
-
-    /* If '&' remains in formal list bind to empty list */
-    if (f->formals->count > 0 &&
-        strcmp(f->formals->cell[0]->sym, "&") == 0) {
-
-        /* Check to ensure that & is not passed invalidly */
-        if (f->formals->count != 2) {
-            return lval_err("Function format invalid. "
-                            "Symbol '&' not followed by single symbol.");
-        }
-
-        /* Pop and delete '&' symbol */
-        lval_del(lval_pop(f->formals, 0));
-
-        /* Pop next symbol and create empty list */
-        lval* sym = lval_pop(f->formals, 0);
-        lval* val = lval_qexpr();
-
-        /* Bind to environment and delete */
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
-        lval_del(val);
-    }
-
-    /* If all formals have been bound evaluate */
-    if (f->formals->count == 0) {
-
-        /* Set environment parent to evaluation environment */
-        f->env->par = e;
-
-        /* Evaluate and return */
-        return builtin_eval(f->env,
-                            lval_add(lval_sexpr(), lval_copy(f->body)));
-    } else {
-        /* Otherwise return partially evaluated function */
-        return lval_copy(f);
-    }
-}
-#endif
-
-
 int lval_eq(lval* x, lval* y) {
+  /* View 和 String 按内容比较 */
+  if (x->type == LVAL_VIEW || y->type == LVAL_VIEW) {
+    const char *s, *t;
+    long n, m;
+    return lval_str_bytes(x, &s, &n) && lval_str_bytes(y, &t, &m) && n == m && memcmp(s, t, n) == 0;
+  }
+
   /* Different Types are always unequal */
   if (x->type != y->type) { return 0;}
 
@@ -719,6 +807,7 @@ int lval_eq(lval* x, lval* y) {
   switch (x->type) {
     /* Compare Number Value */
     case LVAL_NUM: return x->num == y->num;
+    case LVAL_DEC: return x->dec == y->dec;
 
     /* Compare String Values */
     case LVAL_ERR : return (strcmp(x->err, y->err) == 0);
@@ -736,6 +825,7 @@ int lval_eq(lval* x, lval* y) {
     /* If list compare every individual element */
     case LVAL_SEXPR:
     case LVAL_QEXPR:
+      if (x->arr || y->arr) { return lval_packed_eq(x, y); }
       if (x->count != y->count) { return 0;}
       for (int i = 0;i < x->count; i++) {
         /* If any element not equal then whole list not equal */
@@ -744,6 +834,11 @@ int lval_eq(lval* x, lval* y) {
       /* Otherwise lists must be equal */
       return 1;
     case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+    case LVAL_ARR: return lval_arr_eq(x, y);
+    case LVAL_SEQ: return x->seq == y->seq;
+    case LVAL_BYTES:
+      return x->bytes->len == y->bytes->len && memcmp(x->bytes->data, y->bytes->data, x->bytes->len) == 0;
+    case LVAL_DICT: return lval_dict_eq(x, y);
     break;
   }
   return 0;
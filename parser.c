@@ -2,15 +2,191 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
+
+/*
+   词法分析的热点是跳过空白、注释和字符串内容。
+   这些扫描按 16 (SSE2) / 32 (AVX2) 字节一块做比较，得到位掩码后用 ctz 直接定位下一个
+   "有意义"的字节 (非空白 / 引号或反斜杠)；注释交给 memchr 找换行。
+   其余的单字节判断走 256 项的字符分类表，不再调用 isspace / isalnum / strchr。
+   运行时检测到 AVX2 时切换到 256 位版本，其他平台使用标量实现。
+*/
+
+#if defined(__x86_64__) && defined(__LP64__)
+#define TOK_X86 1
+#include <immintrin.h>
+#endif
+
+enum { CC_SPACE = 1, CC_SYM = 2, CC_DIGIT = 4 };
+
+static const unsigned char char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0,  /* 0x00 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x10 */
+    1, 2, 0, 0, 2, 2, 2, 0, 0, 0, 2, 2, 0, 2, 0, 2,  /* 0x20 */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 2, 0, 2, 2, 2, 2,  /* 0x30 */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  /* 0x40 */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 2, 0, 2, 2,  /* 0x50 */
+    0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  /* 0x60 */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 2, 0,  /* 0x70 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x80 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x90 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xa0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xb0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xc0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xd0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xe0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xf0 */
+};
+
+#define CLASS(c) char_class[(unsigned char)(c)]
+
+/* --- 扫描内核：返回 [p, end) 中第一个满足条件的位置，找不到时返回 end --- */
+
+static const char* skip_space_scalar(const char* p, const char* end) {
+    while (p < end && (CLASS(*p) & CC_SPACE)) p++;
+    return p;
+}
+
+static const char* find_quote_scalar(const char* p, const char* end) {
+    while (p < end && *p != '"' && *p != '\\') p++;
+    return p;
+}
+
+static inline int is_structural(char c) {
+    return c == '(' || c == ')' || c == '{' || c == '}' || c == '"' || c == ';';
+}
+
+static const char* find_structural_scalar(const char* p, const char* end) {
+    while (p < end && !is_structural(*p)) p++;
+    return p;
+}
+
+#ifdef TOK_X86
+
+/* 空白字符为 ' ' 和 '\t'..'\r'：(c - 9) 按无符号比较 <= 4 */
+static inline int space_mask_sse2(__m128i x) {
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(9));
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(4)), d);
+    __m128i sp = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+    return _mm_movemask_epi8(_mm_or_si128(ctl, sp));
+}
+
+static const char* skip_space_sse2(const char* p, const char* end) {
+    for (; p + 16 <= end; p += 16) {
+        int m = ~space_mask_sse2(_mm_loadu_si128((const __m128i*)p)) & 0xFFFF;
+        if (m) return p + __builtin_ctz(m);
+    }
+    return skip_space_scalar(p, end);
+}
+
+static const char* find_quote_sse2(const char* p, const char* end) {
+    const __m128i q = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\');
+    for (; p + 16 <= end; p += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, q), _mm_cmpeq_epi8(x, bs)));
+        if (m) return p + __builtin_ctz(m);
+    }
+    return find_quote_scalar(p, end);
+}
+
+static const char* find_structural_sse2(const char* p, const char* end) {
+    for (; p + 16 <= end; p += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('(')), _mm_cmpeq_epi8(x, _mm_set1_epi8(')'))),
+            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('{')), _mm_cmpeq_epi8(x, _mm_set1_epi8('}'))));
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_set1_epi8(';'))));
+        int bits = _mm_movemask_epi8(m);
+        if (bits) return p + __builtin_ctz(bits);
+    }
+    return find_structural_scalar(p, end);
+}
+
+#define TOK_AVX2 __attribute__((target("avx2")))
+
+TOK_AVX2 static const char* skip_space_avx2(const char* p, const char* end) {
+    const __m256i nine = _mm256_set1_epi8(9), four = _mm256_set1_epi8(4), sp = _mm256_set1_epi8(' ');
+    for (; p + 32 <= end; p += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        __m256i d = _mm256_sub_epi8(x, nine);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(d, four), d), _mm256_cmpeq_epi8(x, sp));
+        unsigned m = ~(unsigned)_mm256_movemask_epi8(ws);
+        if (m) return p + __builtin_ctz(m);
+    }
+    return skip_space_sse2(p, end);
+}
+
+TOK_AVX2 static const char* find_quote_avx2(const char* p, const char* end) {
+    const __m256i q = _mm256_set1_epi8('"'), bs = _mm256_set1_epi8('\\');
+    for (; p + 32 <= end; p += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        unsigned m = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, q), _mm256_cmpeq_epi8(x, bs)));
+        if (m) return p + __builtin_ctz(m);
+    }
+    return find_quote_sse2(p, end);
+}
+
+TOK_AVX2 static const char* find_structural_avx2(const char* p, const char* end) {
+    for (; p + 32 <= end; p += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('(')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(')'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('}'))));
+        m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(';'))));
+        unsigned bits = _mm256_movemask_epi8(m);
+        if (bits) return p + __builtin_ctz(bits);
+    }
+    return find_structural_sse2(p, end);
+}
+
+#endif
+
+/* --- 运行时分派表 --- */
+
+static struct {
+    int ready;
+    const char* (*skip_space)(const char* p, const char* end);
+    const char* (*find_quote)(const char* p, const char* end);
+    const char* (*find_structural)(const char* p, const char* end);
+} S;
+
+void tokenizer_init(void) {
+    if (S.ready) return;
+    S.skip_space = skip_space_scalar;
+    S.find_quote = find_quote_scalar;
+    S.find_structural = find_structural_scalar;
+#ifdef TOK_X86
+    S.skip_space = skip_space_sse2;
+    S.find_quote = find_quote_sse2;
+    S.find_structural = find_structural_sse2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        S.skip_space = skip_space_avx2;
+        S.find_quote = find_quote_avx2;
+        S.find_structural = find_structural_avx2;
+    }
+#endif
+    S.ready = 1;
+}
 
 Tokenizer tokenizer_new(char* src) {
     Tokenizer t;
     t.src = src;
     t.pos = 0;
     t.len = strlen(src);
+    tokenizer_init();
     return t;
 }
 
+/* 供流式读取器划分顶层表达式边界使用：下一个括号、引号或分号 / 下一个引号或反斜杠 */
+const char* tok_find_structural(const char* p, const char* end) {
+    return S.find_structural(p, end);
+}
+
+const char* tok_find_quote(const char* p, const char* end) {
+    return S.find_quote(p, end);
+}
+
 /* 查看当前字符 */
 char peek(Tokenizer* t) {
     if (t->pos >= t->len) return '\0';
@@ -24,67 +200,118 @@ char advance(Tokenizer* t) {
 }
 
 int is_sym_char(char c) {
-    if (c == '\0') return 0;
-    return isalnum(c) || strchr("!$%&*/:<=>?@^_~+-\\", c);
+    return (CLASS(c) & CC_SYM) != 0;
+}
+
+/* 跳过空白和注释。空白通常只有一两个字节，先用标量判断，遇到成段的缩进再进入向量扫描 */
+static const char* skip_trivia(const char* p, const char* end) {
+    for (;;) {
+        if (p < end && (CLASS(*p) & CC_SPACE)) {
+            p++;
+            if (p < end && (CLASS(*p) & CC_SPACE)) p = S.skip_space(p, end);
+        }
+        if (p >= end || *p != ';') return p;
+        const char* nl = memchr(p, '\n', end - p);
+        p = nl ? nl : end;
+    }
+}
+
+#define IS_DIGIT(c) (CLASS(c) & CC_DIGIT)
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* 数字字面量: [-] 0x十六进制 | 0b二进制 | 十进制 [. 小数] [e [+-] 指数]，返回结束位置 */
+static const char* scan_number(const char* p, const char* end) {
+    if (*p == '-') p++;
+    if (p + 2 < end && p[0] == '0') {
+        if ((p[1] == 'x' || p[1] == 'X') && hex_value(p[2]) >= 0) {
+            p += 2;
+            while (p < end && hex_value(*p) >= 0) p++;
+            return p;
+        }
+        if ((p[1] == 'b' || p[1] == 'B') && (p[2] == '0' || p[2] == '1')) {
+            p += 2;
+            while (p < end && (*p == '0' || *p == '1')) p++;
+            return p;
+        }
+    }
+    while (p < end && IS_DIGIT(*p)) p++;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && IS_DIGIT(*p)) p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        if (q < end && (*q == '+' || *q == '-')) q++;
+        if (q < end && IS_DIGIT(*q)) {
+            p = q;
+            while (p < end && IS_DIGIT(*p)) p++;
+        }
+    }
+    return p;
 }
 
 Token next_token(Tokenizer* t) {
     Token tok;
     tok.error = NULL;
-    while (isspace(peek(t))) advance(t);
-    if (peek(t) == ';') {
-        while (peek(t) != '\n' && peek(t) != '\0') advance(t);
-        return next_token(t);
-    }
-    tok.start = &t->src[t->pos];
-    if (t->pos >= t->len) {
+
+    const char* end = t->src + t->len;
+    const char* p = skip_trivia(t->src + t->pos, end);
+    tok.start = (char*)p;
+
+    if (p >= end) {
+        t->pos = t->len;
         tok.type = TOK_EOF;//改为结束符是为什么?
         tok.length = 0;
         return tok;
     }
-    char c = advance(t);
+
+    char c = *p++;
     switch(c) {
-        case '(' : tok.type = TOK_LPAREN; tok.length = 1; return tok;
-        case ')' : tok.type = TOK_RPAREN; tok.length = 1; return tok;
-        case '{' : tok.type = TOK_LBRACE; tok.length = 1; return tok;
-        case '}' : tok.type = TOK_RBRACE; tok.length = 1; return tok;
-    }
-
-    if (c == '"') {
-        tok.type = TOK_STR;
-        while (peek(t) != '"' && peek(t) != '\0') {
-            /* 处理转义字符 \" (简单处理，暂不支持复杂转义) */
-            if (peek(t) == '\\') advance(t);
-            advance(t);
-        }
-        if (peek(t) == '"') {
-            advance(t);
-            tok.length = &t->src[t->pos] - tok.start;
-            return tok;
-        } else {
-            tok.type = TOK_ERR;
-            tok.error = "Unterminated string literal";
-            return tok;
-        }
-    }
+        case '(' : tok.type = TOK_LPAREN; break;
+        case ')' : tok.type = TOK_RPAREN; break;
+        case '{' : tok.type = TOK_LBRACE; break;
+        case '}' : tok.type = TOK_RBRACE; break;
 
-    if (isdigit(c)) {
-        tok.type = TOK_NUM;
-        while (isdigit(peek(t)) || peek(t) == '.') advance(t);
-        tok.length = &t->src[t->pos] - tok.start;
-        return tok;
-    } 
+        case '"':
+            tok.type = TOK_STR;
+            /* 每次跳到下一个引号或反斜杠，反斜杠连同被转义的字符一起跳过 */
+            for (;;) {
+                p = S.find_quote(p, end);
+                if (p >= end || *p == '"') break;
+                p += 2;
+            }
+            if (p >= end) {
+                t->pos = t->len;
+                tok.type = TOK_ERR;
+                tok.error = "Unterminated string literal";
+                tok.length = t->len - (tok.start - t->src);
+                return tok;
+            }
+            p++;
+            break;
 
-    if (is_sym_char(c)) {
-        tok.type = TOK_SYM;
-        while (is_sym_char(peek(t))) advance(t);
-        tok.length = &t->src[t->pos] - tok.start;
-        return tok;
+        default:
+            /* 负号紧跟数字时是负数字面量，否则 '-' 仍然是符号 */
+            if ((CLASS(c) & CC_DIGIT) || (c == '-' && p < end && (CLASS(*p) & CC_DIGIT))) {
+                tok.type = TOK_NUM;
+                p = scan_number(p - 1, end);
+            } else if (CLASS(c) & CC_SYM) {
+                tok.type = TOK_SYM;
+                while (p < end && (CLASS(*p) & CC_SYM)) p++;
+            } else {
+                tok.type = TOK_ERR;
+                tok.error = "Unexpected character";
+            }
     }
 
-    tok.type = TOK_ERR;
-    tok.error = "Unexpected character";
-    tok.length = 1;
+    tok.length = p - tok.start;
+    t->pos = p - t->src;
     return tok;
 }
 
@@ -96,103 +323,994 @@ lval* parse_qexpr(Tokenizer* t) {
     return parse_expr_list(t, TOK_RBRACE);
 }
 
+/*
+   数字字面量直接在源码上解析。
+   整数 (十进制 / 0x / 0b) 溢出时与 strtol 一样截断到 LONG_MAX / LONG_MIN。
+   小数先把有效数字收集成 64 位整数 m 和十进制指数 e，
+   当 m <= 2^53 且 10^|e| 能精确表示为 double 时，m * 10^e 或 m / 10^e 只有一次舍入，
+   结果与 strtod 相同 (Clinger 快速路径)；其余情况用 Eisel-Lemire 算法：m 乘以 10^e 的 128 位近似，
+   从乘积的高位直接得到正确舍入的结果。近似误差可能影响舍入时算法会放弃，这时才退回 strtod。
+   有效数字超过 19 位时 m 是截断的，m 和 m + 1 得到同一个 double 才采用。
+*/
+
+static const double pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MANTISSA_MAX (1ULL << 53)
+
+/* 10^e 的 128 位尾数 (高 64 位，低 64 位)，最高位为 1，向下截断。e 从 POW10_128_MIN 到 POW10_128_MAX，
+   范围之外的 19 位以内的有效数字一定下溢为 0 或上溢为无穷，交给 strtod */
+#define POW10_128_MIN (-342)
+#define POW10_128_MAX 308
+
+static const unsigned long long pow10_128[][2] = {
+    {0xeef453d6923bd65aULL, 0x113faa2906a13b3fULL},  /* 1e-342 */
+    {0x9558b4661b6565f8ULL, 0x4ac7ca59a424c507ULL},  /* 1e-341 */
+    {0xbaaee17fa23ebf76ULL, 0x5d79bcf00d2df649ULL},  /* 1e-340 */
+    {0xe95a99df8ace6f53ULL, 0xf4d82c2c107973dcULL},  /* 1e-339 */
+    {0x91d8a02bb6c10594ULL, 0x79071b9b8a4be869ULL},  /* 1e-338 */
+    {0xb64ec836a47146f9ULL, 0x9748e2826cdee284ULL},  /* 1e-337 */
+    {0xe3e27a444d8d98b7ULL, 0xfd1b1b2308169b25ULL},  /* 1e-336 */
+    {0x8e6d8c6ab0787f72ULL, 0xfe30f0f5e50e20f7ULL},  /* 1e-335 */
+    {0xb208ef855c969f4fULL, 0xbdbd2d335e51a935ULL},  /* 1e-334 */
+    {0xde8b2b66b3bc4723ULL, 0xad2c788035e61382ULL},  /* 1e-333 */
+    {0x8b16fb203055ac76ULL, 0x4c3bcb5021afcc31ULL},  /* 1e-332 */
+    {0xaddcb9e83c6b1793ULL, 0xdf4abe242a1bbf3dULL},  /* 1e-331 */
+    {0xd953e8624b85dd78ULL, 0xd71d6dad34a2af0dULL},  /* 1e-330 */
+    {0x87d4713d6f33aa6bULL, 0x8672648c40e5ad68ULL},  /* 1e-329 */
+    {0xa9c98d8ccb009506ULL, 0x680efdaf511f18c2ULL},  /* 1e-328 */
+    {0xd43bf0effdc0ba48ULL, 0x0212bd1b2566def2ULL},  /* 1e-327 */
+    {0x84a57695fe98746dULL, 0x014bb630f7604b57ULL},  /* 1e-326 */
+    {0xa5ced43b7e3e9188ULL, 0x419ea3bd35385e2dULL},  /* 1e-325 */
+    {0xcf42894a5dce35eaULL, 0x52064cac828675b9ULL},  /* 1e-324 */
+    {0x818995ce7aa0e1b2ULL, 0x7343efebd1940993ULL},  /* 1e-323 */
+    {0xa1ebfb4219491a1fULL, 0x1014ebe6c5f90bf8ULL},  /* 1e-322 */
+    {0xca66fa129f9b60a6ULL, 0xd41a26e077774ef6ULL},  /* 1e-321 */
+    {0xfd00b897478238d0ULL, 0x8920b098955522b4ULL},  /* 1e-320 */
+    {0x9e20735e8cb16382ULL, 0x55b46e5f5d5535b0ULL},  /* 1e-319 */
+    {0xc5a890362fddbc62ULL, 0xeb2189f734aa831dULL},  /* 1e-318 */
+    {0xf712b443bbd52b7bULL, 0xa5e9ec7501d523e4ULL},  /* 1e-317 */
+    {0x9a6bb0aa55653b2dULL, 0x47b233c92125366eULL},  /* 1e-316 */
+    {0xc1069cd4eabe89f8ULL, 0x999ec0bb696e840aULL},  /* 1e-315 */
+    {0xf148440a256e2c76ULL, 0xc00670ea43ca250dULL},  /* 1e-314 */
+    {0x96cd2a865764dbcaULL, 0x380406926a5e5728ULL},  /* 1e-313 */
+    {0xbc807527ed3e12bcULL, 0xc605083704f5ecf2ULL},  /* 1e-312 */
+    {0xeba09271e88d976bULL, 0xf7864a44c633682eULL},  /* 1e-311 */
+    {0x93445b8731587ea3ULL, 0x7ab3ee6afbe0211dULL},  /* 1e-310 */
+    {0xb8157268fdae9e4cULL, 0x5960ea05bad82964ULL},  /* 1e-309 */
+    {0xe61acf033d1a45dfULL, 0x6fb92487298e33bdULL},  /* 1e-308 */
+    {0x8fd0c16206306babULL, 0xa5d3b6d479f8e056ULL},  /* 1e-307 */
+    {0xb3c4f1ba87bc8696ULL, 0x8f48a4899877186cULL},  /* 1e-306 */
+    {0xe0b62e2929aba83cULL, 0x331acdabfe94de87ULL},  /* 1e-305 */
+    {0x8c71dcd9ba0b4925ULL, 0x9ff0c08b7f1d0b14ULL},  /* 1e-304 */
+    {0xaf8e5410288e1b6fULL, 0x07ecf0ae5ee44dd9ULL},  /* 1e-303 */
+    {0xdb71e91432b1a24aULL, 0xc9e82cd9f69d6150ULL},  /* 1e-302 */
+    {0x892731ac9faf056eULL, 0xbe311c083a225cd2ULL},  /* 1e-301 */
+    {0xab70fe17c79ac6caULL, 0x6dbd630a48aaf406ULL},  /* 1e-300 */
+    {0xd64d3d9db981787dULL, 0x092cbbccdad5b108ULL},  /* 1e-299 */
+    {0x85f0468293f0eb4eULL, 0x25bbf56008c58ea5ULL},  /* 1e-298 */
+    {0xa76c582338ed2621ULL, 0xaf2af2b80af6f24eULL},  /* 1e-297 */
+    {0xd1476e2c07286faaULL, 0x1af5af660db4aee1ULL},  /* 1e-296 */
+    {0x82cca4db847945caULL, 0x50d98d9fc890ed4dULL},  /* 1e-295 */
+    {0xa37fce126597973cULL, 0xe50ff107bab528a0ULL},  /* 1e-294 */
+    {0xcc5fc196fefd7d0cULL, 0x1e53ed49a96272c8ULL},  /* 1e-293 */
+    {0xff77b1fcbebcdc4fULL, 0x25e8e89c13bb0f7aULL},  /* 1e-292 */
+    {0x9faacf3df73609b1ULL, 0x77b191618c54e9acULL},  /* 1e-291 */
+    {0xc795830d75038c1dULL, 0xd59df5b9ef6a2417ULL},  /* 1e-290 */
+    {0xf97ae3d0d2446f25ULL, 0x4b0573286b44ad1dULL},  /* 1e-289 */
+    {0x9becce62836ac577ULL, 0x4ee367f9430aec32ULL},  /* 1e-288 */
+    {0xc2e801fb244576d5ULL, 0x229c41f793cda73fULL},  /* 1e-287 */
+    {0xf3a20279ed56d48aULL, 0x6b43527578c1110fULL},  /* 1e-286 */
+    {0x9845418c345644d6ULL, 0x830a13896b78aaa9ULL},  /* 1e-285 */
+    {0xbe5691ef416bd60cULL, 0x23cc986bc656d553ULL},  /* 1e-284 */
+    {0xedec366b11c6cb8fULL, 0x2cbfbe86b7ec8aa8ULL},  /* 1e-283 */
+    {0x94b3a202eb1c3f39ULL, 0x7bf7d71432f3d6a9ULL},  /* 1e-282 */
+    {0xb9e08a83a5e34f07ULL, 0xdaf5ccd93fb0cc53ULL},  /* 1e-281 */
+    {0xe858ad248f5c22c9ULL, 0xd1b3400f8f9cff68ULL},  /* 1e-280 */
+    {0x91376c36d99995beULL, 0x23100809b9c21fa1ULL},  /* 1e-279 */
+    {0xb58547448ffffb2dULL, 0xabd40a0c2832a78aULL},  /* 1e-278 */
+    {0xe2e69915b3fff9f9ULL, 0x16c90c8f323f516cULL},  /* 1e-277 */
+    {0x8dd01fad907ffc3bULL, 0xae3da7d97f6792e3ULL},  /* 1e-276 */
+    {0xb1442798f49ffb4aULL, 0x99cd11cfdf41779cULL},  /* 1e-275 */
+    {0xdd95317f31c7fa1dULL, 0x40405643d711d583ULL},  /* 1e-274 */
+    {0x8a7d3eef7f1cfc52ULL, 0x482835ea666b2572ULL},  /* 1e-273 */
+    {0xad1c8eab5ee43b66ULL, 0xda3243650005eecfULL},  /* 1e-272 */
+    {0xd863b256369d4a40ULL, 0x90bed43e40076a82ULL},  /* 1e-271 */
+    {0x873e4f75e2224e68ULL, 0x5a7744a6e804a291ULL},  /* 1e-270 */
+    {0xa90de3535aaae202ULL, 0x711515d0a205cb36ULL},  /* 1e-269 */
+    {0xd3515c2831559a83ULL, 0x0d5a5b44ca873e03ULL},  /* 1e-268 */
+    {0x8412d9991ed58091ULL, 0xe858790afe9486c2ULL},  /* 1e-267 */
+    {0xa5178fff668ae0b6ULL, 0x626e974dbe39a872ULL},  /* 1e-266 */
+    {0xce5d73ff402d98e3ULL, 0xfb0a3d212dc8128fULL},  /* 1e-265 */
+    {0x80fa687f881c7f8eULL, 0x7ce66634bc9d0b99ULL},  /* 1e-264 */
+    {0xa139029f6a239f72ULL, 0x1c1fffc1ebc44e80ULL},  /* 1e-263 */
+    {0xc987434744ac874eULL, 0xa327ffb266b56220ULL},  /* 1e-262 */
+    {0xfbe9141915d7a922ULL, 0x4bf1ff9f0062baa8ULL},  /* 1e-261 */
+    {0x9d71ac8fada6c9b5ULL, 0x6f773fc3603db4a9ULL},  /* 1e-260 */
+    {0xc4ce17b399107c22ULL, 0xcb550fb4384d21d3ULL},  /* 1e-259 */
+    {0xf6019da07f549b2bULL, 0x7e2a53a146606a48ULL},  /* 1e-258 */
+    {0x99c102844f94e0fbULL, 0x2eda7444cbfc426dULL},  /* 1e-257 */
+    {0xc0314325637a1939ULL, 0xfa911155fefb5308ULL},  /* 1e-256 */
+    {0xf03d93eebc589f88ULL, 0x793555ab7eba27caULL},  /* 1e-255 */
+    {0x96267c7535b763b5ULL, 0x4bc1558b2f3458deULL},  /* 1e-254 */
+    {0xbbb01b9283253ca2ULL, 0x9eb1aaedfb016f16ULL},  /* 1e-253 */
+    {0xea9c227723ee8bcbULL, 0x465e15a979c1cadcULL},  /* 1e-252 */
+    {0x92a1958a7675175fULL, 0x0bfacd89ec191ec9ULL},  /* 1e-251 */
+    {0xb749faed14125d36ULL, 0xcef980ec671f667bULL},  /* 1e-250 */
+    {0xe51c79a85916f484ULL, 0x82b7e12780e7401aULL},  /* 1e-249 */
+    {0x8f31cc0937ae58d2ULL, 0xd1b2ecb8b0908810ULL},  /* 1e-248 */
+    {0xb2fe3f0b8599ef07ULL, 0x861fa7e6dcb4aa15ULL},  /* 1e-247 */
+    {0xdfbdcece67006ac9ULL, 0x67a791e093e1d49aULL},  /* 1e-246 */
+    {0x8bd6a141006042bdULL, 0xe0c8bb2c5c6d24e0ULL},  /* 1e-245 */
+    {0xaecc49914078536dULL, 0x58fae9f773886e18ULL},  /* 1e-244 */
+    {0xda7f5bf590966848ULL, 0xaf39a475506a899eULL},  /* 1e-243 */
+    {0x888f99797a5e012dULL, 0x6d8406c952429603ULL},  /* 1e-242 */
+    {0xaab37fd7d8f58178ULL, 0xc8e5087ba6d33b83ULL},  /* 1e-241 */
+    {0xd5605fcdcf32e1d6ULL, 0xfb1e4a9a90880a64ULL},  /* 1e-240 */
+    {0x855c3be0a17fcd26ULL, 0x5cf2eea09a55067fULL},  /* 1e-239 */
+    {0xa6b34ad8c9dfc06fULL, 0xf42faa48c0ea481eULL},  /* 1e-238 */
+    {0xd0601d8efc57b08bULL, 0xf13b94daf124da26ULL},  /* 1e-237 */
+    {0x823c12795db6ce57ULL, 0x76c53d08d6b70858ULL},  /* 1e-236 */
+    {0xa2cb1717b52481edULL, 0x54768c4b0c64ca6eULL},  /* 1e-235 */
+    {0xcb7ddcdda26da268ULL, 0xa9942f5dcf7dfd09ULL},  /* 1e-234 */
+    {0xfe5d54150b090b02ULL, 0xd3f93b35435d7c4cULL},  /* 1e-233 */
+    {0x9efa548d26e5a6e1ULL, 0xc47bc5014a1a6dafULL},  /* 1e-232 */
+    {0xc6b8e9b0709f109aULL, 0x359ab6419ca1091bULL},  /* 1e-231 */
+    {0xf867241c8cc6d4c0ULL, 0xc30163d203c94b62ULL},  /* 1e-230 */
+    {0x9b407691d7fc44f8ULL, 0x79e0de63425dcf1dULL},  /* 1e-229 */
+    {0xc21094364dfb5636ULL, 0x985915fc12f542e4ULL},  /* 1e-228 */
+    {0xf294b943e17a2bc4ULL, 0x3e6f5b7b17b2939dULL},  /* 1e-227 */
+    {0x979cf3ca6cec5b5aULL, 0xa705992ceecf9c42ULL},  /* 1e-226 */
+    {0xbd8430bd08277231ULL, 0x50c6ff782a838353ULL},  /* 1e-225 */
+    {0xece53cec4a314ebdULL, 0xa4f8bf5635246428ULL},  /* 1e-224 */
+    {0x940f4613ae5ed136ULL, 0x871b7795e136be99ULL},  /* 1e-223 */
+    {0xb913179899f68584ULL, 0x28e2557b59846e3fULL},  /* 1e-222 */
+    {0xe757dd7ec07426e5ULL, 0x331aeada2fe589cfULL},  /* 1e-221 */
+    {0x9096ea6f3848984fULL, 0x3ff0d2c85def7621ULL},  /* 1e-220 */
+    {0xb4bca50b065abe63ULL, 0x0fed077a756b53a9ULL},  /* 1e-219 */
+    {0xe1ebce4dc7f16dfbULL, 0xd3e8495912c62894ULL},  /* 1e-218 */
+    {0x8d3360f09cf6e4bdULL, 0x64712dd7abbbd95cULL},  /* 1e-217 */
+    {0xb080392cc4349decULL, 0xbd8d794d96aacfb3ULL},  /* 1e-216 */
+    {0xdca04777f541c567ULL, 0xecf0d7a0fc5583a0ULL},  /* 1e-215 */
+    {0x89e42caaf9491b60ULL, 0xf41686c49db57244ULL},  /* 1e-214 */
+    {0xac5d37d5b79b6239ULL, 0x311c2875c522ced5ULL},  /* 1e-213 */
+    {0xd77485cb25823ac7ULL, 0x7d633293366b828bULL},  /* 1e-212 */
+    {0x86a8d39ef77164bcULL, 0xae5dff9c02033197ULL},  /* 1e-211 */
+    {0xa8530886b54dbdebULL, 0xd9f57f830283fdfcULL},  /* 1e-210 */
+    {0xd267caa862a12d66ULL, 0xd072df63c324fd7bULL},  /* 1e-209 */
+    {0x8380dea93da4bc60ULL, 0x4247cb9e59f71e6dULL},  /* 1e-208 */
+    {0xa46116538d0deb78ULL, 0x52d9be85f074e608ULL},  /* 1e-207 */
+    {0xcd795be870516656ULL, 0x67902e276c921f8bULL},  /* 1e-206 */
+    {0x806bd9714632dff6ULL, 0x00ba1cd8a3db53b6ULL},  /* 1e-205 */
+    {0xa086cfcd97bf97f3ULL, 0x80e8a40eccd228a4ULL},  /* 1e-204 */
+    {0xc8a883c0fdaf7df0ULL, 0x6122cd128006b2cdULL},  /* 1e-203 */
+    {0xfad2a4b13d1b5d6cULL, 0x796b805720085f81ULL},  /* 1e-202 */
+    {0x9cc3a6eec6311a63ULL, 0xcbe3303674053bb0ULL},  /* 1e-201 */
+    {0xc3f490aa77bd60fcULL, 0xbedbfc4411068a9cULL},  /* 1e-200 */
+    {0xf4f1b4d515acb93bULL, 0xee92fb5515482d44ULL},  /* 1e-199 */
+    {0x991711052d8bf3c5ULL, 0x751bdd152d4d1c4aULL},  /* 1e-198 */
+    {0xbf5cd54678eef0b6ULL, 0xd262d45a78a0635dULL},  /* 1e-197 */
+    {0xef340a98172aace4ULL, 0x86fb897116c87c34ULL},  /* 1e-196 */
+    {0x9580869f0e7aac0eULL, 0xd45d35e6ae3d4da0ULL},  /* 1e-195 */
+    {0xbae0a846d2195712ULL, 0x8974836059cca109ULL},  /* 1e-194 */
+    {0xe998d258869facd7ULL, 0x2bd1a438703fc94bULL},  /* 1e-193 */
+    {0x91ff83775423cc06ULL, 0x7b6306a34627ddcfULL},  /* 1e-192 */
+    {0xb67f6455292cbf08ULL, 0x1a3bc84c17b1d542ULL},  /* 1e-191 */
+    {0xe41f3d6a7377eecaULL, 0x20caba5f1d9e4a93ULL},  /* 1e-190 */
+    {0x8e938662882af53eULL, 0x547eb47b7282ee9cULL},  /* 1e-189 */
+    {0xb23867fb2a35b28dULL, 0xe99e619a4f23aa43ULL},  /* 1e-188 */
+    {0xdec681f9f4c31f31ULL, 0x6405fa00e2ec94d4ULL},  /* 1e-187 */
+    {0x8b3c113c38f9f37eULL, 0xde83bc408dd3dd04ULL},  /* 1e-186 */
+    {0xae0b158b4738705eULL, 0x9624ab50b148d445ULL},  /* 1e-185 */
+    {0xd98ddaee19068c76ULL, 0x3badd624dd9b0957ULL},  /* 1e-184 */
+    {0x87f8a8d4cfa417c9ULL, 0xe54ca5d70a80e5d6ULL},  /* 1e-183 */
+    {0xa9f6d30a038d1dbcULL, 0x5e9fcf4ccd211f4cULL},  /* 1e-182 */
+    {0xd47487cc8470652bULL, 0x7647c3200069671fULL},  /* 1e-181 */
+    {0x84c8d4dfd2c63f3bULL, 0x29ecd9f40041e073ULL},  /* 1e-180 */
+    {0xa5fb0a17c777cf09ULL, 0xf468107100525890ULL},  /* 1e-179 */
+    {0xcf79cc9db955c2ccULL, 0x7182148d4066eeb4ULL},  /* 1e-178 */
+    {0x81ac1fe293d599bfULL, 0xc6f14cd848405530ULL},  /* 1e-177 */
+    {0xa21727db38cb002fULL, 0xb8ada00e5a506a7cULL},  /* 1e-176 */
+    {0xca9cf1d206fdc03bULL, 0xa6d90811f0e4851cULL},  /* 1e-175 */
+    {0xfd442e4688bd304aULL, 0x908f4a166d1da663ULL},  /* 1e-174 */
+    {0x9e4a9cec15763e2eULL, 0x9a598e4e043287feULL},  /* 1e-173 */
+    {0xc5dd44271ad3cdbaULL, 0x40eff1e1853f29fdULL},  /* 1e-172 */
+    {0xf7549530e188c128ULL, 0xd12bee59e68ef47cULL},  /* 1e-171 */
+    {0x9a94dd3e8cf578b9ULL, 0x82bb74f8301958ceULL},  /* 1e-170 */
+    {0xc13a148e3032d6e7ULL, 0xe36a52363c1faf01ULL},  /* 1e-169 */
+    {0xf18899b1bc3f8ca1ULL, 0xdc44e6c3cb279ac1ULL},  /* 1e-168 */
+    {0x96f5600f15a7b7e5ULL, 0x29ab103a5ef8c0b9ULL},  /* 1e-167 */
+    {0xbcb2b812db11a5deULL, 0x7415d448f6b6f0e7ULL},  /* 1e-166 */
+    {0xebdf661791d60f56ULL, 0x111b495b3464ad21ULL},  /* 1e-165 */
+    {0x936b9fcebb25c995ULL, 0xcab10dd900beec34ULL},  /* 1e-164 */
+    {0xb84687c269ef3bfbULL, 0x3d5d514f40eea742ULL},  /* 1e-163 */
+    {0xe65829b3046b0afaULL, 0x0cb4a5a3112a5112ULL},  /* 1e-162 */
+    {0x8ff71a0fe2c2e6dcULL, 0x47f0e785eaba72abULL},  /* 1e-161 */
+    {0xb3f4e093db73a093ULL, 0x59ed216765690f56ULL},  /* 1e-160 */
+    {0xe0f218b8d25088b8ULL, 0x306869c13ec3532cULL},  /* 1e-159 */
+    {0x8c974f7383725573ULL, 0x1e414218c73a13fbULL},  /* 1e-158 */
+    {0xafbd2350644eeacfULL, 0xe5d1929ef90898faULL},  /* 1e-157 */
+    {0xdbac6c247d62a583ULL, 0xdf45f746b74abf39ULL},  /* 1e-156 */
+    {0x894bc396ce5da772ULL, 0x6b8bba8c328eb783ULL},  /* 1e-155 */
+    {0xab9eb47c81f5114fULL, 0x066ea92f3f326564ULL},  /* 1e-154 */
+    {0xd686619ba27255a2ULL, 0xc80a537b0efefebdULL},  /* 1e-153 */
+    {0x8613fd0145877585ULL, 0xbd06742ce95f5f36ULL},  /* 1e-152 */
+    {0xa798fc4196e952e7ULL, 0x2c48113823b73704ULL},  /* 1e-151 */
+    {0xd17f3b51fca3a7a0ULL, 0xf75a15862ca504c5ULL},  /* 1e-150 */
+    {0x82ef85133de648c4ULL, 0x9a984d73dbe722fbULL},  /* 1e-149 */
+    {0xa3ab66580d5fdaf5ULL, 0xc13e60d0d2e0ebbaULL},  /* 1e-148 */
+    {0xcc963fee10b7d1b3ULL, 0x318df905079926a8ULL},  /* 1e-147 */
+    {0xffbbcfe994e5c61fULL, 0xfdf17746497f7052ULL},  /* 1e-146 */
+    {0x9fd561f1fd0f9bd3ULL, 0xfeb6ea8bedefa633ULL},  /* 1e-145 */
+    {0xc7caba6e7c5382c8ULL, 0xfe64a52ee96b8fc0ULL},  /* 1e-144 */
+    {0xf9bd690a1b68637bULL, 0x3dfdce7aa3c673b0ULL},  /* 1e-143 */
+    {0x9c1661a651213e2dULL, 0x06bea10ca65c084eULL},  /* 1e-142 */
+    {0xc31bfa0fe5698db8ULL, 0x486e494fcff30a62ULL},  /* 1e-141 */
+    {0xf3e2f893dec3f126ULL, 0x5a89dba3c3efccfaULL},  /* 1e-140 */
+    {0x986ddb5c6b3a76b7ULL, 0xf89629465a75e01cULL},  /* 1e-139 */
+    {0xbe89523386091465ULL, 0xf6bbb397f1135823ULL},  /* 1e-138 */
+    {0xee2ba6c0678b597fULL, 0x746aa07ded582e2cULL},  /* 1e-137 */
+    {0x94db483840b717efULL, 0xa8c2a44eb4571cdcULL},  /* 1e-136 */
+    {0xba121a4650e4ddebULL, 0x92f34d62616ce413ULL},  /* 1e-135 */
+    {0xe896a0d7e51e1566ULL, 0x77b020baf9c81d17ULL},  /* 1e-134 */
+    {0x915e2486ef32cd60ULL, 0x0ace1474dc1d122eULL},  /* 1e-133 */
+    {0xb5b5ada8aaff80b8ULL, 0x0d819992132456baULL},  /* 1e-132 */
+    {0xe3231912d5bf60e6ULL, 0x10e1fff697ed6c69ULL},  /* 1e-131 */
+    {0x8df5efabc5979c8fULL, 0xca8d3ffa1ef463c1ULL},  /* 1e-130 */
+    {0xb1736b96b6fd83b3ULL, 0xbd308ff8a6b17cb2ULL},  /* 1e-129 */
+    {0xddd0467c64bce4a0ULL, 0xac7cb3f6d05ddbdeULL},  /* 1e-128 */
+    {0x8aa22c0dbef60ee4ULL, 0x6bcdf07a423aa96bULL},  /* 1e-127 */
+    {0xad4ab7112eb3929dULL, 0x86c16c98d2c953c6ULL},  /* 1e-126 */
+    {0xd89d64d57a607744ULL, 0xe871c7bf077ba8b7ULL},  /* 1e-125 */
+    {0x87625f056c7c4a8bULL, 0x11471cd764ad4972ULL},  /* 1e-124 */
+    {0xa93af6c6c79b5d2dULL, 0xd598e40d3dd89bcfULL},  /* 1e-123 */
+    {0xd389b47879823479ULL, 0x4aff1d108d4ec2c3ULL},  /* 1e-122 */
+    {0x843610cb4bf160cbULL, 0xcedf722a585139baULL},  /* 1e-121 */
+    {0xa54394fe1eedb8feULL, 0xc2974eb4ee658828ULL},  /* 1e-120 */
+    {0xce947a3da6a9273eULL, 0x733d226229feea32ULL},  /* 1e-119 */
+    {0x811ccc668829b887ULL, 0x0806357d5a3f525fULL},  /* 1e-118 */
+    {0xa163ff802a3426a8ULL, 0xca07c2dcb0cf26f7ULL},  /* 1e-117 */
+    {0xc9bcff6034c13052ULL, 0xfc89b393dd02f0b5ULL},  /* 1e-116 */
+    {0xfc2c3f3841f17c67ULL, 0xbbac2078d443ace2ULL},  /* 1e-115 */
+    {0x9d9ba7832936edc0ULL, 0xd54b944b84aa4c0dULL},  /* 1e-114 */
+    {0xc5029163f384a931ULL, 0x0a9e795e65d4df11ULL},  /* 1e-113 */
+    {0xf64335bcf065d37dULL, 0x4d4617b5ff4a16d5ULL},  /* 1e-112 */
+    {0x99ea0196163fa42eULL, 0x504bced1bf8e4e45ULL},  /* 1e-111 */
+    {0xc06481fb9bcf8d39ULL, 0xe45ec2862f71e1d6ULL},  /* 1e-110 */
+    {0xf07da27a82c37088ULL, 0x5d767327bb4e5a4cULL},  /* 1e-109 */
+    {0x964e858c91ba2655ULL, 0x3a6a07f8d510f86fULL},  /* 1e-108 */
+    {0xbbe226efb628afeaULL, 0x890489f70a55368bULL},  /* 1e-107 */
+    {0xeadab0aba3b2dbe5ULL, 0x2b45ac74ccea842eULL},  /* 1e-106 */
+    {0x92c8ae6b464fc96fULL, 0x3b0b8bc90012929dULL},  /* 1e-105 */
+    {0xb77ada0617e3bbcbULL, 0x09ce6ebb40173744ULL},  /* 1e-104 */
+    {0xe55990879ddcaabdULL, 0xcc420a6a101d0515ULL},  /* 1e-103 */
+    {0x8f57fa54c2a9eab6ULL, 0x9fa946824a12232dULL},  /* 1e-102 */
+    {0xb32df8e9f3546564ULL, 0x47939822dc96abf9ULL},  /* 1e-101 */
+    {0xdff9772470297ebdULL, 0x59787e2b93bc56f7ULL},  /* 1e-100 */
+    {0x8bfbea76c619ef36ULL, 0x57eb4edb3c55b65aULL},  /* 1e-99 */
+    {0xaefae51477a06b03ULL, 0xede622920b6b23f1ULL},  /* 1e-98 */
+    {0xdab99e59958885c4ULL, 0xe95fab368e45ecedULL},  /* 1e-97 */
+    {0x88b402f7fd75539bULL, 0x11dbcb0218ebb414ULL},  /* 1e-96 */
+    {0xaae103b5fcd2a881ULL, 0xd652bdc29f26a119ULL},  /* 1e-95 */
+    {0xd59944a37c0752a2ULL, 0x4be76d3346f0495fULL},  /* 1e-94 */
+    {0x857fcae62d8493a5ULL, 0x6f70a4400c562ddbULL},  /* 1e-93 */
+    {0xa6dfbd9fb8e5b88eULL, 0xcb4ccd500f6bb952ULL},  /* 1e-92 */
+    {0xd097ad07a71f26b2ULL, 0x7e2000a41346a7a7ULL},  /* 1e-91 */
+    {0x825ecc24c873782fULL, 0x8ed400668c0c28c8ULL},  /* 1e-90 */
+    {0xa2f67f2dfa90563bULL, 0x728900802f0f32faULL},  /* 1e-89 */
+    {0xcbb41ef979346bcaULL, 0x4f2b40a03ad2ffb9ULL},  /* 1e-88 */
+    {0xfea126b7d78186bcULL, 0xe2f610c84987bfa8ULL},  /* 1e-87 */
+    {0x9f24b832e6b0f436ULL, 0x0dd9ca7d2df4d7c9ULL},  /* 1e-86 */
+    {0xc6ede63fa05d3143ULL, 0x91503d1c79720dbbULL},  /* 1e-85 */
+    {0xf8a95fcf88747d94ULL, 0x75a44c6397ce912aULL},  /* 1e-84 */
+    {0x9b69dbe1b548ce7cULL, 0xc986afbe3ee11abaULL},  /* 1e-83 */
+    {0xc24452da229b021bULL, 0xfbe85badce996168ULL},  /* 1e-82 */
+    {0xf2d56790ab41c2a2ULL, 0xfae27299423fb9c3ULL},  /* 1e-81 */
+    {0x97c560ba6b0919a5ULL, 0xdccd879fc967d41aULL},  /* 1e-80 */
+    {0xbdb6b8e905cb600fULL, 0x5400e987bbc1c920ULL},  /* 1e-79 */
+    {0xed246723473e3813ULL, 0x290123e9aab23b68ULL},  /* 1e-78 */
+    {0x9436c0760c86e30bULL, 0xf9a0b6720aaf6521ULL},  /* 1e-77 */
+    {0xb94470938fa89bceULL, 0xf808e40e8d5b3e69ULL},  /* 1e-76 */
+    {0xe7958cb87392c2c2ULL, 0xb60b1d1230b20e04ULL},  /* 1e-75 */
+    {0x90bd77f3483bb9b9ULL, 0xb1c6f22b5e6f48c2ULL},  /* 1e-74 */
+    {0xb4ecd5f01a4aa828ULL, 0x1e38aeb6360b1af3ULL},  /* 1e-73 */
+    {0xe2280b6c20dd5232ULL, 0x25c6da63c38de1b0ULL},  /* 1e-72 */
+    {0x8d590723948a535fULL, 0x579c487e5a38ad0eULL},  /* 1e-71 */
+    {0xb0af48ec79ace837ULL, 0x2d835a9df0c6d851ULL},  /* 1e-70 */
+    {0xdcdb1b2798182244ULL, 0xf8e431456cf88e65ULL},  /* 1e-69 */
+    {0x8a08f0f8bf0f156bULL, 0x1b8e9ecb641b58ffULL},  /* 1e-68 */
+    {0xac8b2d36eed2dac5ULL, 0xe272467e3d222f3fULL},  /* 1e-67 */
+    {0xd7adf884aa879177ULL, 0x5b0ed81dcc6abb0fULL},  /* 1e-66 */
+    {0x86ccbb52ea94baeaULL, 0x98e947129fc2b4e9ULL},  /* 1e-65 */
+    {0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL},  /* 1e-64 */
+    {0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL},  /* 1e-63 */
+    {0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL},  /* 1e-62 */
+    {0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL},  /* 1e-61 */
+    {0xcdb02555653131b6ULL, 0x3792f412cb06794dULL},  /* 1e-60 */
+    {0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL},  /* 1e-59 */
+    {0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL},  /* 1e-58 */
+    {0xc8de047564d20a8bULL, 0xf245825a5a445275ULL},  /* 1e-57 */
+    {0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL},  /* 1e-56 */
+    {0x9ced737bb6c4183dULL, 0x55464dd69685606bULL},  /* 1e-55 */
+    {0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL},  /* 1e-54 */
+    {0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL},  /* 1e-53 */
+    {0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL},  /* 1e-52 */
+    {0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL},  /* 1e-51 */
+    {0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL},  /* 1e-50 */
+    {0x95a8637627989aadULL, 0xdde7001379a44aa8ULL},  /* 1e-49 */
+    {0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL},  /* 1e-48 */
+    {0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL},  /* 1e-47 */
+    {0x9226712162ab070dULL, 0xcab3961304ca70e8ULL},  /* 1e-46 */
+    {0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL},  /* 1e-45 */
+    {0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL},  /* 1e-44 */
+    {0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL},  /* 1e-43 */
+    {0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL},  /* 1e-42 */
+    {0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL},  /* 1e-41 */
+    {0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL},  /* 1e-40 */
+    {0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL},  /* 1e-39 */
+    {0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL},  /* 1e-38 */
+    {0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL},  /* 1e-37 */
+    {0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL},  /* 1e-36 */
+    {0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL},  /* 1e-35 */
+    {0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL},  /* 1e-34 */
+    {0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL},  /* 1e-33 */
+    {0xcfb11ead453994baULL, 0x67de18eda5814af2ULL},  /* 1e-32 */
+    {0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL},  /* 1e-31 */
+    {0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL},  /* 1e-30 */
+    {0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL},  /* 1e-29 */
+    {0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL},  /* 1e-28 */
+    {0x9e74d1b791e07e48ULL, 0x775ea264cf55347dULL},  /* 1e-27 */
+    {0xc612062576589ddaULL, 0x95364afe032a819dULL},  /* 1e-26 */
+    {0xf79687aed3eec551ULL, 0x3a83ddbd83f52204ULL},  /* 1e-25 */
+    {0x9abe14cd44753b52ULL, 0xc4926a9672793542ULL},  /* 1e-24 */
+    {0xc16d9a0095928a27ULL, 0x75b7053c0f178293ULL},  /* 1e-23 */
+    {0xf1c90080baf72cb1ULL, 0x5324c68b12dd6338ULL},  /* 1e-22 */
+    {0x971da05074da7beeULL, 0xd3f6fc16ebca5e03ULL},  /* 1e-21 */
+    {0xbce5086492111aeaULL, 0x88f4bb1ca6bcf584ULL},  /* 1e-20 */
+    {0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e5ULL},  /* 1e-19 */
+    {0x9392ee8e921d5d07ULL, 0x3aff322e62439fcfULL},  /* 1e-18 */
+    {0xb877aa3236a4b449ULL, 0x09befeb9fad487c2ULL},  /* 1e-17 */
+    {0xe69594bec44de15bULL, 0x4c2ebe687989a9b3ULL},  /* 1e-16 */
+    {0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a10ULL},  /* 1e-15 */
+    {0xb424dc35095cd80fULL, 0x538484c19ef38c94ULL},  /* 1e-14 */
+    {0xe12e13424bb40e13ULL, 0x2865a5f206b06fb9ULL},  /* 1e-13 */
+    {0x8cbccc096f5088cbULL, 0xf93f87b7442e45d3ULL},  /* 1e-12 */
+    {0xafebff0bcb24aafeULL, 0xf78f69a51539d748ULL},  /* 1e-11 */
+    {0xdbe6fecebdedd5beULL, 0xb573440e5a884d1bULL},  /* 1e-10 */
+    {0x89705f4136b4a597ULL, 0x31680a88f8953030ULL},  /* 1e-9 */
+    {0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3dULL},  /* 1e-8 */
+    {0xd6bf94d5e57a42bcULL, 0x3d32907604691b4cULL},  /* 1e-7 */
+    {0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b10fULL},  /* 1e-6 */
+    {0xa7c5ac471b478423ULL, 0x0fcf80dc33721d53ULL},  /* 1e-5 */
+    {0xd1b71758e219652bULL, 0xd3c36113404ea4a8ULL},  /* 1e-4 */
+    {0x83126e978d4fdf3bULL, 0x645a1cac083126e9ULL},  /* 1e-3 */
+    {0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a3ULL},  /* 1e-2 */
+    {0xccccccccccccccccULL, 0xccccccccccccccccULL},  /* 1e-1 */
+    {0x8000000000000000ULL, 0x0000000000000000ULL},  /* 1e0 */
+    {0xa000000000000000ULL, 0x0000000000000000ULL},  /* 1e1 */
+    {0xc800000000000000ULL, 0x0000000000000000ULL},  /* 1e2 */
+    {0xfa00000000000000ULL, 0x0000000000000000ULL},  /* 1e3 */
+    {0x9c40000000000000ULL, 0x0000000000000000ULL},  /* 1e4 */
+    {0xc350000000000000ULL, 0x0000000000000000ULL},  /* 1e5 */
+    {0xf424000000000000ULL, 0x0000000000000000ULL},  /* 1e6 */
+    {0x9896800000000000ULL, 0x0000000000000000ULL},  /* 1e7 */
+    {0xbebc200000000000ULL, 0x0000000000000000ULL},  /* 1e8 */
+    {0xee6b280000000000ULL, 0x0000000000000000ULL},  /* 1e9 */
+    {0x9502f90000000000ULL, 0x0000000000000000ULL},  /* 1e10 */
+    {0xba43b74000000000ULL, 0x0000000000000000ULL},  /* 1e11 */
+    {0xe8d4a51000000000ULL, 0x0000000000000000ULL},  /* 1e12 */
+    {0x9184e72a00000000ULL, 0x0000000000000000ULL},  /* 1e13 */
+    {0xb5e620f480000000ULL, 0x0000000000000000ULL},  /* 1e14 */
+    {0xe35fa931a0000000ULL, 0x0000000000000000ULL},  /* 1e15 */
+    {0x8e1bc9bf04000000ULL, 0x0000000000000000ULL},  /* 1e16 */
+    {0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL},  /* 1e17 */
+    {0xde0b6b3a76400000ULL, 0x0000000000000000ULL},  /* 1e18 */
+    {0x8ac7230489e80000ULL, 0x0000000000000000ULL},  /* 1e19 */
+    {0xad78ebc5ac620000ULL, 0x0000000000000000ULL},  /* 1e20 */
+    {0xd8d726b7177a8000ULL, 0x0000000000000000ULL},  /* 1e21 */
+    {0x878678326eac9000ULL, 0x0000000000000000ULL},  /* 1e22 */
+    {0xa968163f0a57b400ULL, 0x0000000000000000ULL},  /* 1e23 */
+    {0xd3c21bcecceda100ULL, 0x0000000000000000ULL},  /* 1e24 */
+    {0x84595161401484a0ULL, 0x0000000000000000ULL},  /* 1e25 */
+    {0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL},  /* 1e26 */
+    {0xcecb8f27f4200f3aULL, 0x0000000000000000ULL},  /* 1e27 */
+    {0x813f3978f8940984ULL, 0x4000000000000000ULL},  /* 1e28 */
+    {0xa18f07d736b90be5ULL, 0x5000000000000000ULL},  /* 1e29 */
+    {0xc9f2c9cd04674edeULL, 0xa400000000000000ULL},  /* 1e30 */
+    {0xfc6f7c4045812296ULL, 0x4d00000000000000ULL},  /* 1e31 */
+    {0x9dc5ada82b70b59dULL, 0xf020000000000000ULL},  /* 1e32 */
+    {0xc5371912364ce305ULL, 0x6c28000000000000ULL},  /* 1e33 */
+    {0xf684df56c3e01bc6ULL, 0xc732000000000000ULL},  /* 1e34 */
+    {0x9a130b963a6c115cULL, 0x3c7f400000000000ULL},  /* 1e35 */
+    {0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL},  /* 1e36 */
+    {0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL},  /* 1e37 */
+    {0x96769950b50d88f4ULL, 0x1314448000000000ULL},  /* 1e38 */
+    {0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL},  /* 1e39 */
+    {0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL},  /* 1e40 */
+    {0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL},  /* 1e41 */
+    {0xb7abc627050305adULL, 0xf14a3d9e40000000ULL},  /* 1e42 */
+    {0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL},  /* 1e43 */
+    {0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL},  /* 1e44 */
+    {0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL},  /* 1e45 */
+    {0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL},  /* 1e46 */
+    {0x8c213d9da502de45ULL, 0x4526f422cc340000ULL},  /* 1e47 */
+    {0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL},  /* 1e48 */
+    {0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL},  /* 1e49 */
+    {0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL},  /* 1e50 */
+    {0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL},  /* 1e51 */
+    {0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL},  /* 1e52 */
+    {0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL},  /* 1e53 */
+    {0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL},  /* 1e54 */
+    {0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL},  /* 1e55 */
+    {0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL},  /* 1e56 */
+    {0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL},  /* 1e57 */
+    {0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL},  /* 1e58 */
+    {0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL},  /* 1e59 */
+    {0x9f4f2726179a2245ULL, 0x01d762422c946590ULL},  /* 1e60 */
+    {0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL},  /* 1e61 */
+    {0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL},  /* 1e62 */
+    {0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL},  /* 1e63 */
+    {0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL},  /* 1e64 */
+    {0xf316271c7fc3908aULL, 0x8bef464e3945ef7aULL},  /* 1e65 */
+    {0x97edd871cfda3a56ULL, 0x97758bf0e3cbb5acULL},  /* 1e66 */
+    {0xbde94e8e43d0c8ecULL, 0x3d52eeed1cbea317ULL},  /* 1e67 */
+    {0xed63a231d4c4fb27ULL, 0x4ca7aaa863ee4bddULL},  /* 1e68 */
+    {0x945e455f24fb1cf8ULL, 0x8fe8caa93e74ef6aULL},  /* 1e69 */
+    {0xb975d6b6ee39e436ULL, 0xb3e2fd538e122b44ULL},  /* 1e70 */
+    {0xe7d34c64a9c85d44ULL, 0x60dbbca87196b616ULL},  /* 1e71 */
+    {0x90e40fbeea1d3a4aULL, 0xbc8955e946fe31cdULL},  /* 1e72 */
+    {0xb51d13aea4a488ddULL, 0x6babab6398bdbe41ULL},  /* 1e73 */
+    {0xe264589a4dcdab14ULL, 0xc696963c7eed2dd1ULL},  /* 1e74 */
+    {0x8d7eb76070a08aecULL, 0xfc1e1de5cf543ca2ULL},  /* 1e75 */
+    {0xb0de65388cc8ada8ULL, 0x3b25a55f43294bcbULL},  /* 1e76 */
+    {0xdd15fe86affad912ULL, 0x49ef0eb713f39ebeULL},  /* 1e77 */
+    {0x8a2dbf142dfcc7abULL, 0x6e3569326c784337ULL},  /* 1e78 */
+    {0xacb92ed9397bf996ULL, 0x49c2c37f07965404ULL},  /* 1e79 */
+    {0xd7e77a8f87daf7fbULL, 0xdc33745ec97be906ULL},  /* 1e80 */
+    {0x86f0ac99b4e8dafdULL, 0x69a028bb3ded71a3ULL},  /* 1e81 */
+    {0xa8acd7c0222311bcULL, 0xc40832ea0d68ce0cULL},  /* 1e82 */
+    {0xd2d80db02aabd62bULL, 0xf50a3fa490c30190ULL},  /* 1e83 */
+    {0x83c7088e1aab65dbULL, 0x792667c6da79e0faULL},  /* 1e84 */
+    {0xa4b8cab1a1563f52ULL, 0x577001b891185938ULL},  /* 1e85 */
+    {0xcde6fd5e09abcf26ULL, 0xed4c0226b55e6f86ULL},  /* 1e86 */
+    {0x80b05e5ac60b6178ULL, 0x544f8158315b05b4ULL},  /* 1e87 */
+    {0xa0dc75f1778e39d6ULL, 0x696361ae3db1c721ULL},  /* 1e88 */
+    {0xc913936dd571c84cULL, 0x03bc3a19cd1e38e9ULL},  /* 1e89 */
+    {0xfb5878494ace3a5fULL, 0x04ab48a04065c723ULL},  /* 1e90 */
+    {0x9d174b2dcec0e47bULL, 0x62eb0d64283f9c76ULL},  /* 1e91 */
+    {0xc45d1df942711d9aULL, 0x3ba5d0bd324f8394ULL},  /* 1e92 */
+    {0xf5746577930d6500ULL, 0xca8f44ec7ee36479ULL},  /* 1e93 */
+    {0x9968bf6abbe85f20ULL, 0x7e998b13cf4e1ecbULL},  /* 1e94 */
+    {0xbfc2ef456ae276e8ULL, 0x9e3fedd8c321a67eULL},  /* 1e95 */
+    {0xefb3ab16c59b14a2ULL, 0xc5cfe94ef3ea101eULL},  /* 1e96 */
+    {0x95d04aee3b80ece5ULL, 0xbba1f1d158724a12ULL},  /* 1e97 */
+    {0xbb445da9ca61281fULL, 0x2a8a6e45ae8edc97ULL},  /* 1e98 */
+    {0xea1575143cf97226ULL, 0xf52d09d71a3293bdULL},  /* 1e99 */
+    {0x924d692ca61be758ULL, 0x593c2626705f9c56ULL},  /* 1e100 */
+    {0xb6e0c377cfa2e12eULL, 0x6f8b2fb00c77836cULL},  /* 1e101 */
+    {0xe498f455c38b997aULL, 0x0b6dfb9c0f956447ULL},  /* 1e102 */
+    {0x8edf98b59a373fecULL, 0x4724bd4189bd5eacULL},  /* 1e103 */
+    {0xb2977ee300c50fe7ULL, 0x58edec91ec2cb657ULL},  /* 1e104 */
+    {0xdf3d5e9bc0f653e1ULL, 0x2f2967b66737e3edULL},  /* 1e105 */
+    {0x8b865b215899f46cULL, 0xbd79e0d20082ee74ULL},  /* 1e106 */
+    {0xae67f1e9aec07187ULL, 0xecd8590680a3aa11ULL},  /* 1e107 */
+    {0xda01ee641a708de9ULL, 0xe80e6f4820cc9495ULL},  /* 1e108 */
+    {0x884134fe908658b2ULL, 0x3109058d147fdcddULL},  /* 1e109 */
+    {0xaa51823e34a7eedeULL, 0xbd4b46f0599fd415ULL},  /* 1e110 */
+    {0xd4e5e2cdc1d1ea96ULL, 0x6c9e18ac7007c91aULL},  /* 1e111 */
+    {0x850fadc09923329eULL, 0x03e2cf6bc604ddb0ULL},  /* 1e112 */
+    {0xa6539930bf6bff45ULL, 0x84db8346b786151cULL},  /* 1e113 */
+    {0xcfe87f7cef46ff16ULL, 0xe612641865679a63ULL},  /* 1e114 */
+    {0x81f14fae158c5f6eULL, 0x4fcb7e8f3f60c07eULL},  /* 1e115 */
+    {0xa26da3999aef7749ULL, 0xe3be5e330f38f09dULL},  /* 1e116 */
+    {0xcb090c8001ab551cULL, 0x5cadf5bfd3072cc5ULL},  /* 1e117 */
+    {0xfdcb4fa002162a63ULL, 0x73d9732fc7c8f7f6ULL},  /* 1e118 */
+    {0x9e9f11c4014dda7eULL, 0x2867e7fddcdd9afaULL},  /* 1e119 */
+    {0xc646d63501a1511dULL, 0xb281e1fd541501b8ULL},  /* 1e120 */
+    {0xf7d88bc24209a565ULL, 0x1f225a7ca91a4226ULL},  /* 1e121 */
+    {0x9ae757596946075fULL, 0x3375788de9b06958ULL},  /* 1e122 */
+    {0xc1a12d2fc3978937ULL, 0x0052d6b1641c83aeULL},  /* 1e123 */
+    {0xf209787bb47d6b84ULL, 0xc0678c5dbd23a49aULL},  /* 1e124 */
+    {0x9745eb4d50ce6332ULL, 0xf840b7ba963646e0ULL},  /* 1e125 */
+    {0xbd176620a501fbffULL, 0xb650e5a93bc3d898ULL},  /* 1e126 */
+    {0xec5d3fa8ce427affULL, 0xa3e51f138ab4cebeULL},  /* 1e127 */
+    {0x93ba47c980e98cdfULL, 0xc66f336c36b10137ULL},  /* 1e128 */
+    {0xb8a8d9bbe123f017ULL, 0xb80b0047445d4184ULL},  /* 1e129 */
+    {0xe6d3102ad96cec1dULL, 0xa60dc059157491e5ULL},  /* 1e130 */
+    {0x9043ea1ac7e41392ULL, 0x87c89837ad68db2fULL},  /* 1e131 */
+    {0xb454e4a179dd1877ULL, 0x29babe4598c311fbULL},  /* 1e132 */
+    {0xe16a1dc9d8545e94ULL, 0xf4296dd6fef3d67aULL},  /* 1e133 */
+    {0x8ce2529e2734bb1dULL, 0x1899e4a65f58660cULL},  /* 1e134 */
+    {0xb01ae745b101e9e4ULL, 0x5ec05dcff72e7f8fULL},  /* 1e135 */
+    {0xdc21a1171d42645dULL, 0x76707543f4fa1f73ULL},  /* 1e136 */
+    {0x899504ae72497ebaULL, 0x6a06494a791c53a8ULL},  /* 1e137 */
+    {0xabfa45da0edbde69ULL, 0x0487db9d17636892ULL},  /* 1e138 */
+    {0xd6f8d7509292d603ULL, 0x45a9d2845d3c42b6ULL},  /* 1e139 */
+    {0x865b86925b9bc5c2ULL, 0x0b8a2392ba45a9b2ULL},  /* 1e140 */
+    {0xa7f26836f282b732ULL, 0x8e6cac7768d7141eULL},  /* 1e141 */
+    {0xd1ef0244af2364ffULL, 0x3207d795430cd926ULL},  /* 1e142 */
+    {0x8335616aed761f1fULL, 0x7f44e6bd49e807b8ULL},  /* 1e143 */
+    {0xa402b9c5a8d3a6e7ULL, 0x5f16206c9c6209a6ULL},  /* 1e144 */
+    {0xcd036837130890a1ULL, 0x36dba887c37a8c0fULL},  /* 1e145 */
+    {0x802221226be55a64ULL, 0xc2494954da2c9789ULL},  /* 1e146 */
+    {0xa02aa96b06deb0fdULL, 0xf2db9baa10b7bd6cULL},  /* 1e147 */
+    {0xc83553c5c8965d3dULL, 0x6f92829494e5acc7ULL},  /* 1e148 */
+    {0xfa42a8b73abbf48cULL, 0xcb772339ba1f17f9ULL},  /* 1e149 */
+    {0x9c69a97284b578d7ULL, 0xff2a760414536efbULL},  /* 1e150 */
+    {0xc38413cf25e2d70dULL, 0xfef5138519684abaULL},  /* 1e151 */
+    {0xf46518c2ef5b8cd1ULL, 0x7eb258665fc25d69ULL},  /* 1e152 */
+    {0x98bf2f79d5993802ULL, 0xef2f773ffbd97a61ULL},  /* 1e153 */
+    {0xbeeefb584aff8603ULL, 0xaafb550ffacfd8faULL},  /* 1e154 */
+    {0xeeaaba2e5dbf6784ULL, 0x95ba2a53f983cf38ULL},  /* 1e155 */
+    {0x952ab45cfa97a0b2ULL, 0xdd945a747bf26183ULL},  /* 1e156 */
+    {0xba756174393d88dfULL, 0x94f971119aeef9e4ULL},  /* 1e157 */
+    {0xe912b9d1478ceb17ULL, 0x7a37cd5601aab85dULL},  /* 1e158 */
+    {0x91abb422ccb812eeULL, 0xac62e055c10ab33aULL},  /* 1e159 */
+    {0xb616a12b7fe617aaULL, 0x577b986b314d6009ULL},  /* 1e160 */
+    {0xe39c49765fdf9d94ULL, 0xed5a7e85fda0b80bULL},  /* 1e161 */
+    {0x8e41ade9fbebc27dULL, 0x14588f13be847307ULL},  /* 1e162 */
+    {0xb1d219647ae6b31cULL, 0x596eb2d8ae258fc8ULL},  /* 1e163 */
+    {0xde469fbd99a05fe3ULL, 0x6fca5f8ed9aef3bbULL},  /* 1e164 */
+    {0x8aec23d680043beeULL, 0x25de7bb9480d5854ULL},  /* 1e165 */
+    {0xada72ccc20054ae9ULL, 0xaf561aa79a10ae6aULL},  /* 1e166 */
+    {0xd910f7ff28069da4ULL, 0x1b2ba1518094da04ULL},  /* 1e167 */
+    {0x87aa9aff79042286ULL, 0x90fb44d2f05d0842ULL},  /* 1e168 */
+    {0xa99541bf57452b28ULL, 0x353a1607ac744a53ULL},  /* 1e169 */
+    {0xd3fa922f2d1675f2ULL, 0x42889b8997915ce8ULL},  /* 1e170 */
+    {0x847c9b5d7c2e09b7ULL, 0x69956135febada11ULL},  /* 1e171 */
+    {0xa59bc234db398c25ULL, 0x43fab9837e699095ULL},  /* 1e172 */
+    {0xcf02b2c21207ef2eULL, 0x94f967e45e03f4bbULL},  /* 1e173 */
+    {0x8161afb94b44f57dULL, 0x1d1be0eebac278f5ULL},  /* 1e174 */
+    {0xa1ba1ba79e1632dcULL, 0x6462d92a69731732ULL},  /* 1e175 */
+    {0xca28a291859bbf93ULL, 0x7d7b8f7503cfdcfeULL},  /* 1e176 */
+    {0xfcb2cb35e702af78ULL, 0x5cda735244c3d43eULL},  /* 1e177 */
+    {0x9defbf01b061adabULL, 0x3a0888136afa64a7ULL},  /* 1e178 */
+    {0xc56baec21c7a1916ULL, 0x088aaa1845b8fdd0ULL},  /* 1e179 */
+    {0xf6c69a72a3989f5bULL, 0x8aad549e57273d45ULL},  /* 1e180 */
+    {0x9a3c2087a63f6399ULL, 0x36ac54e2f678864bULL},  /* 1e181 */
+    {0xc0cb28a98fcf3c7fULL, 0x84576a1bb416a7ddULL},  /* 1e182 */
+    {0xf0fdf2d3f3c30b9fULL, 0x656d44a2a11c51d5ULL},  /* 1e183 */
+    {0x969eb7c47859e743ULL, 0x9f644ae5a4b1b325ULL},  /* 1e184 */
+    {0xbc4665b596706114ULL, 0x873d5d9f0dde1feeULL},  /* 1e185 */
+    {0xeb57ff22fc0c7959ULL, 0xa90cb506d155a7eaULL},  /* 1e186 */
+    {0x9316ff75dd87cbd8ULL, 0x09a7f12442d588f2ULL},  /* 1e187 */
+    {0xb7dcbf5354e9beceULL, 0x0c11ed6d538aeb2fULL},  /* 1e188 */
+    {0xe5d3ef282a242e81ULL, 0x8f1668c8a86da5faULL},  /* 1e189 */
+    {0x8fa475791a569d10ULL, 0xf96e017d694487bcULL},  /* 1e190 */
+    {0xb38d92d760ec4455ULL, 0x37c981dcc395a9acULL},  /* 1e191 */
+    {0xe070f78d3927556aULL, 0x85bbe253f47b1417ULL},  /* 1e192 */
+    {0x8c469ab843b89562ULL, 0x93956d7478ccec8eULL},  /* 1e193 */
+    {0xaf58416654a6babbULL, 0x387ac8d1970027b2ULL},  /* 1e194 */
+    {0xdb2e51bfe9d0696aULL, 0x06997b05fcc0319eULL},  /* 1e195 */
+    {0x88fcf317f22241e2ULL, 0x441fece3bdf81f03ULL},  /* 1e196 */
+    {0xab3c2fddeeaad25aULL, 0xd527e81cad7626c3ULL},  /* 1e197 */
+    {0xd60b3bd56a5586f1ULL, 0x8a71e223d8d3b074ULL},  /* 1e198 */
+    {0x85c7056562757456ULL, 0xf6872d5667844e49ULL},  /* 1e199 */
+    {0xa738c6bebb12d16cULL, 0xb428f8ac016561dbULL},  /* 1e200 */
+    {0xd106f86e69d785c7ULL, 0xe13336d701beba52ULL},  /* 1e201 */
+    {0x82a45b450226b39cULL, 0xecc0024661173473ULL},  /* 1e202 */
+    {0xa34d721642b06084ULL, 0x27f002d7f95d0190ULL},  /* 1e203 */
+    {0xcc20ce9bd35c78a5ULL, 0x31ec038df7b441f4ULL},  /* 1e204 */
+    {0xff290242c83396ceULL, 0x7e67047175a15271ULL},  /* 1e205 */
+    {0x9f79a169bd203e41ULL, 0x0f0062c6e984d386ULL},  /* 1e206 */
+    {0xc75809c42c684dd1ULL, 0x52c07b78a3e60868ULL},  /* 1e207 */
+    {0xf92e0c3537826145ULL, 0xa7709a56ccdf8a82ULL},  /* 1e208 */
+    {0x9bbcc7a142b17ccbULL, 0x88a66076400bb691ULL},  /* 1e209 */
+    {0xc2abf989935ddbfeULL, 0x6acff893d00ea435ULL},  /* 1e210 */
+    {0xf356f7ebf83552feULL, 0x0583f6b8c4124d43ULL},  /* 1e211 */
+    {0x98165af37b2153deULL, 0xc3727a337a8b704aULL},  /* 1e212 */
+    {0xbe1bf1b059e9a8d6ULL, 0x744f18c0592e4c5cULL},  /* 1e213 */
+    {0xeda2ee1c7064130cULL, 0x1162def06f79df73ULL},  /* 1e214 */
+    {0x9485d4d1c63e8be7ULL, 0x8addcb5645ac2ba8ULL},  /* 1e215 */
+    {0xb9a74a0637ce2ee1ULL, 0x6d953e2bd7173692ULL},  /* 1e216 */
+    {0xe8111c87c5c1ba99ULL, 0xc8fa8db6ccdd0437ULL},  /* 1e217 */
+    {0x910ab1d4db9914a0ULL, 0x1d9c9892400a22a2ULL},  /* 1e218 */
+    {0xb54d5e4a127f59c8ULL, 0x2503beb6d00cab4bULL},  /* 1e219 */
+    {0xe2a0b5dc971f303aULL, 0x2e44ae64840fd61dULL},  /* 1e220 */
+    {0x8da471a9de737e24ULL, 0x5ceaecfed289e5d2ULL},  /* 1e221 */
+    {0xb10d8e1456105dadULL, 0x7425a83e872c5f47ULL},  /* 1e222 */
+    {0xdd50f1996b947518ULL, 0xd12f124e28f77719ULL},  /* 1e223 */
+    {0x8a5296ffe33cc92fULL, 0x82bd6b70d99aaa6fULL},  /* 1e224 */
+    {0xace73cbfdc0bfb7bULL, 0x636cc64d1001550bULL},  /* 1e225 */
+    {0xd8210befd30efa5aULL, 0x3c47f7e05401aa4eULL},  /* 1e226 */
+    {0x8714a775e3e95c78ULL, 0x65acfaec34810a71ULL},  /* 1e227 */
+    {0xa8d9d1535ce3b396ULL, 0x7f1839a741a14d0dULL},  /* 1e228 */
+    {0xd31045a8341ca07cULL, 0x1ede48111209a050ULL},  /* 1e229 */
+    {0x83ea2b892091e44dULL, 0x934aed0aab460432ULL},  /* 1e230 */
+    {0xa4e4b66b68b65d60ULL, 0xf81da84d5617853fULL},  /* 1e231 */
+    {0xce1de40642e3f4b9ULL, 0x36251260ab9d668eULL},  /* 1e232 */
+    {0x80d2ae83e9ce78f3ULL, 0xc1d72b7c6b426019ULL},  /* 1e233 */
+    {0xa1075a24e4421730ULL, 0xb24cf65b8612f81fULL},  /* 1e234 */
+    {0xc94930ae1d529cfcULL, 0xdee033f26797b627ULL},  /* 1e235 */
+    {0xfb9b7cd9a4a7443cULL, 0x169840ef017da3b1ULL},  /* 1e236 */
+    {0x9d412e0806e88aa5ULL, 0x8e1f289560ee864eULL},  /* 1e237 */
+    {0xc491798a08a2ad4eULL, 0xf1a6f2bab92a27e2ULL},  /* 1e238 */
+    {0xf5b5d7ec8acb58a2ULL, 0xae10af696774b1dbULL},  /* 1e239 */
+    {0x9991a6f3d6bf1765ULL, 0xacca6da1e0a8ef29ULL},  /* 1e240 */
+    {0xbff610b0cc6edd3fULL, 0x17fd090a58d32af3ULL},  /* 1e241 */
+    {0xeff394dcff8a948eULL, 0xddfc4b4cef07f5b0ULL},  /* 1e242 */
+    {0x95f83d0a1fb69cd9ULL, 0x4abdaf101564f98eULL},  /* 1e243 */
+    {0xbb764c4ca7a4440fULL, 0x9d6d1ad41abe37f1ULL},  /* 1e244 */
+    {0xea53df5fd18d5513ULL, 0x84c86189216dc5edULL},  /* 1e245 */
+    {0x92746b9be2f8552cULL, 0x32fd3cf5b4e49bb4ULL},  /* 1e246 */
+    {0xb7118682dbb66a77ULL, 0x3fbc8c33221dc2a1ULL},  /* 1e247 */
+    {0xe4d5e82392a40515ULL, 0x0fabaf3feaa5334aULL},  /* 1e248 */
+    {0x8f05b1163ba6832dULL, 0x29cb4d87f2a7400eULL},  /* 1e249 */
+    {0xb2c71d5bca9023f8ULL, 0x743e20e9ef511012ULL},  /* 1e250 */
+    {0xdf78e4b2bd342cf6ULL, 0x914da9246b255416ULL},  /* 1e251 */
+    {0x8bab8eefb6409c1aULL, 0x1ad089b6c2f7548eULL},  /* 1e252 */
+    {0xae9672aba3d0c320ULL, 0xa184ac2473b529b1ULL},  /* 1e253 */
+    {0xda3c0f568cc4f3e8ULL, 0xc9e5d72d90a2741eULL},  /* 1e254 */
+    {0x8865899617fb1871ULL, 0x7e2fa67c7a658892ULL},  /* 1e255 */
+    {0xaa7eebfb9df9de8dULL, 0xddbb901b98feeab7ULL},  /* 1e256 */
+    {0xd51ea6fa85785631ULL, 0x552a74227f3ea565ULL},  /* 1e257 */
+    {0x8533285c936b35deULL, 0xd53a88958f87275fULL},  /* 1e258 */
+    {0xa67ff273b8460356ULL, 0x8a892abaf368f137ULL},  /* 1e259 */
+    {0xd01fef10a657842cULL, 0x2d2b7569b0432d85ULL},  /* 1e260 */
+    {0x8213f56a67f6b29bULL, 0x9c3b29620e29fc73ULL},  /* 1e261 */
+    {0xa298f2c501f45f42ULL, 0x8349f3ba91b47b8fULL},  /* 1e262 */
+    {0xcb3f2f7642717713ULL, 0x241c70a936219a73ULL},  /* 1e263 */
+    {0xfe0efb53d30dd4d7ULL, 0xed238cd383aa0110ULL},  /* 1e264 */
+    {0x9ec95d1463e8a506ULL, 0xf4363804324a40aaULL},  /* 1e265 */
+    {0xc67bb4597ce2ce48ULL, 0xb143c6053edcd0d5ULL},  /* 1e266 */
+    {0xf81aa16fdc1b81daULL, 0xdd94b7868e94050aULL},  /* 1e267 */
+    {0x9b10a4e5e9913128ULL, 0xca7cf2b4191c8326ULL},  /* 1e268 */
+    {0xc1d4ce1f63f57d72ULL, 0xfd1c2f611f63a3f0ULL},  /* 1e269 */
+    {0xf24a01a73cf2dccfULL, 0xbc633b39673c8cecULL},  /* 1e270 */
+    {0x976e41088617ca01ULL, 0xd5be0503e085d813ULL},  /* 1e271 */
+    {0xbd49d14aa79dbc82ULL, 0x4b2d8644d8a74e18ULL},  /* 1e272 */
+    {0xec9c459d51852ba2ULL, 0xddf8e7d60ed1219eULL},  /* 1e273 */
+    {0x93e1ab8252f33b45ULL, 0xcabb90e5c942b503ULL},  /* 1e274 */
+    {0xb8da1662e7b00a17ULL, 0x3d6a751f3b936243ULL},  /* 1e275 */
+    {0xe7109bfba19c0c9dULL, 0x0cc512670a783ad4ULL},  /* 1e276 */
+    {0x906a617d450187e2ULL, 0x27fb2b80668b24c5ULL},  /* 1e277 */
+    {0xb484f9dc9641e9daULL, 0xb1f9f660802dedf6ULL},  /* 1e278 */
+    {0xe1a63853bbd26451ULL, 0x5e7873f8a0396973ULL},  /* 1e279 */
+    {0x8d07e33455637eb2ULL, 0xdb0b487b6423e1e8ULL},  /* 1e280 */
+    {0xb049dc016abc5e5fULL, 0x91ce1a9a3d2cda62ULL},  /* 1e281 */
+    {0xdc5c5301c56b75f7ULL, 0x7641a140cc7810fbULL},  /* 1e282 */
+    {0x89b9b3e11b6329baULL, 0xa9e904c87fcb0a9dULL},  /* 1e283 */
+    {0xac2820d9623bf429ULL, 0x546345fa9fbdcd44ULL},  /* 1e284 */
+    {0xd732290fbacaf133ULL, 0xa97c177947ad4095ULL},  /* 1e285 */
+    {0x867f59a9d4bed6c0ULL, 0x49ed8eabcccc485dULL},  /* 1e286 */
+    {0xa81f301449ee8c70ULL, 0x5c68f256bfff5a74ULL},  /* 1e287 */
+    {0xd226fc195c6a2f8cULL, 0x73832eec6fff3111ULL},  /* 1e288 */
+    {0x83585d8fd9c25db7ULL, 0xc831fd53c5ff7eabULL},  /* 1e289 */
+    {0xa42e74f3d032f525ULL, 0xba3e7ca8b77f5e55ULL},  /* 1e290 */
+    {0xcd3a1230c43fb26fULL, 0x28ce1bd2e55f35ebULL},  /* 1e291 */
+    {0x80444b5e7aa7cf85ULL, 0x7980d163cf5b81b3ULL},  /* 1e292 */
+    {0xa0555e361951c366ULL, 0xd7e105bcc332621fULL},  /* 1e293 */
+    {0xc86ab5c39fa63440ULL, 0x8dd9472bf3fefaa7ULL},  /* 1e294 */
+    {0xfa856334878fc150ULL, 0xb14f98f6f0feb951ULL},  /* 1e295 */
+    {0x9c935e00d4b9d8d2ULL, 0x6ed1bf9a569f33d3ULL},  /* 1e296 */
+    {0xc3b8358109e84f07ULL, 0x0a862f80ec4700c8ULL},  /* 1e297 */
+    {0xf4a642e14c6262c8ULL, 0xcd27bb612758c0faULL},  /* 1e298 */
+    {0x98e7e9cccfbd7dbdULL, 0x8038d51cb897789cULL},  /* 1e299 */
+    {0xbf21e44003acdd2cULL, 0xe0470a63e6bd56c3ULL},  /* 1e300 */
+    {0xeeea5d5004981478ULL, 0x1858ccfce06cac74ULL},  /* 1e301 */
+    {0x95527a5202df0ccbULL, 0x0f37801e0c43ebc8ULL},  /* 1e302 */
+    {0xbaa718e68396cffdULL, 0xd30560258f54e6baULL},  /* 1e303 */
+    {0xe950df20247c83fdULL, 0x47c6b82ef32a2069ULL},  /* 1e304 */
+    {0x91d28b7416cdd27eULL, 0x4cdc331d57fa5441ULL},  /* 1e305 */
+    {0xb6472e511c81471dULL, 0xe0133fe4adf8e952ULL},  /* 1e306 */
+    {0xe3d8f9e563a198e5ULL, 0x58180fddd97723a6ULL},  /* 1e307 */
+    {0x8e679c2f5e44ff8fULL, 0x570f09eaa7ea7648ULL},  /* 1e308 */
+};
+
+static lval* parse_int(const char* p, const char* end, int neg) {
+    int base = 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) { base = 16; p += 2; }
+    else if (end - p > 2 && p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) { base = 2; p += 2; }
+
+    /* 按负数累加，这样 LONG_MIN 也能表示 */
+    long x = 0;
+    for (; p < end; p++) {
+        int d = base == 16 ? hex_value(*p) : *p - '0';
+        if (__builtin_mul_overflow(x, base, &x) || __builtin_sub_overflow(x, d, &x)) {
+            return lval_num(neg ? LONG_MIN : LONG_MAX);
+        }
+    }
+    if (!neg) {
+        if (x == LONG_MIN) return lval_num(LONG_MAX);
+        x = -x;
+    }
+    return lval_num(x);
+}
+
+/* 慢速路径：复制成 NUL 结尾的字符串交给 strtod (源码片段后面不一定有结束符) */
+static double parse_dec_slow(const char* s, int n) {
+    char local[64];
+    char* buf = n < (int)sizeof(local) ? local : malloc(n + 1);
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+    double d = strtod(buf, NULL);
+    if (buf != local) free(buf);
+    return d;
+}
+
+/* Eisel-Lemire：m != 0，成功时把 m * 10^e10 正确舍入后的 double 写入 out 并返回 1，
+   乘积不足以确定舍入方向 (或结果是次正规数、无穷) 时返回 0 */
+static int eisel_lemire(unsigned long long m, int e10, double* out) {
+    if (e10 < POW10_128_MIN || e10 > POW10_128_MAX) return 0;
+
+    /* 归一化 m，指数估计：floor(e10 * log2(10)) + 64 + 1023 */
+    int clz = __builtin_clzll(m);
+    m <<= clz;
+    unsigned long long exp2 = (unsigned long long)(((217706 * e10) >> 16) + 64 + 1023 - clz);
+
+    /* 先只乘高 64 位；低 9 位全为 1 时截断误差可能进位，再乘上低 64 位 */
+    const unsigned long long* pw = pow10_128[e10 - POW10_128_MIN];
+    unsigned __int128 x = (unsigned __int128)m * pw[0];
+    unsigned long long hi = (unsigned long long)(x >> 64);
+    unsigned long long lo = (unsigned long long)x;
+    if ((hi & 0x1FF) == 0x1FF && lo + m < m) {
+        unsigned __int128 y = (unsigned __int128)m * pw[1];
+        unsigned long long ylo = (unsigned long long)y;
+        unsigned long long mlo = lo + (unsigned long long)(y >> 64);
+        unsigned long long mhi = hi + (mlo < lo);
+        if ((mhi & 0x1FF) == 0x1FF && mlo + 1 == 0 && ylo + m < m) return 0;
+        hi = mhi;
+        lo = mlo;
+    }
+
+    /* 取 54 位，最后一位用于舍入；恰好在两个 double 中间时无法判断 */
+    unsigned long long msb = hi >> 63;
+    unsigned long long mant = hi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+    if (lo == 0 && (hi & 0x1FF) == 0 && (mant & 3) == 1) return 0;
+
+    mant += mant & 1;
+    mant >>= 1;
+    if (mant >> 53) {
+        mant >>= 1;
+        exp2++;
+    }
+    if (exp2 - 1 >= 0x7FF - 1) return 0;
+
+    unsigned long long bits = exp2 << 52 | (mant & ((1ULL << 52) - 1));
+    memcpy(out, &bits, sizeof(bits));
+    return 1;
+}
+
+static lval* parse_dec(const char* s, const char* end, int neg) {
+    const char* p = s;
+    unsigned long long m = 0;
+    int digits = 0;     // m 中的有效数字个数 (不含前导零)
+    int exp10 = 0;
+    int exact = 1;      // 所有非零数字都收进了 m
+
+    for (; p < end && IS_DIGIT(*p); p++) {
+        if (digits < 19) {
+            m = m * 10 + (*p - '0');
+            if (m) digits++;
+        } else {
+            exp10++;
+            if (*p != '0') exact = 0;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && IS_DIGIT(*p); p++) {
+            if (digits < 19) {
+                m = m * 10 + (*p - '0');
+                if (m) digits++;
+                exp10--;
+            } else if (*p != '0') {
+                exact = 0;
+            }
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int eneg = 0;
+        if (*p == '+' || *p == '-') { eneg = *p == '-'; p++; }
+        int e = 0;
+        for (; p < end; p++) {
+            if (e < 100000) e = e * 10 + (*p - '0');
+        }
+        exp10 += eneg ? -e : e;
+    }
+
+    double d;
+    if (m == 0) {
+        d = 0.0;
+    } else if (exact && m <= MANTISSA_MAX && exp10 >= -22 && exp10 <= 22) {
+        d = exp10 < 0 ? (double)m / pow10_exact[-exp10] : (double)m * pow10_exact[exp10];
+    } else if (exact && exp10 > 22 && exp10 <= 22 + 15
+               && m * (unsigned long long)pow10_exact[exp10 - 22] <= MANTISSA_MAX
+               && m <= MANTISSA_MAX / (unsigned long long)pow10_exact[exp10 - 22]) {
+        /* 多出来的指数先乘进整数部分，仍然精确 */
+        d = (double)(m * (unsigned long long)pow10_exact[exp10 - 22]) * 1e22;
+    } else {
+        double up;
+        if (!eisel_lemire(m, exp10, &d) || (!exact && (!eisel_lemire(m + 1, exp10, &up) || up != d))) {
+            return lval_dec(parse_dec_slow(neg ? s - 1 : s, end - (neg ? s - 1 : s)));
+        }
+    }
+    return lval_dec(neg ? -d : d);
+}
+
+static lval* parse_num(Token tok) {
+    const char* p = tok.start;
+    const char* end = tok.start + tok.length;
+    int neg = *p == '-';
+    if (neg) p++;
+
+    int is_dec = 0;
+    if (!(end - p > 1 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X' || p[1] == 'b' || p[1] == 'B'))) {
+        for (const char* q = p; q < end; q++) {
+            if (*q == '.' || *q == 'e' || *q == 'E') { is_dec = 1; break; }
+        }
+    }
+    return is_dec ? parse_dec(p, end, neg) : parse_int(p, end, neg);
+}
+
+/* 原子直接由源码片段构造，不再复制出临时的 NUL 结尾字符串 */
 lval* parse_atom(Token tok) {
-    char* s = malloc(tok.length + 1);
-    strncpy(s, tok.start, tok.length);
-    s[tok.length] = '\0';
-    
     if (tok.type == TOK_NUM) {
-        long x = strtol(s, NULL, 10);
-        free(s);
-        return lval_num(x);
+        return parse_num(tok);
     }
 
     if (tok.type == TOK_SYM) {
-        lval* v = lval_sym(s);
-        free(s);
-        return v;
+        return lval_sym_n(tok.start, tok.length);
     }
 
     if (tok.type == TOK_STR) {
-        char* unescaped = lval_str_unescape(s);
-        lval* v = lval_str(unescaped);
-        free(unescaped);
-        free(s);
-        return v;
+        /* 去掉两边的引号 */
+        return lval_str_n(tok.start + 1, tok.length - 2);
     }
 
-    free(s);
     return lval_err("Unexpected token type in parse_atom");
- }
+}
 
-lval* parse_expr_list(Tokenizer* t, TokenType end_type) {
-    lval* res;
-    if (end_type == TOK_RPAREN) {
-        res = lval_sexpr();
-    } else {
-        res = lval_qexpr();
+/*
+   列表用显式栈迭代解析，嵌套深度不受 C 栈限制，超过 PARSE_MAX_DEPTH 时返回错误。
+   所有未闭合列表的元素都压在同一个元素栈上，每层只记录自己的元素从哪里开始；
+   遇到右括号时这一层的元素个数就确定了，一次分配好 cell 数组并整段复制过去。
+   两个栈是线程局部的，解析过程中反复复用，不随列表个数增长分配次数。
+*/
+
+typedef struct {
+    int start;          // 这一层的第一个元素在元素栈中的位置
+    TokenType end;      // 期望的右括号
+} parse_frame;
+
+static __thread lval** parse_items = NULL;
+static __thread int parse_items_cap = 0;
+static __thread parse_frame* parse_frames = NULL;
+static __thread int parse_frames_cap = 0;
+
+/* 解析完一个很大的列表后不长期占着内存 */
+#define PARSE_STACK_KEEP 65536
+
+static void parse_stack_trim(void) {
+    if (parse_items_cap > PARSE_STACK_KEEP) {
+        free(parse_items);
+        parse_items = NULL;
+        parse_items_cap = 0;
+    }
+    if (parse_frames_cap > PARSE_STACK_KEEP) {
+        free(parse_frames);
+        parse_frames = NULL;
+        parse_frames_cap = 0;
     }
+}
 
-    Token tok = next_token(t);
-    while (tok.type != end_type && tok.type != TOK_EOF) {
-        if (tok.type == TOK_ERR) {
-            lval_del(res);
-            return lval_err(tok.error);
-        }
+/* 释放当前线程的两个栈，解析线程退出前调用 */
+void parse_stack_free(void) {
+    free(parse_items);
+    parse_items = NULL;
+    parse_items_cap = 0;
+    free(parse_frames);
+    parse_frames = NULL;
+    parse_frames_cap = 0;
+}
 
+/* 出错时释放元素栈上 [base, top) 的元素 */
+static lval* parse_fail(int base, int top, lval* err) {
+    for (int i = base; i < top; i++) lval_del(parse_items[i]);
+    parse_stack_trim();
+    return err;
+}
+
+lval* parse_expr_list(Tokenizer* t, TokenType end_type) {
+    int top = 0;        // 元素栈顶
+    int depth = 0;      // 当前未闭合的层数 (frames 栈顶)
+
+    if (parse_frames_cap == 0) {
+        parse_frames_cap = 64;
+        parse_frames = malloc(sizeof(parse_frame) * parse_frames_cap);
+    }
+    parse_frames[depth].start = top;
+    parse_frames[depth].end = end_type;
+    depth++;
+
+    for (;;) {
+        Token tok = next_token(t);
         lval* ele = NULL;
 
-        if (tok.type == TOK_LPAREN) {
-            ele = parse_sexpr(t);
-        } else if (tok.type == TOK_LBRACE) {
-            ele = parse_qexpr(t);
-        } else {
-            ele = parse_atom(tok);
+        switch (tok.type) {
+            case TOK_EOF:
+                return parse_fail(0, top, lval_err("Missing closing parenthesis/brace"));
+
+            case TOK_ERR:
+                return parse_fail(0, top, lval_err(tok.error));
+
+            case TOK_LPAREN:
+            case TOK_LBRACE:
+                if (depth >= PARSE_MAX_DEPTH) {
+                    return parse_fail(0, top, lval_err("Nesting depth exceeds the maximum of %d", PARSE_MAX_DEPTH));
+                }
+                if (depth == parse_frames_cap) {
+                    parse_frames_cap *= 2;
+                    parse_frames = realloc(parse_frames, sizeof(parse_frame) * parse_frames_cap);
+                }
+                parse_frames[depth].start = top;
+                parse_frames[depth].end = tok.type == TOK_LPAREN ? TOK_RPAREN : TOK_RBRACE;
+                depth++;
+                continue;
+
+            case TOK_RPAREN:
+            case TOK_RBRACE:
+                if (tok.type == parse_frames[depth - 1].end) {
+                    /* 这一层结束：元素个数已知，cell 一次分配到位 */
+                    parse_frame* f = &parse_frames[--depth];
+                    int n = top - f->start;
+                    ele = f->end == TOK_RPAREN ? lval_sexpr() : lval_qexpr();
+                    if (n > 0) {
+                        ele->cell = malloc(sizeof(lval*) * n);
+                        memcpy(ele->cell, parse_items + f->start, sizeof(lval*) * n);
+                        ele->count = n;
+                    }
+                    top = f->start;
+                    ele = lval_pack(ele);
+                    if (depth == 0) {
+                        parse_stack_trim();
+                        return ele;
+                    }
+                    break;
+                }
+                /* 括号类型不匹配，与原子位置上出现右括号一样报错 */
+                ele = parse_atom(tok);
+                break;
+
+            default:
+                ele = parse_atom(tok);
         }
 
         if (ele->type == LVAL_ERR) {
-            lval_del(res);
-            return ele;
+            return parse_fail(0, top, ele);
         }
-
-        lval_add(res, ele);
-        tok = next_token(t);
+        if (top == parse_items_cap) {
+            parse_items_cap = parse_items_cap ? parse_items_cap * 2 : 256;
+            parse_items = realloc(parse_items, sizeof(lval*) * parse_items_cap);
+        }
+        parse_items[top++] = ele;
     }
+}
 
-    if (tok.type != end_type) {
-        lval_del(res);
-        return lval_err("Missing closing parenthesis/brace");
-    }
-    return res;
+/* 解析一个顶层表达式，输入结束时返回 NULL */
+lval* parse_form(Tokenizer* t) {
+    Token tok = next_token(t);
+    if (tok.type == TOK_EOF) { return NULL; }
+    if (tok.type == TOK_ERR) { return lval_err(tok.error); }
+    if (tok.type == TOK_LPAREN) { return parse_expr_list(t, TOK_RPAREN); }
+    if (tok.type == TOK_LBRACE) { return parse_expr_list(t, TOK_RBRACE); }
+    return parse_atom(tok);
 }
 
 lval* lval_parse(char* input) {
     Tokenizer t = tokenizer_new(input);
     lval* res = lval_sexpr();
-    Token tok = next_token(&t);
-
-    while (tok.type != TOK_EOF) {
-        if (tok.type == TOK_ERR) {
-            lval_del(res);
-            return lval_err(tok.error);
-        }
-
-        lval* ele = NULL;
-        if (tok.type == TOK_LPAREN) {
-            ele = parse_expr_list(&t, TOK_RPAREN);
-        } else if (tok.type == TOK_LBRACE) {
-            ele = parse_expr_list(&t, TOK_RBRACE);
-        } else {
-            ele = parse_atom(tok);
-        }
+    lval* ele;
 
+    while ((ele = parse_form(&t))) {
         if (ele->type == LVAL_ERR) {
             lval_del(res);
             return ele;
         }
-
         lval_add(res, ele);
-        tok = next_token(&t);
     }
     return res;
 }
@@ -74,18 +74,64 @@ int main(int argc, char** argv) {
 
   lval_pool_init();
 
+  /*
+     --dump-image <file>  加载 prelude (和后面给出的脚本) 后把全局环境写入镜像文件，然后退出
+     --image <file>       从镜像恢复全局环境，不再解析和求值 prelude；镜像无效时退回正常启动
+  */
+  char* dump_image = NULL;
+  char* image = NULL;
+  int first = 1;
+  while (first < argc) {
+    if (strcmp(argv[first], "--dump-image") == 0 && first + 1 < argc) {
+      dump_image = argv[first + 1];
+    } else if (strcmp(argv[first], "--image") == 0 && first + 1 < argc) {
+      image = argv[first + 1];
+    } else {
+      break;
+    }
+    first += 2;
+  }
+
   lenv* e = lenv_new();
-  lenv_add_builtins(e);
+  if (image) {
+    lval* x = lenv_load_image(e, image);
+    if (x->type == LVAL_ERR) {
+      lval_println(x);
+      lenv_del(e);
+      e = lenv_new();
+      image = NULL;
+    }
+    lval_del(x);
+  }
+
+  if (!image) {
+    lenv_add_builtins(e);
+
+    /* Load Standard Library */
+    lval* args = lval_add(lval_sexpr(), lval_str("chapter/prelude.lspy"));
+    lval* x = builtin_load(e, args);
+    if (x->type == LVAL_ERR) { lval_println(x); }
+    lval_del(x);
+  }
 
-  /* Load Standard Library */
-  lval* args = lval_add(lval_sexpr(), lval_str("chapter/prelude.lspy"));
-  lval* x = builtin_load(e, args);
-  if (x->type == LVAL_ERR) { lval_println(x); }
-  lval_del(x);
+  if (dump_image) {
+    for (int i = first; i < argc; i++) {
+      lval* x = builtin_load(e, lval_add(lval_sexpr(), lval_str(argv[i])));
+      if (x->type == LVAL_ERR) { lval_println(x); }
+      lval_del(x);
+    }
+    lval* x = lenv_dump_image(e, dump_image);
+    int failed = x->type == LVAL_ERR;
+    if (failed) { lval_println(x); }
+    lval_del(x);
+    lenv_del(e);
+    lval_pool_cleanup();
+    return failed;
+  }
 
-  if (argc >= 2) {
-    /* loop over each supplied filename (starting from 1) */
-    for (int i = 1; i < argc; i++) {
+  if (argc > first) {
+    /* loop over each supplied filename */
+    for (int i = first; i < argc; i++) {
       lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
       lval* x = builtin_load(e, args);
       if (x->type == LVAL_ERR) { lval_println(x); }
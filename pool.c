@@ -3,16 +3,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
-/* Global free list head */
-static lval* free_list = NULL;
+/* Free list head, one per thread so parser threads can allocate without locking.
+   The tail is tracked too so a whole list can be handed over in O(1). */
+static __thread lval* free_list = NULL;
+static __thread lval* free_tail = NULL;
 
-/* Statistics (optional, for debugging) */
-long pool_count = 0;      // Number of free objects in pool
-long total_allocs = 0;    // Total system mallocs performed
+/* lval 按块向系统申请，一次申请 POOL_BLOCK 个，减少 malloc 次数并让相邻分配的对象在内存中连续 */
+#define POOL_BLOCK 256
+
+typedef struct pool_block {
+    struct pool_block* next;
+    lval items[POOL_BLOCK];
+} pool_block;
+
+/* 对象可能在一个线程分配、在另一个线程释放，所以块由全局链表统一持有，只在退出时释放 */
+static pool_block* blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 线程之间交换空闲对象的公共仓库：并行解析前主线程把空闲对象放进来，
+   工作线程的池用完时先从这里一次取一批，用不完的在结束时放回 */
+static lval* depot_head = NULL;
+static lval* depot_tail = NULL;
+static long depot_count = 0;
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics (optional, for debugging), per thread */
+__thread long pool_count = 0;      // Number of free objects in pool
+__thread long total_allocs = 0;    // Total system mallocs performed
 
 void lval_pool_init(void) {
     free_list = NULL;
+    free_tail = NULL;
     pool_count = 0;
     total_allocs = 0;
 }
@@ -24,21 +47,63 @@ void lval_pool_print_stats(void) {
     printf("==============================\n");
 }
 
+/* 从仓库取最多 POOL_BLOCK 个对象作为当前线程的空闲链表，仓库为空时返回 0 */
+static int pool_refill_from_depot(void) {
+    /* 不加锁的预检查，只是为了避开单线程时的加锁开销 */
+    if (__atomic_load_n(&depot_head, __ATOMIC_RELAXED) == NULL) return 0;
+
+    pthread_mutex_lock(&depot_lock);
+    lval* head = depot_head;
+    lval* tail = head;
+    long n = 0;
+    if (head) {
+        n = 1;
+        while (n < POOL_BLOCK && tail->body) {
+            tail = tail->body;
+            n++;
+        }
+        __atomic_store_n(&depot_head, tail->body, __ATOMIC_RELAXED);
+        if (depot_head == NULL) depot_tail = NULL;
+        depot_count -= n;
+    }
+    pthread_mutex_unlock(&depot_lock);
+
+    if (n == 0) return 0;
+    tail->body = NULL;
+    free_list = head;
+    free_tail = tail;
+    pool_count += n;
+    return 1;
+}
+
 lval* lval_alloc(void) {
-    if (free_list == NULL) {
-        // Pool is empty, request from OS
-        total_allocs++;
-        return malloc(sizeof(lval));
-    } else {
-        // Reuse from pool
-        lval* v = free_list;
-        
-        // Move head to next (reuse body as next pointer)
-        free_list = v->body; 
-        
-        pool_count--;
-        return v;
+    if (free_list == NULL && !pool_refill_from_depot()) {
+        // Pool is empty, request a whole block from OS and put all but one on the free list
+        pool_block* b = malloc(sizeof(pool_block));
+        pthread_mutex_lock(&blocks_lock);
+        b->next = blocks;
+        blocks = b;
+        pthread_mutex_unlock(&blocks_lock);
+        b->items[POOL_BLOCK - 1].body = NULL;
+        for (int i = POOL_BLOCK - 2; i > 0; i--) {
+            b->items[i].body = &b->items[i + 1];
+        }
+        free_list = &b->items[1];
+        free_tail = &b->items[POOL_BLOCK - 1];
+        pool_count += POOL_BLOCK - 1;
+        total_allocs += POOL_BLOCK;
+        return &b->items[0];
     }
+
+    // Reuse from pool
+    lval* v = free_list;
+
+    // Move head to next (reuse body as next pointer)
+    free_list = v->body;
+    if (free_list == NULL) free_tail = NULL;
+
+    pool_count--;
+    return v;
 }
 
 void lval_release(lval* v) {
@@ -47,20 +112,53 @@ void lval_release(lval* v) {
     // Insert v at head of free list
     // Reuse body field to point to old head
     v->body = free_list;
+    if (free_list == NULL) free_tail = v;
     free_list = v;
     
     pool_count++;
 }
 
+/* 把当前线程的全部空闲对象移入公共仓库 */
+void lval_pool_share(void) {
+    if (free_list == NULL) return;
+    pthread_mutex_lock(&depot_lock);
+    free_tail->body = depot_head;
+    if (depot_head == NULL) depot_tail = free_tail;
+    __atomic_store_n(&depot_head, free_list, __ATOMIC_RELAXED);
+    depot_count += pool_count;
+    pthread_mutex_unlock(&depot_lock);
+
+    free_list = free_tail = NULL;
+    pool_count = 0;
+}
+
+/* 把公共仓库中的全部对象收回当前线程的池 */
+void lval_pool_reclaim(void) {
+    pthread_mutex_lock(&depot_lock);
+    if (depot_head) {
+        depot_tail->body = free_list;
+        if (free_list == NULL) free_tail = depot_tail;
+        free_list = depot_head;
+        pool_count += depot_count;
+        __atomic_store_n(&depot_head, NULL, __ATOMIC_RELAXED);
+        depot_tail = NULL;
+        depot_count = 0;
+    }
+    pthread_mutex_unlock(&depot_lock);
+}
+
 void lval_pool_cleanup(void) {
-    lval* curr = free_list;
-    while (curr) {
-        lval* next = curr->body;
-        free(curr); // Actually free to OS
-        curr = next;
+    pthread_mutex_lock(&blocks_lock);
+    while (blocks) {
+        pool_block* next = blocks->next;
+        free(blocks); // Actually free to OS
+        blocks = next;
     }
-    free_list = NULL;
+    pthread_mutex_unlock(&blocks_lock);
+    free_list = free_tail = NULL;
     pool_count = 0;
+    depot_head = depot_tail = NULL;
+    depot_count = 0;
 }
 
 void lval_pool_dump_log(const char* filename) {
@@ -17,6 +17,11 @@ lval* lval_alloc(void);
 /* Return an lval to the pool (replaces free(v) for the struct only) */
 void lval_release(lval* v);
 
+/* Hand this thread's free objects to a shared depot / take them all back.
+   Worker threads refill from the depot before asking the OS (used by the parallel parser) */
+void lval_pool_share(void);
+void lval_pool_reclaim(void);
+
 /* Cleanup all memory in the pool (call at program exit) */
 void lval_pool_cleanup(void);
 
@@ -0,0 +1,278 @@
+#include "config.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+
+/*
+   reader.c
+   流式读取源文件。
+   缓冲区固定大小，用完后从文件描述符继续读入；边界扫描器跟踪括号深度、字符串和注释，
+   找到一个完整的顶层表达式后只把这一段交给 parse_form，
+   所以 load 可以"解析一个、求值一个、释放一个"，内存占用与文件大小无关。
+   缓冲区只会在单个表达式比它还大时扩容。
+*/
+
+lreader* lreader_open(char* filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return NULL; }
+  tokenizer_init();
+
+  lreader* r = malloc(sizeof(lreader));
+  r->fd = fd;
+  r->cap = READER_BUF_SIZE;
+  r->buf = malloc(r->cap);
+  r->start = r->end = r->scan = 0;
+  r->depth = 0;
+  r->in_str = r->in_esc = r->in_comment = r->in_atom = 0;
+  r->eof = 0;
+  return r;
+}
+
+void lreader_close(lreader* r) {
+  close(r->fd);
+  free(r->buf);
+  free(r);
+}
+
+/* 把未处理的数据移到缓冲区开头，需要时扩容，再从文件读入一块 */
+static void reader_fill(lreader* r) {
+  if (r->start > 0) {
+    memmove(r->buf, r->buf + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->scan -= r->start;
+    r->start = 0;
+  }
+  if (r->end == r->cap) {
+    r->cap *= 2;
+    r->buf = realloc(r->buf, r->cap);
+  }
+
+  ssize_t n;
+  do {
+    n = read(r->fd, r->buf + r->end, r->cap - r->end);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0) { r->eof = 1; return; }
+  r->end += n;
+}
+
+static int is_delim(char c) {
+  return isspace((unsigned char)c) || c == '(' || c == ')' || c == '{' || c == '}' || c == ';' || c == '"';
+}
+
+/* 从上次停下的位置继续扫描，返回下一个顶层表达式的结束位置；数据不够时返回 -1。
+   括号内部直接跳到下一个括号/引号/分号，字符串内跳到下一个引号/反斜杠，注释用 memchr 找换行 */
+static long reader_scan(lreader* r) {
+  const char* base = r->buf;
+  const char* end = r->buf + r->end;
+
+  while (r->scan < r->end) {
+    const char* p = base + r->scan;
+
+    if (r->in_comment) {
+      const char* nl = memchr(p, '\n', end - p);
+      if (!nl) { r->scan = r->end; break; }
+      r->in_comment = 0;
+      r->scan = nl - base + 1;
+      continue;
+    }
+
+    if (r->in_str) {
+      if (r->in_esc) {
+        r->in_esc = 0;
+        r->scan++;
+        continue;
+      }
+      p = tok_find_quote(p, end);
+      r->scan = p - base;
+      if (p >= end) { break; }
+      r->scan++;
+      if (*p == '\\') {
+        r->in_esc = 1;
+      } else {
+        r->in_str = 0;
+        if (r->depth == 0) { return r->scan; }
+      }
+      continue;
+    }
+
+    if (r->in_atom) {
+      /* 原子在分隔符处结束，分隔符本身留给下一个表达式 */
+      if (is_delim(*p)) { return r->scan; }
+      r->scan++;
+      continue;
+    }
+
+    if (r->depth > 0) {
+      p = tok_find_structural(p, end);
+      r->scan = p - base;
+      if (p >= end) { break; }
+    }
+
+    switch (*p) {
+      case ';': r->in_comment = 1; break;
+      case '"': r->in_str = 1; break;
+      case '(':
+      case '{': r->depth++; break;
+      case ')':
+      case '}':
+        /* 顶层多出来的右括号也单独作为一个"表达式"，由解析器报错 */
+        if (r->depth > 0) { r->depth--; }
+        if (r->depth == 0) { return ++r->scan; }
+        break;
+      default:
+        if (r->depth == 0 && !isspace((unsigned char)*p)) { r->in_atom = 1; }
+    }
+    r->scan++;
+  }
+  return -1;
+}
+
+static void reader_reset_scan(lreader* r) {
+  r->scan = r->start;
+  r->depth = 0;
+  r->in_str = r->in_esc = r->in_comment = r->in_atom = 0;
+}
+
+/* 读取并解析下一个顶层表达式，文件结束时返回 NULL */
+lval* lreader_next(lreader* r) {
+  long stop;
+  while ((stop = reader_scan(r)) < 0 && !r->eof) {
+    reader_fill(r);
+  }
+  /* 文件结束时剩下的内容整体交给解析器，不完整的表达式由它报告错误 */
+  if (stop < 0) { stop = r->end; }
+
+  Tokenizer t;
+  t.src = r->buf + r->start;
+  t.pos = 0;
+  t.len = stop - r->start;
+  lval* x = parse_form(&t);
+
+  /* 以解析器实际消耗的位置为准，重新开始扫描 */
+  r->start += t.pos;
+  reader_reset_scan(r);
+  return x;
+}
+
+/* --- 并行解析 ---
+   每批从缓冲区取出约 nthreads * LOAD_CHUNK_SIZE 字节的完整顶层表达式，
+   在表达式边界处切成 nthreads 段，每段由一个线程解析。
+   lval 内存池是线程局部的 (见 pool.c)，所以各线程分配互不干扰；
+   主线程在每批开始前把自己池中的空闲对象放进公共仓库供各线程取用，结束后全部收回，
+   避免求值时释放到主线程池里的对象越积越多。
+   各段的结果按原来的顺序拼接，求值仍然在主线程上按文件顺序进行。 */
+
+typedef struct {
+  char* src;
+  int len;
+  lval* forms;      /* 解析出的表达式 (S-Expression) */
+  lval* err;        /* 解析错误，之前的表达式仍然保留在 forms 中 */
+} parse_job;
+
+static void* parse_worker(void* arg) {
+  parse_job* job = arg;
+
+  Tokenizer t;
+  t.src = job->src;
+  t.pos = 0;
+  t.len = job->len;
+
+  lval_vec items = {0};
+  lval* x;
+  job->err = NULL;
+  while ((x = parse_form(&t))) {
+    if (x->type == LVAL_ERR) { job->err = x; break; }
+    vec_push(&items, x);
+  }
+
+  job->forms = lval_sexpr();
+  job->forms->cell = items.items;
+  job->forms->count = items.count;
+
+  /* 解析器的元素栈是线程局部的，线程结束前释放 (主线程下一批会重新分配) */
+  parse_stack_free();
+  lval_pool_share();
+  return NULL;
+}
+
+/* 扫描出下一批完整的表达式，切分点 (相对 r->start 的偏移) 写入 cuts，返回段数 */
+static int reader_split(lreader* r, int nthreads, long* cuts) {
+  long chunk = LOAD_CHUNK_SIZE;
+  long last = 0;   /* 最后一段的起点 */
+  int n = 0;
+
+  reader_reset_scan(r);
+  for (;;) {
+    long stop = reader_scan(r);
+    if (stop < 0) {
+      if (!r->eof) {
+        reader_fill(r);
+        continue;
+      }
+      /* 剩下的内容 (可能是不完整的表达式) 作为最后一段，由解析器报告错误 */
+      if (r->end > r->start + last) { cuts[n++] = r->end - r->start; }
+      break;
+    }
+
+    /* 表达式结束，从它后面重新开始扫描 */
+    r->depth = 0;
+    r->in_str = r->in_esc = r->in_comment = r->in_atom = 0;
+    if (stop - r->start - last >= chunk) {
+      last = cuts[n++] = stop - r->start;
+      if (n == nthreads) { break; }
+    }
+  }
+  return n;
+}
+
+lval* lreader_next_batch(lreader* r, int nthreads) {
+  long cuts[nthreads];
+  int n = reader_split(r, nthreads, cuts);
+  if (n == 0) { return NULL; }
+
+  parse_job jobs[n];
+  pthread_t threads[n];
+  long from = 0;
+  for (int i = 0; i < n; i++) {
+    jobs[i].src = r->buf + r->start + from;
+    jobs[i].len = cuts[i] - from;
+    from = cuts[i];
+  }
+
+  lval_pool_share();
+  for (int i = 1; i < n; i++) {
+    pthread_create(&threads[i], NULL, parse_worker, &jobs[i]);
+  }
+  /* 第一段在当前线程上解析 */
+  parse_worker(&jobs[0]);
+  for (int i = 1; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  lval_pool_reclaim();
+
+  r->start += from;
+  reader_reset_scan(r);
+
+  /* 按原顺序拼接；遇到第一个解析错误时把它放在末尾，丢弃之后的段 */
+  lval* res = lval_sexpr();
+  lval_vec items = {0};
+  lval* err = NULL;
+  for (int i = 0; i < n; i++) {
+    if (!err) {
+      for (int j = 0; j < jobs[i].forms->count; j++) { vec_push(&items, jobs[i].forms->cell[j]); }
+      jobs[i].forms->count = 0;
+      err = jobs[i].err;
+    } else {
+      lval_del(jobs[i].err);
+    }
+    lval_del(jobs[i].forms);
+  }
+  if (err) { vec_push(&items, err); }
+  res->cell = items.items;
+  res->count = items.count;
+  return res;
+}
@@ -0,0 +1,1050 @@
+#define _GNU_SOURCE
+#include "config.h"
+#include "error.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+   serialize.c
+   lval 的紧凑二进制编码，以及基于它的堆镜像 (heap image)。
+   每个值以一个类型标记开头，整数和长度用 varint (负数先做 zigzag)，小数按 8 字节原样写入，
+   全数字列表的紧凑存储整块写出。符号和字符串经过字符串表：第一次出现时写出内容，
+   之后只写它在表中的编号。内置函数按名字编码，读回时在内置函数表里查找，
+   所以镜像不依赖函数地址，换一次编译也能用 (只要内置函数表没有变化)。
+
+   镜像就是全局环境的全部条目：--dump-image 在加载完 prelude 之后把它写入文件，
+   --image 启动时把文件 mmap 进来直接解码，跳过 prelude 的解析和求值。
+   同样的编码也用于 load 的编译缓存 (.lspyc)，见文件末尾。
+*/
+
+enum { SER_NUM, SER_DEC, SER_ERR, SER_SYM, SER_STR, SER_SEXPR, SER_QEXPR,
+       SER_PACKED, SER_ARR, SER_BUILTIN, SER_LAMBDA, SER_BYTES, SER_SEQ, SER_DICT };
+
+#define IMAGE_MAGIC "LSPYIMG"
+#define IMAGE_VERSION 2
+
+#define FNV_OFFSET 1469598103934665603UL
+#define FNV_PRIME 1099511628211UL
+
+/* 编码和解码的最大嵌套深度，超过时报错而不是耗尽 C 栈 */
+#ifndef SERIALIZE_MAX_DEPTH
+#define SERIALIZE_MAX_DEPTH 10000
+#endif
+
+/* 按 8 字节一组的 FNV-1a，剩余不足 8 字节的部分逐字节处理。
+   乘法只会把低位扩散到高位，最后再把高位混回低位，字符串表按低位取槽时才不会扎堆 */
+static unsigned long hash_bytes(unsigned long h, const unsigned char* p, long n) {
+  for (; n >= 8; p += 8, n -= 8) {
+    unsigned long w;
+    memcpy(&w, p, 8);
+    h = (h ^ w) * FNV_PRIME;
+  }
+  for (; n > 0; p++, n--) { h = (h ^ *p) * FNV_PRIME; }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdUL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* --- 内置函数表 --- */
+
+/* 名字 <-> 函数指针的对应关系直接取自 lenv_add_builtins 注册的环境 */
+static lenv* builtin_table(void) {
+  static lenv* table = NULL;
+  if (!table) {
+    table = lenv_new();
+    lenv_add_builtins(table);
+  }
+  return table;
+}
+
+static char* builtin_name(lbuiltin f) {
+  lenv* t = builtin_table();
+  for (int i = 0; i < t->count; i++) {
+    if (t->vals[i]->builtin == f) { return t->syms[i]; }
+  }
+  return NULL;
+}
+
+static lbuiltin builtin_lookup(const char* name) {
+  lenv* t = builtin_table();
+  for (int i = 0; i < t->count; i++) {
+    if (strcmp(t->syms[i], name) == 0) {
+      return t->vals[i]->builtin;
+    }
+  }
+  return NULL;
+}
+
+/* 内置函数表的指纹 (名字的 FNV-1a)，表有变化时旧镜像作废 */
+static unsigned long builtin_fingerprint(void) {
+  lenv* t = builtin_table();
+  unsigned long h = FNV_OFFSET;
+  for (int i = 0; i < t->count; i++) {
+    for (char* c = t->syms[i]; ; c++) {
+      h = (h ^ (unsigned char)*c) * FNV_PRIME;
+      if (!*c) { break; }
+    }
+  }
+  return h;
+}
+
+/* --- 编码 --- */
+
+/* 字符串表的一项：内容在名字池 (编码时) 或输入 (解码时) 中的位置 */
+typedef struct {
+  long off;
+  long len;
+  unsigned long hash;
+} ser_str;
+
+typedef struct {
+  char* data;
+  long len;
+  long cap;
+  lval* err;   /* 遇到无法编码的值时记录错误 */
+
+  /* 字符串表，slots 是开放寻址的哈希表，存 strs 的下标 + 1。
+     名字另存一份在 names 里，输出缓冲区的内容写出后表仍然可用 */
+  ser_str* strs;
+  long nstr;
+  long* slots;
+  long nslots;
+  char* names;
+  long names_len;
+  long names_cap;
+} ser_buf;
+
+static void ser_buf_free(ser_buf* b) {
+  free(b->data);
+  free(b->strs);
+  free(b->slots);
+  free(b->names);
+  memset(b, 0, sizeof(ser_buf));
+}
+
+static void ser_put(ser_buf* b, const void* p, long n) {
+  if (b->len + n > b->cap) {
+    while (b->len + n > b->cap) { b->cap = b->cap ? b->cap * 2 : 4096; }
+    b->data = realloc(b->data, b->cap);
+  }
+  memcpy(b->data + b->len, p, n);
+  b->len += n;
+}
+
+static void ser_byte(ser_buf* b, unsigned char c) {
+  if (b->len < b->cap) {
+    b->data[b->len++] = c;
+  } else {
+    ser_put(b, &c, 1);
+  }
+}
+
+static void ser_varint(ser_buf* b, unsigned long x) {
+  while (x >= 0x80) {
+    ser_byte(b, (unsigned char)(x | 0x80));
+    x >>= 7;
+  }
+  ser_byte(b, (unsigned char)x);
+}
+
+static void ser_bytes(ser_buf* b, const char* s, long n) {
+  ser_varint(b, n);
+  ser_put(b, s, n);
+}
+
+static void ser_table_grow(ser_buf* b) {
+  b->nslots = b->nslots ? b->nslots * 2 : 256;
+  free(b->slots);
+  b->slots = calloc(b->nslots, sizeof(long));
+  b->strs = realloc(b->strs, sizeof(ser_str) * (b->nslots / 2));
+  for (long k = 0; k < b->nstr; k++) {
+    long i = b->strs[k].hash & (b->nslots - 1);
+    while (b->slots[i]) { i = (i + 1) & (b->nslots - 1); }
+    b->slots[i] = k + 1;
+  }
+}
+
+/* 经过字符串表的名字：已经在表里时写编号 + 1，否则写 0、长度和内容并加入表中 */
+static void ser_name(ser_buf* b, const char* s) {
+  long n = strlen(s);
+  unsigned long h = hash_bytes(FNV_OFFSET, (const unsigned char*)s, n);
+  if (b->nstr * 2 >= b->nslots) { ser_table_grow(b); }
+
+  long i = h & (b->nslots - 1);
+  while (b->slots[i]) {
+    ser_str* e = &b->strs[b->slots[i] - 1];
+    if (e->hash == h && e->len == n && memcmp(b->names + e->off, s, n) == 0) {
+      ser_varint(b, b->slots[i]);
+      return;
+    }
+    i = (i + 1) & (b->nslots - 1);
+  }
+  ser_varint(b, 0);
+  ser_varint(b, n);
+  if (b->names_len + n > b->names_cap) {
+    while (b->names_len + n > b->names_cap) { b->names_cap = b->names_cap ? b->names_cap * 2 : 4096; }
+    b->names = realloc(b->names, b->names_cap);
+  }
+  memcpy(b->names + b->names_len, s, n);
+  b->strs[b->nstr] = (ser_str){ b->names_len, n, h };
+  b->names_len += n;
+  b->slots[i] = ++b->nstr;
+  ser_put(b, s, n);
+}
+
+static void ser_text(ser_buf* b, int tag, const char* s) {
+  ser_byte(b, tag);
+  ser_name(b, s);
+}
+
+static void ser_value(ser_buf* b, lval* v, int depth);
+
+/* 惰性序列：从下游到源依次写出每个节点 (阶段链不递归) */
+static void ser_seq(ser_buf* b, lval_seq_t* s, int depth) {
+  long n = 0;
+  for (lval_seq_t* x = s; x; x = x->parent) { n++; }
+  ser_byte(b, SER_SEQ);
+  ser_varint(b, n);
+  for (; s && !b->err; s = s->parent) {
+    ser_byte(b, s->kind);
+    ser_varint(b, ((unsigned long)s->start << 1) ^ (unsigned long)(s->start >> 63));
+    ser_varint(b, ((unsigned long)s->end << 1) ^ (unsigned long)(s->end >> 63));
+    ser_varint(b, ((unsigned long)s->step << 1) ^ (unsigned long)(s->step >> 63));
+    ser_byte(b, (s->fn ? 1 : 0) | (s->val ? 2 : 0));
+    if (s->fn) { ser_value(b, s->fn, depth + 1); }
+    if (s->val) { ser_value(b, s->val, depth + 1); }
+  }
+}
+
+static void ser_env(ser_buf* b, lenv* e, int depth) {
+  ser_varint(b, e->count);
+  for (int i = 0; i < e->count && !b->err; i++) {
+    ser_name(b, e->syms[i]);
+    ser_value(b, e->vals[i], depth);
+  }
+}
+
+static void ser_value(ser_buf* b, lval* v, int depth) {
+  if (b->err) { return; }
+  if (depth > SERIALIZE_MAX_DEPTH) {
+    b->err = lval_err("Value nesting exceeds the maximum of %d.", SERIALIZE_MAX_DEPTH);
+    return;
+  }
+
+  switch (v->type) {
+    case LVAL_NUM:
+      ser_byte(b, SER_NUM);
+      ser_varint(b, ((unsigned long)v->num << 1) ^ (unsigned long)(v->num >> 63));
+      break;
+    case LVAL_DEC:
+      ser_byte(b, SER_DEC);
+      ser_put(b, &v->dec, sizeof(double));
+      break;
+    case LVAL_ERR: ser_text(b, SER_ERR, v->err); break;
+    case LVAL_SYM: ser_text(b, SER_SYM, v->sym); break;
+    case LVAL_STR: ser_text(b, SER_STR, v->str); break;
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      if (v->arr && v->arr->kind != ARR_LVAL) {
+        ser_byte(b, SER_PACKED);
+        ser_byte(b, v->arr->kind);
+        ser_varint(b, v->count);
+        ser_put(b, v->arr->data, v->count * (v->arr->kind == ARR_I64 ? sizeof(long) : sizeof(double)));
+        break;
+      }
+      ser_byte(b, v->type == LVAL_SEXPR ? SER_SEXPR : SER_QEXPR);
+      ser_varint(b, v->count);
+      for (int i = 0; i < v->count; i++) { ser_value(b, lval_elems(v)[i], depth + 1); }
+      break;
+    case LVAL_ARR:
+      ser_byte(b, SER_ARR);
+      ser_byte(b, v->arr->kind);
+      ser_varint(b, v->arr->count);
+      ser_put(b, v->arr->data, v->arr->count * (v->arr->kind == ARR_I64 ? sizeof(long) : sizeof(double)));
+      break;
+    case LVAL_FUN:
+      if (v->builtin) {
+        char* name = builtin_name(v->builtin);
+        if (!name) {
+          b->err = lval_err("Cannot serialize an unregistered builtin.");
+          return;
+        }
+        ser_byte(b, SER_BUILTIN);
+        ser_name(b, name);
+      } else {
+        ser_byte(b, SER_LAMBDA);
+        ser_env(b, v->env, depth + 1);
+        ser_value(b, v->formals, depth + 1);
+        ser_value(b, v->body, depth + 1);
+      }
+      break;
+    case LVAL_BYTES:
+      ser_byte(b, SER_BYTES);
+      ser_bytes(b, (const char*)v->bytes->data, v->bytes->len);
+      break;
+    case LVAL_SEQ:
+      ser_seq(b, v->seq, depth);
+      break;
+    case LVAL_DICT:
+      ser_byte(b, SER_DICT);
+      ser_varint(b, v->dict->count);
+      for (int i = 0; i < v->dict->count; i++) {
+        ser_name(b, v->dict->keys[i]);
+        ser_value(b, v->dict->vals[i], depth + 1);
+      }
+      break;
+    default:
+      /* 文件句柄依赖运行时状态，不能写出 */
+      b->err = lval_err("Cannot serialize a value of type %s.", ltype_name(v->type));
+  }
+}
+
+/* --- 解码 --- */
+
+typedef struct {
+  const unsigned char* p;
+  const unsigned char* end;
+  int bad;     /* 数据截断或格式错误 */
+
+  /* 字符串表，off 是相对 base 的偏移 */
+  const unsigned char* base;
+  ser_str* strs;
+  long nstr;
+  long cap;
+} ser_reader;
+
+static void ser_reader_init(ser_reader* r, const void* p, long len) {
+  memset(r, 0, sizeof(ser_reader));
+  r->p = r->base = p;
+  r->end = r->p + len;
+}
+
+static void ser_reader_free(ser_reader* r) {
+  free(r->strs);
+  r->strs = NULL;
+  r->nstr = r->cap = 0;
+}
+
+static int ser_get_byte(ser_reader* r) {
+  if (r->p >= r->end) { r->bad = 1; return -1; }
+  return *r->p++;
+}
+
+static unsigned long ser_get_varint(ser_reader* r) {
+  unsigned long x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (r->p >= r->end) { r->bad = 1; return 0; }
+    unsigned char c = *r->p++;
+    x |= (unsigned long)(c & 0x7f) << shift;
+    if (!(c & 0x80)) { return x; }
+  }
+  r->bad = 1;
+  return 0;
+}
+
+/* 读出一段字节，返回它在输入中的位置；长度不对时标记为错误 */
+static const char* ser_get_bytes(ser_reader* r, long* n) {
+  unsigned long len = ser_get_varint(r);
+  if (r->bad || len > (unsigned long)(r->end - r->p)) { r->bad = 1; *n = 0; return NULL; }
+  const char* s = (const char*)r->p;
+  r->p += len;
+  *n = len;
+  return s;
+}
+
+/* 读出一个经过字符串表的名字，返回新分配的副本 */
+static char* ser_get_text(ser_reader* r) {
+  unsigned long k = ser_get_varint(r);
+  if (r->bad) { return NULL; }
+  if (k > 0) {
+    if (k > (unsigned long)r->nstr) { r->bad = 1; return NULL; }
+    ser_str* e = &r->strs[k - 1];
+    char* str = malloc(e->len + 1);
+    memcpy(str, r->base + e->off, e->len);
+    str[e->len] = '\0';
+    return str;
+  }
+  long n;
+  const char* s = ser_get_bytes(r, &n);
+  if (!s) { return NULL; }
+  if (r->nstr == r->cap) {
+    r->cap = r->cap ? r->cap * 2 : 256;
+    r->strs = realloc(r->strs, sizeof(ser_str) * r->cap);
+  }
+  r->strs[r->nstr++] = (ser_str){ (const unsigned char*)s - r->base, n, 0 };
+  char* str = malloc(n + 1);
+  memcpy(str, s, n);
+  str[n] = '\0';
+  return str;
+}
+
+static lval* ser_read_value(ser_reader* r, int depth);
+
+static lval* ser_read_seq(ser_reader* r, int depth) {
+  unsigned long n = ser_get_varint(r);
+  if (r->bad || n == 0 || n > (unsigned long)(r->end - r->p)) { r->bad = 1; return NULL; }
+
+  /* 节点按从下游到源的顺序写出，逐个挂到上一个节点的 parent 上 */
+  lval_seq_t* head = NULL;
+  lval_seq_t** link = &head;
+  for (unsigned long i = 0; i < n && !r->bad; i++) {
+    int kind = ser_get_byte(r);
+    unsigned long z[3];
+    for (int j = 0; j < 3; j++) { z[j] = ser_get_varint(r); }
+    int flags = ser_get_byte(r);
+    if (r->bad || kind < SEQ_RANGE || kind > SEQ_CSV) { r->bad = 1; break; }
+
+    lval_seq_t* s = malloc(sizeof(lval_seq_t));
+    s->ref_count = 1;
+    s->kind = kind;
+    s->parent = NULL;
+    s->start = (long)(z[0] >> 1) ^ -(long)(z[0] & 1);
+    s->end = (long)(z[1] >> 1) ^ -(long)(z[1] & 1);
+    s->step = (long)(z[2] >> 1) ^ -(long)(z[2] & 1);
+    s->fn = (flags & 1) ? ser_read_value(r, depth + 1) : NULL;
+    s->val = (flags & 2) && !r->bad ? ser_read_value(r, depth + 1) : NULL;
+    *link = s;
+    link = &s->parent;
+  }
+  /* 源节点不能再有上游，阶段节点必须有上游 */
+  if (!r->bad) {
+    for (lval_seq_t* s = head; s; s = s->parent) {
+      int is_source = s->kind == SEQ_RANGE || s->kind == SEQ_ITERATE || s->kind == SEQ_LIST || s->kind == SEQ_CSV;
+      if (is_source != (s->parent == NULL)
+          || ((s->kind == SEQ_LIST) && (!s->val || s->val->type != LVAL_QEXPR))
+          || ((s->kind == SEQ_CSV) && (!s->val || s->val->type != LVAL_STR))
+          || ((s->kind == SEQ_ITERATE || s->kind == SEQ_MAP || s->kind == SEQ_FILTER)
+              && (!s->fn || s->fn->type != LVAL_FUN))) {
+        r->bad = 1;
+      }
+    }
+  }
+  if (r->bad) {
+    lval_seq_release(head);
+    return NULL;
+  }
+  lval* v = lval_alloc();
+  v->type = LVAL_SEQ;
+  v->seq = head;
+  return v;
+}
+
+/* 紧凑存储的数字数组，数据整块复制 */
+static lval_arr_t* ser_read_arr(ser_reader* r, long* count) {
+  int kind = ser_get_byte(r);
+  unsigned long n = ser_get_varint(r);
+  size_t size = kind == ARR_I64 ? sizeof(long) : sizeof(double);
+  if (r->bad || (kind != ARR_I64 && kind != ARR_F64) || n > (unsigned long)(r->end - r->p) / size) {
+    r->bad = 1;
+    return NULL;
+  }
+  lval* tmp = lval_arr(kind, n);
+  lval_arr_t* s = tmp->arr;
+  s->ref_count++;
+  lval_del(tmp);
+  memcpy(s->data, r->p, n * size);
+  r->p += n * size;
+  *count = n;
+  return s;
+}
+
+static lval* ser_read_lambda(ser_reader* r, int depth) {
+  lenv* env = lenv_new();
+  unsigned long n = ser_get_varint(r);
+  for (unsigned long i = 0; i < n && !r->bad; i++) {
+    char* sym = ser_get_text(r);
+    lval* val = sym ? ser_read_value(r, depth + 1) : NULL;
+    if (!val) { free(sym); break; }
+    env->count++;
+    env->syms = realloc(env->syms, sizeof(char*) * env->count);
+    env->vals = realloc(env->vals, sizeof(lval*) * env->count);
+    env->syms[env->count-1] = sym;
+    env->vals[env->count-1] = val;
+  }
+  lval* formals = r->bad ? NULL : ser_read_value(r, depth + 1);
+  lval* body = r->bad ? NULL : ser_read_value(r, depth + 1);
+  if (r->bad) {
+    lval_del(formals);
+    lval_del(body);
+    lenv_del(env);
+    return NULL;
+  }
+  lval* f = lval_lambda(formals, body);
+  lenv_del(f->env);
+  f->env = env;
+  return f;
+}
+
+/* 解码一个值，出错时返回 NULL 并设置 r->bad */
+static lval* ser_read_value(ser_reader* r, int depth) {
+  if (depth > SERIALIZE_MAX_DEPTH) { r->bad = 1; return NULL; }
+
+  int tag = ser_get_byte(r);
+  switch (tag) {
+    case SER_NUM: {
+      unsigned long z = ser_get_varint(r);
+      return r->bad ? NULL : lval_num((long)(z >> 1) ^ -(long)(z & 1));
+    }
+    case SER_DEC: {
+      double d;
+      if (r->end - r->p < (long)sizeof(double)) { r->bad = 1; return NULL; }
+      memcpy(&d, r->p, sizeof(double));
+      r->p += sizeof(double);
+      return lval_dec(d);
+    }
+    case SER_ERR: case SER_SYM: case SER_STR: {
+      char* s = ser_get_text(r);
+      if (!s) { return NULL; }
+      lval* v = lval_alloc();
+      v->type = tag == SER_ERR ? LVAL_ERR : tag == SER_SYM ? LVAL_SYM : LVAL_STR;
+      if (tag == SER_ERR) { v->err = s; }
+      if (tag == SER_SYM) { v->sym = s; }
+      if (tag == SER_STR) { v->str = s; }
+      return v;
+    }
+    case SER_SEXPR: case SER_QEXPR: {
+      unsigned long n = ser_get_varint(r);
+      /* 每个元素至少占一个字节，先检查长度再分配 */
+      if (r->bad || n > (unsigned long)(r->end - r->p)) { r->bad = 1; return NULL; }
+      lval* v = tag == SER_SEXPR ? lval_sexpr() : lval_qexpr();
+      v->cell = malloc(sizeof(lval*) * (n ? n : 1));
+      for (unsigned long i = 0; i < n; i++) {
+        lval* x = ser_read_value(r, depth + 1);
+        if (!x) { lval_del(v); return NULL; }
+        v->cell[v->count++] = x;
+      }
+      return v;
+    }
+    case SER_PACKED: case SER_ARR: {
+      long count;
+      lval_arr_t* s = ser_read_arr(r, &count);
+      if (!s) { return NULL; }
+      lval* v = tag == SER_ARR ? lval_alloc() : lval_qexpr();
+      if (tag == SER_ARR) { v->type = LVAL_ARR; }
+      v->arr = s;
+      v->count = count;
+      return v;
+    }
+    case SER_BUILTIN: {
+      char* name = ser_get_text(r);
+      lbuiltin f = name ? builtin_lookup(name) : NULL;
+      free(name);
+      if (!f) { r->bad = 1; return NULL; }
+      return lval_fun(f);
+    }
+    case SER_LAMBDA:
+      return ser_read_lambda(r, depth);
+    case SER_BYTES: {
+      long n;
+      const char* data = ser_get_bytes(r, &n);
+      if (!data) { return NULL; }
+      unsigned char* copy = malloc(n ? n : 1);
+      memcpy(copy, data, n);
+      return lval_bytes(copy, n);
+    }
+    case SER_SEQ:
+      return ser_read_seq(r, depth);
+    case SER_DICT: {
+      unsigned long n = ser_get_varint(r);
+      if (r->bad || n > (unsigned long)(r->end - r->p)) { r->bad = 1; return NULL; }
+      lval* d = lval_dict();
+      for (unsigned long i = 0; i < n; i++) {
+        char* key = ser_get_text(r);
+        lval* x = key ? ser_read_value(r, depth + 1) : NULL;
+        if (!x) {
+          free(key);
+          lval_del(d);
+          return NULL;
+        }
+        lval_dict_put(d, key, x);
+      }
+      return d;
+    }
+  }
+  r->bad = 1;
+  return NULL;
+}
+
+/* --- serialize / deserialize ---
+   (serialize v) 返回 Bytes，(serialize v "file") 写入文件；
+   (deserialize b) 从 Bytes 解码，(deserialize "file") 从 serialize 写出的文件解码。
+   数据头: "LSB" + 版本号 + sizeof(long) + 字节序标记，之后是一个值。 */
+
+#define SER_MAGIC "LSB"
+#define SER_VERSION 1
+
+static void ser_header(ser_buf* b) {
+  ser_put(b, SER_MAGIC, sizeof(SER_MAGIC) - 1);
+  ser_byte(b, SER_VERSION);
+  ser_byte(b, sizeof(long));
+  unsigned short order = 0x0102;
+  ser_put(b, &order, sizeof(order));
+}
+
+static lval* ser_decode(const unsigned char* data, long len) {
+  ser_buf h = {0};
+  ser_header(&h);
+  long hlen = h.len;
+  int ok = len >= hlen && memcmp(data, h.data, hlen) == 0;
+  ser_buf_free(&h);
+  if (!ok) { return lval_err("Function 'deserialize' passed data that was not produced by serialize."); }
+
+  ser_reader r;
+  ser_reader_init(&r, data + hlen, len - hlen);
+  lval* x = ser_read_value(&r, 0);
+  ser_reader_free(&r);
+  if (!x || r.p != r.end) {
+    lval_del(x);
+    return lval_err("Function 'deserialize' passed truncated or corrupt data.");
+  }
+  return x;
+}
+
+lval* builtin_serialize(lenv* e, lval* a) {
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function 'serialize' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
+  if (a->count == 2) { LASSERT_TYPE("serialize", a, 1, LVAL_STR); }
+
+  ser_buf b = {0};
+  ser_header(&b);
+  ser_value(&b, a->cell[0], 0);
+  if (b.err) {
+    lval* err = b.err;
+    b.err = NULL;
+    ser_buf_free(&b);
+    lval_del(a);
+    return err;
+  }
+
+  if (a->count == 2) {
+    char* filename = a->cell[1]->str;
+    FILE* f = fopen(filename, "wb");
+    lval* res;
+    if (!f) {
+      res = lval_err("Could not open file %s", filename);
+    } else {
+      size_t written = fwrite(b.data, 1, b.len, f);
+      int failed = fclose(f) != 0 || written != (size_t)b.len;
+      res = failed ? lval_err("Could not write file %s", filename) : lval_sym("ok");
+    }
+    ser_buf_free(&b);
+    lval_del(a);
+    return res;
+  }
+
+  /* 输出缓冲区直接交给 Bytes，不再复制 */
+  unsigned char* data = realloc(b.data, b.len);
+  long len = b.len;
+  b.data = NULL;
+  ser_buf_free(&b);
+  lval_del(a);
+  return lval_bytes(data, len);
+}
+
+lval* builtin_deserialize(lenv* e, lval* a) {
+  LASSERT_NUM("deserialize", a, 1);
+  LASSERT(a, a->cell[0]->type == LVAL_BYTES || a->cell[0]->type == LVAL_STR,
+    "Function 'deserialize' passed incorrect type for argument 0. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[0]->type), ltype_name(LVAL_BYTES), ltype_name(LVAL_STR));
+
+  if (a->cell[0]->type == LVAL_BYTES) {
+    lval* x = ser_decode(a->cell[0]->bytes->data, a->cell[0]->bytes->len);
+    lval_del(a);
+    return x;
+  }
+
+  /* 文件直接 mmap 进来解码 */
+  char* filename = a->cell[0]->str;
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) { close(fd); }
+    lval* err = lval_err("Could not open file %s", filename);
+    lval_del(a);
+    return err;
+  }
+  lval_del(a);
+  if (st.st_size == 0) {
+    close(fd);
+    return ser_decode(NULL, 0);
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) { return lval_err("Could not map file"); }
+  lval* x = ser_decode(map, st.st_size);
+  munmap(map, st.st_size);
+  return x;
+}
+
+/* --- 堆镜像 ---
+   文件头: "LSPYIMG" + 版本号 (1 字节) + sizeof(long) + 字节序标记 + 内置函数表指纹，
+   之后是条目数和 (名字, 值) 序列，顺序与全局环境中的顺序一致。 */
+
+static void image_header(ser_buf* b) {
+  ser_put(b, IMAGE_MAGIC, sizeof(IMAGE_MAGIC) - 1);
+  ser_byte(b, IMAGE_VERSION);
+  ser_byte(b, sizeof(long));
+  unsigned short order = 0x0102;
+  ser_put(b, &order, sizeof(order));
+  ser_varint(b, builtin_fingerprint());
+}
+
+lval* lenv_dump_image(lenv* e, char* filename) {
+  while (e->par) { e = e->par; }
+
+  ser_buf b = {0};
+  image_header(&b);
+  ser_varint(&b, e->count);
+  for (int i = 0; i < e->count; i++) {
+    ser_name(&b, e->syms[i]);
+    ser_value(&b, e->vals[i], 0);
+    if (b.err) {
+      lval* err = lval_err("Could not write image: '%s': %s", e->syms[i], b.err->err);
+      lval_del(b.err);
+      ser_buf_free(&b);
+      return err;
+    }
+  }
+
+  FILE* f = fopen(filename, "wb");
+  if (!f) {
+    ser_buf_free(&b);
+    return lval_err("Could not open file %s", filename);
+  }
+  size_t written = fwrite(b.data, 1, b.len, f);
+  int failed = fclose(f) != 0 || written != (size_t)b.len;
+  ser_buf_free(&b);
+  if (failed) { return lval_err("Could not write image %s", filename); }
+  return lval_sym("ok");
+}
+
+lval* lenv_load_image(lenv* e, char* filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return lval_err("Could not open file %s", filename); }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return lval_err("Invalid image %s", filename);
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) { return lval_err("Could not map image %s", filename); }
+
+  /* 文件头必须与当前程序生成的完全一致 */
+  ser_buf h = {0};
+  image_header(&h);
+  ser_reader r;
+  ser_reader_init(&r, map, st.st_size);
+  if (st.st_size < h.len || memcmp(map, h.data, h.len) != 0) {
+    free(h.data);
+    munmap(map, st.st_size);
+    return lval_err("Image %s was built by a different version of lispy", filename);
+  }
+  r.p += h.len;
+  free(h.data);
+
+  /* 条目直接追加到环境末尾，镜像中的名字不会重复，不需要 lenv_put 的逐个查找 */
+  unsigned long n = ser_get_varint(&r);
+  if (!r.bad && n <= (unsigned long)(r.end - r.p)) {
+    e->syms = realloc(e->syms, sizeof(char*) * (e->count + n));
+    e->vals = realloc(e->vals, sizeof(lval*) * (e->count + n));
+    for (unsigned long i = 0; i < n; i++) {
+      char* sym = ser_get_text(&r);
+      lval* val = sym ? ser_read_value(&r, 0) : NULL;
+      if (!val) { free(sym); break; }
+      e->syms[e->count] = sym;
+      e->vals[e->count] = lval_share(val);
+      e->count++;
+    }
+  } else {
+    r.bad = 1;
+  }
+  munmap(map, st.st_size);
+  ser_reader_free(&r);
+
+  if (r.bad) { return lval_err("Image %s is truncated or corrupt", filename); }
+  return lval_sym("ok");
+}
+
+/* --- load 的编译缓存 ---
+   缓存文件头: "LSPYC" + 格式版本 + sizeof(long) + 字节序标记 + 构建指纹 + 源文件大小 + 源文件哈希 + 内容校验和，
+   之后是源文件中的顶层表达式依次序列化的结果。
+   命中时只需要对源文件算一遍哈希、对缓存内容算一遍校验和，然后逐个解码，不再做词法和语法分析。
+   未命中时表达式边解析边编码，每满 CACHE_BLOCK 字节就写入临时文件，内存里最多保留一块；
+   校验和按 CACHE_BLOCK 分块串联计算，写的时候不需要整个内容都在内存里。
+   CACHE_VERSION 只描述文件格式；解释器本身的变化由构建指纹检测 (见 cache_fingerprint)，
+   换了一个解析结果不同的解释器时旧缓存自动失效。 */
+
+#define CACHE_MAGIC "LSPYC"
+#define CACHE_VERSION 4
+#define CACHE_HEADER_SIZE (sizeof(CACHE_MAGIC) - 1 + 4 + 4 * 8)
+#define CACHE_BLOCK (64 * 1024)
+
+struct lcache {
+  char* path;           /* 缓存文件路径 */
+  unsigned long size;   /* 源文件大小 */
+  unsigned long hash;   /* 源文件哈希 */
+  int valid;
+
+  /* 命中：mmap 进来的缓存文件 */
+  void* map;
+  long map_len;
+  ser_reader r;
+
+  /* 未命中：表达式编码进 out，满一块就写入临时文件，load 成功后 link 成 tmp 再 rename */
+  ser_buf out;
+  char* tmp;
+  FILE* f;
+  int anon;              /* 临时文件还没有名字 (O_TMPFILE) */
+  unsigned long sum;     /* 已经写出的块的校验和 */
+  long written;          /* 已经写出的内容字节数 (不含文件头) */
+  int overflow;
+};
+
+/* 内容校验和：按 CACHE_BLOCK 分块串联，最后一块 (可能为空) 也算一次 */
+static unsigned long cache_sum(const unsigned char* p, long n) {
+  unsigned long h = FNV_OFFSET;
+  for (; n >= CACHE_BLOCK; p += CACHE_BLOCK, n -= CACHE_BLOCK) { h = hash_bytes(h, p, CACHE_BLOCK); }
+  return hash_bytes(h, p, n);
+}
+
+/* 缓存内容依赖的解释器构建：内置函数表、lval 布局和影响解析结果的常量，
+   再加上一段覆盖各种字面量语法的样例源码的解析结果。解析器的输出有任何变化时样例的编码随之变化，
+   不需要记得手动增加 CACHE_VERSION。只在第一次用到时计算一次 */
+static unsigned long cache_fingerprint(void) {
+  static unsigned long fp = 0;
+  if (fp) { return fp; }
+  long consts[] = { sizeof(lval), sizeof(long), LVAL_PACK_MIN, PARSE_MAX_DEPTH, SERIALIZE_MAX_DEPTH };
+  unsigned long h = hash_bytes(builtin_fingerprint(), (unsigned char*)consts, sizeof(consts));
+
+  char sample[] =
+    "(def {f} (\\ {x & xs} {if (> x 0.5) {head xs} {tail xs}}))\n"
+    "; comment\n"
+    "{1 2 3 4 5 6 7 8 9 10} {1.5 -2.25 3e10 4 5 6 7 8 9 10} {\"a\\n\\t\\\"b\" sym -7 +x}\n"
+    "9223372036854775807 -9223372036854775808 92233720368547758070 0.1 1e-320 1.7976931348623157e308\n"
+    "(+ 1 (- 2 3)) {} ()";
+  tokenizer_init();
+  lval* x = lval_parse(sample);
+  ser_buf b = {0};
+  ser_value(&b, x, 0);
+  h = hash_bytes(h, (unsigned char*)b.data, b.len);
+  ser_buf_free(&b);
+  lval_del(x);
+  fp = h ? h : 1;
+  return fp;
+}
+
+/* 计算源文件的大小和哈希，失败或文件大于 LOAD_CACHE_MAX 时返回 -1 (不读取内容)。
+   用 pread 读 load 自己打开的描述符，不移动读取位置：文件在这期间被替换 (编辑器保存时 rename) 时，
+   哈希和之后解析的仍然是同一个文件 */
+static int hash_file(int fd, unsigned long* size, unsigned long* hash) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > LOAD_CACHE_MAX) { return -1; }
+
+  long cap = READER_BUF_SIZE;
+  unsigned char* buf = malloc(cap);
+  unsigned long h = FNV_OFFSET;
+  unsigned long total = 0;
+  for (;;) {
+    /* 读满整块再哈希，保证按 8 字节分组的位置与文件偏移无关 */
+    long n = 0;
+    ssize_t k;
+    while (n < cap && (k = pread(fd, buf + n, cap - n, total + n)) > 0) { n += k; }
+    h = hash_bytes(h, buf, n);
+    total += n;
+    if (n < cap) { break; }
+  }
+  free(buf);
+  *size = total;
+  *hash = h;
+  return 0;
+}
+
+static void cache_header(ser_buf* b, lcache* c, unsigned long sum) {
+  ser_put(b, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1);
+  ser_byte(b, CACHE_VERSION);
+  ser_byte(b, sizeof(long));
+  unsigned short order = 0x0102;
+  ser_put(b, &order, sizeof(order));
+  unsigned long fp = cache_fingerprint();
+  ser_put(b, &fp, 8);
+  ser_put(b, &c->size, 8);
+  ser_put(b, &c->hash, 8);
+  ser_put(b, &sum, 8);
+}
+
+/* 打开 filename 对应的缓存，fd 是调用者为解析源文件打开的描述符 (只用 pread 读，不改变读取位置)。
+   返回 NULL 表示这个文件不使用缓存；否则 lcache_valid 为真时用 lcache_next 取出表达式，
+   为假时由调用者从 fd 解析源文件并用 lcache_add 记录 */
+lcache* lcache_open(char* filename, int fd) {
+  long len = strlen(filename);
+  if (LOAD_CACHE_MAX <= 0 || len < 5 || strcmp(filename + len - 5, ".lspy") != 0) { return NULL; }
+
+  lcache* c = calloc(1, sizeof(lcache));
+  if (hash_file(fd, &c->size, &c->hash) != 0) {
+    free(c);
+    return NULL;
+  }
+  c->path = malloc(len + 2);
+  strcpy(c->path, filename);
+  strcat(c->path, "c");
+
+  int cfd = open(c->path, O_RDONLY);
+  if (cfd < 0) { return c; }
+  struct stat st;
+  if (fstat(cfd, &st) != 0 || st.st_size < (long)CACHE_HEADER_SIZE) {
+    close(cfd);
+    return c;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+  close(cfd);
+  if (map == MAP_FAILED) { return c; }
+
+  /* 文件头 (包括源文件哈希) 和内容校验和都一致才算命中 */
+  const unsigned char* body = (unsigned char*)map + CACHE_HEADER_SIZE;
+  long body_len = st.st_size - CACHE_HEADER_SIZE;
+  ser_buf h = {0};
+  cache_header(&h, c, cache_sum(body, body_len));
+  int ok = memcmp(map, h.data, h.len) == 0;
+  free(h.data);
+  if (!ok) {
+    munmap(map, st.st_size);
+    return c;
+  }
+
+  c->valid = 1;
+  c->map = map;
+  c->map_len = st.st_size;
+  ser_reader_init(&c->r, body, body_len);
+  return c;
+}
+
+int lcache_valid(lcache* c) {
+  return c && c->valid;
+}
+
+/* 取出下一个表达式，结束时返回 NULL */
+lval* lcache_next(lcache* c) {
+  if (c->r.p >= c->r.end) { return NULL; }
+  lval* x = ser_read_value(&c->r, 0);
+  if (!x) {
+    c->r.p = c->r.end;
+    return lval_err("Cache %s is corrupt", c->path);
+  }
+  return x;
+}
+
+/* 放弃这次的缓存：删除临时文件，之后的 lcache_add 都忽略 */
+static void cache_abandon(lcache* c) {
+  if (c->f) {
+    fclose(c->f);
+    if (!c->anon) { unlink(c->tmp); }
+    c->f = NULL;
+  }
+  lval_del(c->out.err);
+  c->out.err = NULL;
+  c->out.len = 0;
+  c->overflow = 1;
+}
+
+/* 把 out 中满 CACHE_BLOCK 的部分写入临时文件并计入校验和，不足一块的剩余部分留到下次 */
+static void cache_flush(lcache* c) {
+  long done = 0;
+  for (; c->out.len - done >= CACHE_BLOCK; done += CACHE_BLOCK) {
+    if (fwrite(c->out.data + done, 1, CACHE_BLOCK, c->f) != CACHE_BLOCK) {
+      cache_abandon(c);
+      return;
+    }
+    c->sum = hash_bytes(c->sum, (unsigned char*)c->out.data + done, CACHE_BLOCK);
+  }
+  c->written += done;
+  c->out.len -= done;
+  memmove(c->out.data, c->out.data + done, c->out.len);
+}
+
+/* 在缓存文件所在的目录里建一个没有名字的临时文件 (O_TMPFILE)，load 中途 exit 或进程被杀时
+   由内核回收，不会留下 .tmp 文件；文件系统不支持时退回到名为 tmp 的临时文件 */
+static FILE* cache_tmpfile(lcache* c) {
+#ifdef O_TMPFILE
+  char* slash = strrchr(c->path, '/');
+  char* dir = slash ? strndup(c->path, slash == c->path ? 1 : slash - c->path) : strdup(".");
+  int fd = open(dir, O_TMPFILE | O_WRONLY, 0666);
+  free(dir);
+  if (fd >= 0) {
+    FILE* f = fdopen(fd, "wb");
+    if (f) {
+      c->anon = 1;
+      return f;
+    }
+    close(fd);
+  }
+#endif
+  return fopen(c->tmp, "wb");
+}
+
+/* 提交前给没有名字的临时文件起名为 tmp */
+static int cache_link(lcache* c) {
+  if (!c->anon) { return 1; }
+  char proc[64];
+  sprintf(proc, "/proc/self/fd/%d", fileno(c->f));
+  c->anon = 0;
+  return linkat(AT_FDCWD, proc, AT_FDCWD, c->tmp, AT_SYMLINK_FOLLOW) == 0;
+}
+
+/* 第一次写入时创建临时文件，文件头先占位，提交时再填写；目录不可写时放弃缓存 */
+static int cache_begin(lcache* c) {
+  if (c->f) { return 1; }
+  c->tmp = malloc(strlen(c->path) + 64);
+  sprintf(c->tmp, "%s.%ld.%lx.tmp", c->path, (long)getpid(), (unsigned long)c);
+  c->f = cache_tmpfile(c);
+  static const char zero[CACHE_HEADER_SIZE];
+  if (!c->f || fwrite(zero, 1, CACHE_HEADER_SIZE, c->f) != CACHE_HEADER_SIZE) {
+    cache_abandon(c);
+    return 0;
+  }
+  c->sum = FNV_OFFSET;
+  return 1;
+}
+
+/* 记录一个从源文件解析出的表达式 (在求值之前调用，不改变 form) */
+void lcache_add(lcache* c, lval* form) {
+  if (!c || c->valid || c->overflow || !cache_begin(c)) { return; }
+  ser_value(&c->out, form, 0);
+  if (c->out.err || c->written + c->out.len > LOAD_CACHE_MAX) {
+    /* 无法编码或者太大：放弃缓存，删除已经写出的部分 */
+    cache_abandon(c);
+    return;
+  }
+  cache_flush(c);
+}
+
+/* commit 为真时写出剩余内容、回填文件头，再把临时文件 rename 成缓存文件，
+   并发的 load 不会读到写了一半的缓存；写入失败时静默放弃 */
+void lcache_close(lcache* c, int commit) {
+  if (!c) { return; }
+  if (c->valid) {
+    munmap(c->map, c->map_len);
+  } else if (commit && !c->overflow && cache_begin(c)) {
+    c->sum = hash_bytes(c->sum, (unsigned char*)c->out.data, c->out.len);
+    ser_buf h = {0};
+    cache_header(&h, c, c->sum);
+    int ok = (c->out.len == 0 || fwrite(c->out.data, 1, c->out.len, c->f) == (size_t)c->out.len)
+          && fseek(c->f, 0, SEEK_SET) == 0
+          && fwrite(h.data, 1, h.len, c->f) == (size_t)h.len
+          && fflush(c->f) == 0
+          && cache_link(c);
+    ok = fclose(c->f) == 0 && ok;
+    c->f = NULL;
+    if (!ok || rename(c->tmp, c->path) != 0) { unlink(c->tmp); }
+    free(h.data);
+  }
+  if (c->f) { cache_abandon(c); }
+  ser_buf_free(&c->out);
+  ser_reader_free(&c->r);
+  free(c->tmp);
+  free(c->path);
+  free(c);
+}
@@ -0,0 +1,366 @@
+#define _GNU_SOURCE
+#include "config.h"
+#include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+   serve.c
+   在 Unix 域或 TCP 套接字上提供服务，每个请求交给一个 Lispy 处理函数。
+   (serve addr handler) 监听 addr，把监听套接字和之后接受的连接都登记到 event.c 的事件循环里，
+   由 run-loop 在同一个线程、同一个全局环境中处理所有连接，不需要为每个请求启动进程或重新加载 prelude。
+   请求的格式有两种：按行 ("line"，默认，以 \n 结尾，可以带 \r) 和长度前缀帧 ("frame"，4 字节大端长度 + 内容)；
+   每个请求调用一次 (handler 请求)，结果按同样的格式写回：String 原样写出，其他值写出打印形式，
+   处理函数出错时写回错误信息，连接和服务都不受影响。
+   一次读到的多个请求依次处理，回复攒在输出缓冲区里一次写出；写不完时等待可写，积压的回复太多时暂停读取。
+   connect 打开一个到 addr 的客户端连接 (阻塞的 r+ 文件句柄)，可以配合 fread-nb / fwrite-nb 和事件循环使用。
+*/
+
+/* 监听套接字：file 是 serve 返回的文件句柄的一份引用，使服务在没有变量引用句柄时也继续；
+   fclose / unwatch 时 forget 释放这里的状态 */
+typedef struct {
+  lnative base;
+  lval* file;
+  lval* handler;
+  int frame;
+  int fd;
+  int paused;
+} lserver;
+
+/* 一个连接：in 是还没处理完的请求数据，out 是还没写出的回复 */
+typedef struct {
+  lnative base;
+  lval* handler;
+  int frame;
+  int fd;
+  char* in;
+  long in_len;
+  long in_cap;
+  lbuf out;
+  long out_off;
+  int eof;
+} lconn;
+
+/* --- 地址 --- */
+
+/* "unix:路径" 或 "主机:端口" (主机可以为空，表示所有地址)；成功时返回已经 bind 的套接字 */
+static int addr_socket(const char* addr, int listening, char* why, size_t why_len) {
+  if (strncmp(addr, "unix:", 5) == 0) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    const char* path = addr + 5;
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+      snprintf(why, why_len, "path too long");
+      return -1;
+    }
+    strcpy(sa.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { snprintf(why, why_len, "%s", strerror(errno)); return -1; }
+    if (listening) {
+      /* 上次留下的套接字文件 (不会删除普通文件) */
+      struct stat st;
+      if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) { unlink(path); }
+    }
+    int r = listening ? bind(fd, (struct sockaddr*)&sa, sizeof(sa)) : connect(fd, (struct sockaddr*)&sa, sizeof(sa));
+    if (r < 0) {
+      snprintf(why, why_len, "%s", strerror(errno));
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  const char* colon = strrchr(addr, ':');
+  if (!colon) {
+    snprintf(why, why_len, "expected unix:PATH or HOST:PORT");
+    return -1;
+  }
+  char host[256];
+  long hlen = colon - addr;
+  /* [::1]:7000 形式的 IPv6 地址 */
+  if (hlen >= 2 && addr[0] == '[' && addr[hlen - 1] == ']') { addr++; hlen -= 2; }
+  if (hlen >= (long)sizeof(host)) {
+    snprintf(why, why_len, "host name too long");
+    return -1;
+  }
+  memcpy(host, addr, hlen);
+  host[hlen] = '\0';
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  int gai = getaddrinfo(hlen ? host : NULL, colon + 1, &hints, &res);
+  if (gai != 0) {
+    snprintf(why, why_len, "%s", gai_strerror(gai));
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) { continue; }
+    int one = 1;
+    if (listening) { setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)); }
+    int r = listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) : connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if (r == 0) {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      break;
+    }
+    snprintf(why, why_len, "%s", strerror(errno));
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+/* --- 连接 --- */
+
+static void conn_free(lnative* n) {
+  lconn* c = (lconn*)n;
+  close(c->fd);
+  lval_del(c->handler);
+  free(c->in);
+  lbuf_free(&c->out);
+  free(c);
+}
+
+static void conn_close(lconn* c) {
+  loop_remove(c->fd);
+  conn_free(&c->base);
+}
+
+/* 调用处理函数，把回复追加到 out */
+static void conn_handle(lenv* e, lconn* c, const char* req, long len) {
+  lval* s = lval_alloc();
+  s->type = LVAL_STR;
+  s->str = malloc(len + 1);
+  memcpy(s->str, req, len);
+  s->str[len] = '\0';
+
+  lval* r = lval_call(e, lval_copy(c->handler), lval_add(lval_sexpr(), s));
+
+  /* 帧格式先留出长度的位置，写完内容后再填 */
+  long start = c->out.len;
+  if (c->frame) { lbuf_put(&c->out, "\0\0\0\0", 4); }
+  const char* p;
+  long n;
+  if (lval_str_bytes(r, &p, &n)) {
+    lbuf_put(&c->out, p, n);
+  } else {
+    lval_write(&c->out, r);
+  }
+  if (c->frame) {
+    unsigned long m = c->out.len - start - 4;
+    unsigned char* h = (unsigned char*)c->out.data + start;
+    h[0] = m >> 24; h[1] = m >> 16; h[2] = m >> 8; h[3] = m;
+  } else {
+    lbuf_putc(&c->out, '\n');
+  }
+  lval_del(r);
+}
+
+/* 处理 in 中所有完整的请求；请求超过 SERVE_MAX_REQUEST 时返回 -1 */
+static int conn_requests(lenv* e, lconn* c) {
+  long pos = 0;
+  for (;;) {
+    const char* p = c->in + pos;
+    long avail = c->in_len - pos;
+    if (c->frame) {
+      if (avail < 4) { break; }
+      const unsigned char* h = (const unsigned char*)p;
+      long m = ((long)h[0] << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+      if (m > SERVE_MAX_REQUEST) { return -1; }
+      if (avail < 4 + m) { break; }
+      conn_handle(e, c, p + 4, m);
+      pos += 4 + m;
+    } else {
+      const char* nl = memchr(p, '\n', avail);
+      if (!nl) {
+        /* 连接结束时最后一行可以没有换行 */
+        if (c->eof && avail > 0) {
+          conn_handle(e, c, p, avail);
+          pos += avail;
+        }
+        break;
+      }
+      long m = nl - p;
+      conn_handle(e, c, p, m > 0 && p[m - 1] == '\r' ? m - 1 : m);
+      pos += m + 1;
+    }
+  }
+  memmove(c->in, c->in + pos, c->in_len - pos);
+  c->in_len -= pos;
+  return c->in_len > SERVE_MAX_REQUEST + 4 ? -1 : 0;
+}
+
+/* 尽量写出 out；出错时返回 -1 */
+static int conn_flush(lconn* c) {
+  while (c->out_off < c->out.len) {
+    /* 对方已经关闭时不要收到 SIGPIPE */
+    ssize_t n = send(c->fd, c->out.data + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) { return 0; }
+      return -1;
+    }
+    c->out_off += n;
+  }
+  c->out.len = c->out_off = 0;
+  if (c->out.cap > LBUF_KEEP) { lbuf_free(&c->out); }
+  return 0;
+}
+
+static lval* conn_ready(lenv* e, lnative* n, unsigned events) {
+  lconn* c = (lconn*)n;
+
+  if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c->eof) {
+    if (c->in_cap - c->in_len < SERVE_READ_SIZE) {
+      c->in_cap = c->in_len + SERVE_READ_SIZE;
+      c->in = realloc(c->in, c->in_cap);
+    }
+    ssize_t r;
+    do { r = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len); } while (r < 0 && errno == EINTR);
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      conn_close(c);
+      return NULL;
+    }
+    if (r == 0) { c->eof = 1; }
+    if (r > 0) { c->in_len += r; }
+    if (conn_requests(e, c) < 0) {
+      /* 请求太长：丢掉剩下的输入，写完已有的回复后关闭 */
+      c->in_len = 0;
+      c->eof = 1;
+    }
+  }
+
+  if (conn_flush(c) < 0) {
+    conn_close(c);
+    return NULL;
+  }
+
+  long pending = c->out.len - c->out_off;
+  if (c->eof && pending == 0) {
+    conn_close(c);
+    return NULL;
+  }
+  /* 积压的回复太多时先不读新的请求，等对方读走 */
+  unsigned want = (!c->eof && pending < SERVE_MAX_REQUEST ? EPOLLIN : 0) | (pending ? EPOLLOUT : 0);
+  loop_events(c->fd, want);
+  return NULL;
+}
+
+/* --- 监听 --- */
+
+/* 连接就绪时由事件循环调用，暂停期间由 loop_after 的定时器调用 (events 为 0) */
+static lval* server_ready(lenv* e, lnative* n, unsigned events) {
+  lserver* s = (lserver*)n;
+  for (;;) {
+    int fd = accept4(s->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) { continue; }
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+        /* 描述符或内存用完：等待中的连接还在队列里，监听套接字会一直可读。
+           先不等待可读，过一会儿由定时器再试，避免空转 */
+        if (!s->paused) { loop_events(s->fd, 0); }
+        s->paused = 1;
+        loop_after(SERVE_ACCEPT_RETRY_MS, &s->base);
+        return NULL;
+      }
+      /* EAGAIN：已经接受完 */
+      break;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  /* Unix 域套接字上无效，忽略 */
+
+    lconn* c = calloc(1, sizeof(lconn));
+    c->base.ready = conn_ready;
+    c->base.forget = conn_free;
+    c->handler = lval_copy(s->handler);
+    c->frame = s->frame;
+    c->fd = fd;
+    lbuf_init(&c->out, NULL);
+    if (loop_add(fd, EPOLLIN, &c->base) < 0) { conn_free(&c->base); }
+  }
+  if (s->paused) {
+    s->paused = 0;
+    loop_events(s->fd, EPOLLIN);
+  }
+  return NULL;
+}
+
+/* 监听的文件被 fclose / unwatch：不再接受新连接，已有的连接继续 */
+static void server_forget(lnative* n) {
+  lserver* s = (lserver*)n;
+  lval_del(s->handler);
+  lval_del(s->file);
+  free(s);
+}
+
+/* (serve addr handler [format])：在 addr 上监听，每个请求调用 (handler 请求)；返回监听的文件句柄 */
+lval* builtin_serve(lenv* e, lval* a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function 'serve' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+  LASSERT_TYPE("serve", a, 0, LVAL_STR);
+  LASSERT_TYPE("serve", a, 1, LVAL_FUN);
+  if (a->count == 3) { LASSERT_TYPE("serve", a, 2, LVAL_STR); }
+  char* format = a->count == 3 ? a->cell[2]->str : "line";
+  LASSERT(a, strcmp(format, "line") == 0 || strcmp(format, "frame") == 0,
+    "Function 'serve' passed an unknown format '%s'. Expected line or frame.", format);
+
+  char why[128];
+  int fd = addr_socket(a->cell[0]->str, 1, why, sizeof(why));
+  LASSERT(a, fd >= 0, "Function 'serve' could not listen on '%s': %s", a->cell[0]->str, why);
+  if (listen(fd, SERVE_BACKLOG) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+    lval* err = lval_err("Function 'serve' could not listen on '%s': %s", a->cell[0]->str, strerror(errno));
+    close(fd);
+    lval_del(a);
+    return err;
+  }
+
+  lserver* s = malloc(sizeof(lserver));
+  s->base.ready = server_ready;
+  s->base.forget = server_forget;
+  s->frame = format[0] == 'f';
+  s->fd = fd;
+  s->paused = 0;
+  s->handler = lval_pop(a, 1);
+  lval* f = lval_file("r");
+  f->file_rc->file = fdopen(fd, "r");
+  s->file = lval_copy(f);
+
+  if (loop_add(fd, EPOLLIN, &s->base) < 0) {
+    lval* err = lval_err("Function 'serve' could not watch '%s': %s", a->cell[0]->str, strerror(errno));
+    server_forget(&s->base);
+    lval_del(f);
+    lval_del(a);
+    return err;
+  }
+  lval_del(a);
+  return f;
+}
+
+/* (connect addr)：到 addr 的客户端连接，可读可写 */
+lval* builtin_connect(lenv* e, lval* a) {
+  LASSERT_NUM("connect", a, 1);
+  LASSERT_TYPE("connect", a, 0, LVAL_STR);
+  char why[128];
+  int fd = addr_socket(a->cell[0]->str, 0, why, sizeof(why));
+  LASSERT(a, fd >= 0, "Function 'connect' could not connect to '%s': %s", a->cell[0]->str, why);
+  lval_del(a);
+  lval* f = lval_file("r+");
+  f->file_rc->file = fdopen(fd, "r+");
+  return f;
+}
@@ -0,0 +1,211 @@
+#include "config.h"
+#include "error.h"
+
+/*
+   sort.c
+   原生的 sort / sort-by。
+   列表元素先收集到 sort_item 数组 (元素指针 + 缓存的排序键)，再做稳定的自底向上归并排序，
+   最后按顺序写回原列表的 cell 数组，整个过程不复制元素本身。
+   不传比较函数时，纯数字/纯字符串列表直接按键比较，不回调 Lispy 函数；
+   紧凑存储的数字列表直接对底层数组排序。
+*/
+
+enum { SORT_KEY_NUM, SORT_KEY_DEC, SORT_KEY_STR, SORT_KEY_CMP };
+
+typedef struct {
+  lval* val;
+  lval* key;   /* sort-by 缓存的键，释放时一并删除 */
+  union { long n; double d; char* s; } k;
+} sort_item;
+
+typedef struct {
+  lenv* e;
+  int kind;
+  lval* cmp;   /* 用户比较函数 (SORT_KEY_CMP) */
+  lval* err;   /* 比较函数出错时记录下来，排序提前结束 */
+} sort_ctx;
+
+#define SORT_RUN 16
+
+/* 比较 a < b，用户比较函数收到的是元素的副本 */
+static int sort_less(sort_ctx* c, sort_item* a, sort_item* b) {
+  switch (c->kind) {
+    case SORT_KEY_NUM: return a->k.n < b->k.n;
+    case SORT_KEY_DEC: return a->k.d < b->k.d;
+    case SORT_KEY_STR: return strcmp(a->k.s, b->k.s) < 0;
+  }
+
+  if (c->err) { return 0; }
+  lval* args = lval_sexpr();
+  lval_add(args, lval_copy(a->val));
+  lval_add(args, lval_copy(b->val));
+  lval* r = lval_call(c->e, lval_copy(c->cmp), args);
+  if (r->type == LVAL_ERR) {
+    c->err = r;
+    return 0;
+  }
+  int less = lval_is_true(r);
+  lval_del(r);
+  return less;
+}
+
+/* 稳定归并排序：先对每段 SORT_RUN 个元素做插入排序，再逐层两两归并 */
+static void sort_items(sort_ctx* c, sort_item* items, long n) {
+  for (long lo = 0; lo < n; lo += SORT_RUN) {
+    long hi = lo + SORT_RUN < n ? lo + SORT_RUN : n;
+    for (long i = lo + 1; i < hi; i++) {
+      sort_item x = items[i];
+      long j = i;
+      while (j > lo && sort_less(c, &x, &items[j-1])) {
+        items[j] = items[j-1];
+        j--;
+      }
+      items[j] = x;
+    }
+  }
+  if (n <= SORT_RUN) { return; }
+
+  sort_item* buf = malloc(sizeof(sort_item) * n);
+  sort_item* src = items;
+  sort_item* dst = buf;
+  for (long width = SORT_RUN; width < n; width *= 2) {
+    for (long lo = 0; lo < n; lo += 2 * width) {
+      long mid = lo + width < n ? lo + width : n;
+      long hi = lo + 2 * width < n ? lo + 2 * width : n;
+      long i = lo, j = mid, k = lo;
+      /* 只有右边严格更小时才取右边，保证稳定 */
+      while (i < mid && j < hi) {
+        dst[k++] = sort_less(c, &src[j], &src[i]) ? src[j++] : src[i++];
+      }
+      while (i < mid) { dst[k++] = src[i++]; }
+      while (j < hi) { dst[k++] = src[j++]; }
+    }
+    sort_item* t = src; src = dst; dst = t;
+  }
+  if (src != items) { memcpy(items, src, sizeof(sort_item) * n); }
+  free(buf);
+}
+
+static int sort_cmp_long(const void* a, const void* b) {
+  long x = *(const long*)a, y = *(const long*)b;
+  return (x > y) - (x < y);
+}
+
+static int sort_cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/* 根据键的类型选择比较方式并填好 sort_item 的键，键类型不统一时返回 -1 */
+static int sort_key_kind(lval* key, int kind) {
+  int k;
+  switch (key->type) {
+    case LVAL_NUM: k = SORT_KEY_NUM; break;
+    case LVAL_DEC: k = SORT_KEY_DEC; break;
+    case LVAL_STR: k = SORT_KEY_STR; break;
+    default: return -1;
+  }
+  if (kind < 0 || kind == k) { return k; }
+  /* 整数和小数混合时统一按小数比较 */
+  if ((kind == SORT_KEY_NUM && k == SORT_KEY_DEC) || (kind == SORT_KEY_DEC && k == SORT_KEY_NUM)) {
+    return SORT_KEY_DEC;
+  }
+  return -1;
+}
+
+static void sort_fill_key(sort_item* it, int kind) {
+  lval* key = it->key ? it->key : it->val;
+  if (kind == SORT_KEY_NUM) { it->k.n = key->num; }
+  if (kind == SORT_KEY_DEC) { it->k.d = key->type == LVAL_NUM ? (double)key->num : key->dec; }
+  if (kind == SORT_KEY_STR) { it->k.s = key->str; }
+}
+
+/* 排序 q 的元素。cmp 非空时用它比较，keyf 非空时先对每个元素求一次键 */
+static lval* sort_list(lenv* e, lval* q, lval* cmp, lval* keyf, char* func) {
+  /* 紧凑存储的数字列表，无需装箱，直接排底层数组 */
+  if (q->arr && q->arr->kind != ARR_LVAL && !cmp && !keyf) {
+    void* data = lval_packed_own(q);
+    qsort(data, q->count, q->arr->kind == ARR_I64 ? sizeof(long) : sizeof(double),
+      q->arr->kind == ARR_I64 ? sort_cmp_long : sort_cmp_double);
+    return q;
+  }
+  lval_unpack(q);
+
+  long n = q->count;
+  sort_item* items = malloc(sizeof(sort_item) * (n ? n : 1));
+  sort_ctx c = { e, SORT_KEY_CMP, cmp, NULL };
+  lval* err = NULL;
+
+  for (long i = 0; i < n; i++) {
+    items[i].val = q->cell[i];
+    items[i].key = NULL;
+  }
+
+  if (keyf) {
+    for (long i = 0; i < n && !err; i++) {
+      lval* args = lval_add(lval_sexpr(), lval_copy(items[i].val));
+      lval* key = lval_call(e, lval_copy(keyf), args);
+      if (key->type == LVAL_ERR) { err = key; break; }
+      items[i].key = key;
+    }
+  }
+
+  if (!cmp && !err) {
+    int kind = -1;
+    for (long i = 0; i < n; i++) {
+      lval* key = items[i].key ? items[i].key : items[i].val;
+      kind = sort_key_kind(key, kind);
+      if (kind < 0) {
+        err = lval_err("Function '%s' can only compare Numbers or Strings without a comparator. Got %s at index %li.",
+          func, ltype_name(key->type), i);
+        break;
+      }
+    }
+    if (!err) {
+      c.kind = kind;
+      for (long i = 0; i < n; i++) { sort_fill_key(&items[i], kind); }
+    }
+  }
+
+  if (!err) {
+    sort_items(&c, items, n);
+    err = c.err;
+  }
+
+  if (!err) {
+    for (long i = 0; i < n; i++) { q->cell[i] = items[i].val; }
+  }
+  for (long i = 0; i < n; i++) { lval_del(items[i].key); }
+  free(items);
+
+  if (err) {
+    lval_del(q);
+    return err;
+  }
+  return q;
+}
+
+lval* builtin_sort(lenv* e, lval* a) {
+  LASSERT(a, a->count == 1 || a->count == 2,
+    "Function 'sort' passed incorrect number of arguments. Got %i, Expected 1 or 2.", a->count);
+  if (a->count == 2) { LASSERT_TYPE("sort", a, 0, LVAL_FUN); }
+  LASSERT_TYPE("sort", a, a->count - 1, LVAL_QEXPR);
+
+  lval* cmp = a->count == 2 ? lval_pop(a, 0) : NULL;
+  lval* q = lval_take(a, 0);
+  lval* r = sort_list(e, q, cmp, NULL, "sort");
+  lval_del(cmp);
+  return r;
+}
+
+lval* builtin_sort_by(lenv* e, lval* a) {
+  LASSERT_NUM("sort-by", a, 2);
+  LASSERT_TYPE("sort-by", a, 0, LVAL_FUN);
+  LASSERT_TYPE("sort-by", a, 1, LVAL_QEXPR);
+
+  lval* keyf = lval_pop(a, 0);
+  lval* q = lval_take(a, 0);
+  lval* r = sort_list(e, q, NULL, keyf, "sort-by");
+  lval_del(keyf);
+  return r;
+}
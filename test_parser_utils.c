@@ -22,6 +22,16 @@ lval* lval_num(long x) {
     return v;
 }
 
+lval* lval_dec(double x) {
+    lval* v = lval_alloc();
+    v->type = LVAL_DEC;
+    v->dec = x;
+    v->count = 0;
+    v->cell = NULL;
+    v->file_rc = NULL;
+    return v;
+}
+
 lval* lval_err(char* fmt, ...) {
     lval* v = lval_alloc();
     v->type = LVAL_ERR;
@@ -61,6 +71,30 @@ lval* lval_str(char* s) {
     return v;
 }
 
+lval* lval_sym_n(char* s, int n) {
+    lval* v = lval_alloc();
+    v->type = LVAL_SYM;
+    v->sym = malloc(n + 1);
+    memcpy(v->sym, s, n);
+    v->sym[n] = '\0';
+    v->count = 0;
+    v->cell = NULL;
+    v->file_rc = NULL;
+    return v;
+}
+
+lval* lval_str_n(char* s, int n) {
+    lval* v = lval_alloc();
+    v->type = LVAL_STR;
+    v->str = malloc(n + 1);
+    memcpy(v->str, s, n);
+    v->str[n] = '\0';
+    v->count = 0;
+    v->cell = NULL;
+    v->file_rc = NULL;
+    return v;
+}
+
 lval* lval_sexpr(void) {
     lval* v = lval_alloc();
     v->type = LVAL_SEXPR;
@@ -104,3 +138,7 @@ lval* lval_add(lval* v, lval* x) {
     v->cell[v->count-1] = x;
     return v;
 }
+
+lval* lval_pack(lval* v) {
+    return v;
+}
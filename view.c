@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include "config.h"
+#include "error.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+   view.c
+   内存映射的只读文件 (LVAL_VIEW)。
+   mmap-open 把整个文件映射进来，返回引用映射页面的视图，不把内容读进内存也不复制；
+   substring 在视图上得到新的视图，file-lines 逐行得到视图，都只是 (映射, 偏移, 长度)。
+   映射和视图都是引用计数的，最后一个视图释放时 munmap。
+   视图不以 '\0' 结尾，可以包含任意字节；需要普通 String 时用 to-string 复制出来。
+   substring / string-find 同样接受 String。
+*/
+
+lval* lval_view(lval_map_t* m, long off, long len) {
+  lval* v = lval_alloc();
+  v->type = LVAL_VIEW;
+  v->view = malloc(sizeof(lval_view_t));
+  v->view->ref_count = 1;
+  v->view->map = m;
+  v->view->off = off;
+  v->view->len = len;
+  m->ref_count++;
+  return v;
+}
+
+void lval_view_release(lval_view_t* v) {
+  v->ref_count--;
+  if (v->ref_count > 0) { return; }
+  lval_map_t* m = v->map;
+  m->ref_count--;
+  if (m->ref_count == 0) {
+    if (m->data) { munmap(m->data, m->len); }
+    free(m);
+  }
+  free(v);
+}
+
+/* String 或 View 的内容和长度；其他类型返回 0 */
+int lval_str_bytes(lval* x, const char** s, long* n) {
+  if (x->type == LVAL_STR) {
+    *s = x->str;
+    *n = strlen(x->str);
+    return 1;
+  }
+  if (x->type == LVAL_VIEW) {
+    *s = x->view->map->data + x->view->off;
+    *n = x->view->len;
+    return 1;
+  }
+  return 0;
+}
+
+/* 视图中从 *pos 开始的一行 (去掉行尾的 \n 或 \r\n)，作为新的视图；没有更多的行时返回 NULL */
+lval* lval_view_line(lval* v, long* pos) {
+  lval_view_t* w = v->view;
+  if (*pos >= w->len) { return NULL; }
+  const char* start = w->map->data + w->off + *pos;
+  const char* nl = memchr(start, '\n', w->len - *pos);
+  long n = nl ? nl - start : w->len - *pos;
+  *pos += nl ? n + 1 : n;
+  if (n > 0 && start[n - 1] == '\r') { n--; }
+  return lval_view(w->map, start - w->map->data, n);
+}
+
+/* (mmap-open "file")：整个文件的只读视图 */
+lval* builtin_mmap_open(lenv* e, lval* a) {
+  LASSERT_NUM("mmap-open", a, 1);
+  LASSERT_TYPE("mmap-open", a, 0, LVAL_STR);
+
+  char* filename = a->cell[0]->str;
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    if (fd >= 0) { close(fd); }
+    lval* err = lval_err("Function 'mmap-open' could not open file '%s'.", filename);
+    lval_del(a);
+    return err;
+  }
+
+  /* 空文件不能映射，用一个空的映射代替 */
+  char* data = NULL;
+  if (st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      lval* err = lval_err("Function 'mmap-open' could not map file '%s'.", filename);
+      lval_del(a);
+      return err;
+    }
+  }
+  close(fd);
+  lval_del(a);
+
+  lval_map_t* m = malloc(sizeof(lval_map_t));
+  m->ref_count = 0;
+  m->len = st.st_size;
+  m->data = data;
+  return lval_view(m, 0, m->len);
+}
+
+/* (substring s start [end])：字节区间 [start, end)，end 缺省为末尾，负数从末尾倒数。
+   View 得到共享映射的新视图，String 得到新的 String */
+lval* builtin_substring(lenv* e, lval* a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function 'substring' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+  LASSERT(a, a->cell[0]->type == LVAL_STR || a->cell[0]->type == LVAL_VIEW,
+    "Function 'substring' passed incorrect type for argument 0. Got %s, Expected %s or %s.",
+    ltype_name(a->cell[0]->type), ltype_name(LVAL_STR), ltype_name(LVAL_VIEW));
+  LASSERT_TYPE("substring", a, 1, LVAL_NUM);
+  if (a->count == 3) { LASSERT_TYPE("substring", a, 2, LVAL_NUM); }
+
+  const char* s;
+  long n;
+  lval_str_bytes(a->cell[0], &s, &n);
+  long start = a->cell[1]->num;
+  long end = a->count == 3 ? a->cell[2]->num : n;
+  if (start < 0) { start += n; }
+  if (end < 0) { end += n; }
+  LASSERT(a, start >= 0 && start <= end && end <= n,
+    "Function 'substring' passed an invalid range [%li, %li) for length %li.", start, end, n);
+
+  lval* x = a->cell[0];
+  lval* r;
+  if (x->type == LVAL_VIEW) {
+    r = lval_view(x->view->map, x->view->off + start, end - start);
+  } else {
+    r = lval_alloc();
+    r->type = LVAL_STR;
+    r->str = malloc(end - start + 1);
+    memcpy(r->str, s + start, end - start);
+    r->str[end - start] = '\0';
+  }
+  lval_del(a);
+  return r;
+}
+
+/* (string-find s needle [start])：needle 在 s 中从 start 开始第一次出现的字节偏移，找不到返回 -1 */
+lval* builtin_string_find(lenv* e, lval* a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+    "Function 'string-find' passed incorrect number of arguments. Got %i, Expected 2 or 3.", a->count);
+  for (int i = 0; i < 2; i++) {
+    LASSERT(a, a->cell[i]->type == LVAL_STR || a->cell[i]->type == LVAL_VIEW,
+      "Function 'string-find' passed incorrect type for argument %i. Got %s, Expected %s or %s.",
+      i, ltype_name(a->cell[i]->type), ltype_name(LVAL_STR), ltype_name(LVAL_VIEW));
+  }
+  if (a->count == 3) { LASSERT_TYPE("string-find", a, 2, LVAL_NUM); }
+
+  const char *s, *needle;
+  long n, m;
+  lval_str_bytes(a->cell[0], &s, &n);
+  lval_str_bytes(a->cell[1], &needle, &m);
+  long start = a->count == 3 ? a->cell[2]->num : 0;
+  LASSERT(a, start >= 0 && start <= n,
+    "Function 'string-find' passed an invalid start %li for length %li.", start, n);
+
+  const char* hit = memmem(s + start, n - start, needle, m);
+  lval_del(a);
+  return lval_num(hit ? hit - s : -1);
+}